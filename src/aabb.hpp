@@ -0,0 +1,132 @@
+#ifndef AABB_HPP
+#define AABB_HPP
+
+
+#include "vec.hpp"
+#include "ray.hpp"
+
+
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+
+// Axis-aligned bounding box, default constructed box is empty
+class AABB {
+public:
+
+    AABB() :
+        min_(
+            std::numeric_limits<double>::infinity(),
+            std::numeric_limits<double>::infinity(),
+            std::numeric_limits<double>::infinity()),
+        max_(
+            -std::numeric_limits<double>::infinity(),
+            -std::numeric_limits<double>::infinity(),
+            -std::numeric_limits<double>::infinity())
+    {}
+
+    AABB(const Point3 & min, const Point3 & max) :
+        min_(min),
+        max_(max)
+    {}
+
+    Point3 min() const { return min_; }
+    Point3 max() const { return max_; }
+
+    Point3 center() const { return 0.5 * (min_ + max_); }
+    Vec3 extent() const { return max_ - min_; }
+
+    bool empty() const { return min_.x > max_.x || min_.y > max_.y || min_.z > max_.z; }
+
+    // Non-empty with finite bounds, infinite primitives such as planes are not
+    bool bounded() const
+    {
+        return !empty() &&
+            std::isfinite(min_.x) && std::isfinite(min_.y) && std::isfinite(min_.z) &&
+            std::isfinite(max_.x) && std::isfinite(max_.y) && std::isfinite(max_.z);
+    }
+
+    void extend(const Point3 & p)
+    {
+        for (int i = 0; i < 3; ++i) {
+            min_[i] = std::min(min_[i], p[i]);
+            max_[i] = std::max(max_[i], p[i]);
+        }
+    }
+
+    void extend(const AABB & box)
+    {
+        for (int i = 0; i < 3; ++i) {
+            min_[i] = std::min(min_[i], box.min_[i]);
+            max_[i] = std::max(max_[i], box.max_[i]);
+        }
+    }
+
+    double surface_area() const
+    {
+        if (empty())
+            return 0;
+
+        Vec3 e = extent();
+        return 2 * (e.x * e.y + e.y * e.z + e.z * e.x);
+    }
+
+    int longest_axis() const
+    {
+        Vec3 e = extent();
+
+        if (e.x > e.y && e.x > e.z)
+            return 0;
+
+        return e.y > e.z ? 1 : 2;
+    }
+
+    // Slab test, `inv_direction` is the component-wise inverse of the ray direction
+    bool hit(const Point3 & origin, const Vec3 & inv_direction, double t_min, double t_max) const
+    {
+        for (int i = 0; i < 3; ++i) {
+            double t_0 = (min_[i] - origin[i]) * inv_direction[i];
+            double t_1 = (max_[i] - origin[i]) * inv_direction[i];
+
+            if (inv_direction[i] < 0)
+                std::swap(t_0, t_1);
+
+            t_min = t_0 > t_min ? t_0 : t_min;
+            t_max = t_1 < t_max ? t_1 : t_max;
+
+            if (t_max < t_min)
+                return false;
+        }
+
+        return true;
+    }
+
+    bool hit(const Ray & r, double t_min, double t_max) const
+    {
+        Vec3 d = r.direction();
+        return hit(r.origin(), Vec3(1 / d.x, 1 / d.y, 1 / d.z), t_min, t_max);
+    }
+
+private:
+    Point3 min_;
+    Point3 max_;
+};
+
+
+inline AABB merge(const AABB & a, const AABB & b)
+{
+    AABB box = a;
+    box.extend(b);
+    return box;
+}
+
+
+// Bounds at `t` in [0, 1] of an object moving linearly from box `a` to box `b`
+inline AABB lerp(const AABB & a, const AABB & b, const double & t)
+{
+    return AABB(a.min() + t * (b.min() - a.min()), a.max() + t * (b.max() - a.max()));
+}
+
+
+#endif // AABB_HPP
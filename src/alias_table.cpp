@@ -0,0 +1,77 @@
+#include "alias_table.hpp"
+
+
+#include <algorithm>
+#include <cmath>
+
+
+AliasTable::AliasTable(const std::vector<double> & weights) :
+    bins_(weights.size())
+{
+    for (double w : weights)
+        total_ += w;
+
+    if (total_ <= 0)
+        return;
+
+    // Scaled weights average to 1, bins below it are topped up by bins above it (Vose 1991)
+    std::vector<double> scaled(weights.size());
+    std::vector<uint32_t> under, over;
+
+    for (uint32_t i = 0; i < weights.size(); ++i) {
+        bins_[i].pmf = weights[i] / total_;
+        scaled[i] = weights[i] / total_ * weights.size();
+        (scaled[i] < 1 ? under : over).push_back(i);
+    }
+
+    while (!under.empty() && !over.empty()) {
+        uint32_t small = under.back(), large = over.back();
+        under.pop_back();
+
+        bins_[small] = { float(scaled[small]), bins_[small].pmf, large };
+        scaled[large] -= 1 - scaled[small];
+
+        if (scaled[large] < 1) {
+            over.pop_back();
+            under.push_back(large);
+        }
+    }
+
+    // Leftovers differ from 1 by rounding only
+    for (uint32_t i : under)
+        bins_[i] = { 1, bins_[i].pmf, i };
+    for (uint32_t i : over)
+        bins_[i] = { 1, bins_[i].pmf, i };
+}
+
+std::optional<AliasTable::Sample> AliasTable::sample(double u) const
+{
+    if (total_ <= 0)
+        return std::nullopt;
+
+    double x = u * bins_.size();
+    uint32_t i = std::min<uint32_t>(x, bins_.size() - 1);
+    double f = std::min(x - i, std::nextafter(1.0, 0.0));
+
+    const Bin & bin = bins_[i];
+
+    if (f < bin.threshold)
+        return Sample { i, bin.pmf, std::min(f / bin.threshold, std::nextafter(1.0, 0.0)) };
+
+    return Sample { bin.alias, bins_[bin.alias].pmf, std::min((f - bin.threshold) / (1 - bin.threshold), std::nextafter(1.0, 0.0)) };
+}
+
+double AliasTable::pmf(const uint32_t & index) const
+{
+    return total_ > 0 ? bins_[index].pmf : 0;
+}
+
+size_t AliasTable::size() const
+{
+    return bins_.size();
+}
+
+double AliasTable::total() const
+{
+    return total_;
+}
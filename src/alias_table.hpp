@@ -0,0 +1,47 @@
+#ifndef ALIAS_TABLE_HPP
+#define ALIAS_TABLE_HPP
+
+
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+
+// Walker's alias method: picks an index in proportion to non-negative weights in constant time.
+// Every bin holds its own index with probability `threshold` and its alias otherwise
+class AliasTable {
+public:
+
+    struct Sample {
+        uint32_t index;
+        double pmf;
+        double u;  // the uniform number remapped to [0, 1) after the choice, for reuse
+    };
+
+    AliasTable() = default;
+    AliasTable(const std::vector<double> & weights);
+
+    // Index picked with the uniform number `u` in [0, 1), empty when all weights are zero
+    std::optional<Sample> sample(double u) const;
+
+    double pmf(const uint32_t & index) const;
+
+    size_t size() const;
+
+    double total() const;
+
+private:
+
+    // Single precision keeps tables of multi-megapixel maps small
+    struct Bin {
+        float threshold;
+        float pmf;
+        uint32_t alias;
+    };
+
+    std::vector<Bin> bins_;
+    double total_ = 0;
+};
+
+
+#endif // ALIAS_TABLE_HPP
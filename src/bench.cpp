@@ -0,0 +1,1680 @@
+#include "bench.hpp"
+#include "bvh8.hpp"
+#include "bvh_cache.hpp"
+#include "grid.hpp"
+#include "instance.hpp"
+#include "morton.hpp"
+#include "sphere.hpp"
+#include "sphere_set.hpp"
+#include "moving_sphere.hpp"
+#include "plane.hpp"
+#include "render.hpp"
+#include "scene.hpp"
+#include "parallel.hpp"
+
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <numbers>
+#include <numeric>
+#include <random>
+#include <sstream>
+#include <tuple>
+#include <optional>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double seconds_since(const Clock::time_point & start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// One jittered ray per pixel of a w x h image
+std::vector<Ray> primary_rays(const Camera & cam, const int & w, const int & h)
+{
+    std::vector<Ray> rays;
+    rays.reserve(w * h);
+
+    std::minstd_rand gen(0);
+
+    for (int i = 0; i < h; ++i)
+        for (int j = 0; j < w; ++j)
+            rays.push_back(cam.get_ray((j + 0.5) / (w - 1), (h - 1 - i + 0.5) / (h - 1), gen));
+
+    return rays;
+}
+
+// Primary rays of a w x h image ordered tile by tile, so that every run of tile_w * tile_h rays
+// covers one tile of neighbouring pixels. Tiles are cut at the image border
+std::vector<Ray> tiled_primary_rays(const Camera & cam, const int & w, const int & h, const int & tile_w, const int & tile_h)
+{
+    std::vector<Ray> rays;
+    rays.reserve(w * h);
+
+    std::minstd_rand gen(0);
+
+    for (int i_0 = 0; i_0 < h; i_0 += tile_h)
+        for (int j_0 = 0; j_0 < w; j_0 += tile_w)
+            for (int i = i_0; i < std::min(i_0 + tile_h, h); ++i)
+                for (int j = j_0; j < std::min(j_0 + tile_w, w); ++j)
+                    rays.push_back(cam.get_ray((j + 0.5) / (w - 1), (h - 1 - i + 0.5) / (h - 1), gen));
+
+    return rays;
+}
+
+// Closest hit throughput over all hardware threads
+double rays_per_second(const Hittable & objects, const std::vector<Ray> & rays)
+{
+    auto start = Clock::now();
+
+    parallel_for(rays.size(), [&] (size_t i) {
+        objects.trace(rays[i], 0.0001, std::numeric_limits<float>::infinity());
+    }, 256);
+
+    return rays.size() / seconds_since(start);
+}
+
+// Hardware cache miss counter of the calling thread and the threads it starts while enabled,
+// unavailable when the kernel or the virtual machine does not expose performance counters
+class CacheMissCounter {
+public:
+
+    enum class Level { L1D, LLC };
+
+    explicit CacheMissCounter(const Level & level)
+    {
+        perf_event_attr attr {};
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config =
+            (level == Level::L1D ? PERF_COUNT_HW_CACHE_L1D : PERF_COUNT_HW_CACHE_LL) |
+            PERF_COUNT_HW_CACHE_OP_READ << 8 |
+            PERF_COUNT_HW_CACHE_RESULT_MISS << 16;
+        attr.disabled = 1;
+        attr.inherit = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+
+        fd_ = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+
+    ~CacheMissCounter()
+    {
+        if (fd_ >= 0)
+            close(fd_);
+    }
+
+    CacheMissCounter(const CacheMissCounter &) = delete;
+    CacheMissCounter & operator= (const CacheMissCounter &) = delete;
+
+    void start()
+    {
+        if (fd_ >= 0) {
+            ioctl(fd_, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd_, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+
+    std::optional<uint64_t> stop()
+    {
+        uint64_t count;
+
+        if (fd_ < 0 || ioctl(fd_, PERF_EVENT_IOC_DISABLE, 0) != 0 || read(fd_, &count, sizeof(count)) != sizeof(count))
+            return std::nullopt;
+
+        return count;
+    }
+
+private:
+
+    int fd_;
+};
+
+// Binary BVH build time of the SAH, LBVH and HLBVH builders on sphere fields at 1, 2, 4, ... threads
+// up to the hardware threads, with the speedup over a single thread. The SAH builder runs serially and
+// serves as the flat baseline, the linear builders should approach the thread count
+int bench_builders(const std::vector<std::string> & args)
+{
+    std::vector<size_t> field_sizes = { 1'000'000, 10'000'000 };
+    if (!args.empty())
+        field_sizes = { std::stoull(args[0]) };
+
+    const unsigned int max_threads = thread_count();
+
+    std::vector<unsigned int> thread_counts;
+    for (unsigned int n = 1; n < max_threads; n *= 2)
+        thread_counts.push_back(n);
+    thread_counts.push_back(max_threads);
+
+    std::cout << std::left
+        << std::setw(28) << "scene"
+        << std::setw(12) << "builder"
+        << std::setw(12) << "threads"
+        << std::setw(12) << "build s"
+        << "speedup" << std::endl;
+
+    for (size_t field_size : field_sizes) {
+        HittableList objects = sphere_field(field_size);
+
+        for (auto [builder, name] : {
+            std::pair(BVH::Builder::SAH, "sah"),
+            std::pair(BVH::Builder::LBVH, "lbvh"),
+            std::pair(BVH::Builder::HLBVH, "hlbvh") })
+        {
+            double single = 0;
+
+            for (unsigned int n : thread_counts) {
+                set_thread_count(n);
+
+                auto start = Clock::now();
+                BVH bvh(objects, builder);
+                double build_time = seconds_since(start);
+
+                if (n == 1)
+                    single = build_time;
+
+                std::cout << std::left
+                    << std::setw(28) << "sphere_field(" + std::to_string(field_size) + ")"
+                    << std::setw(12) << name
+                    << std::setw(12) << n
+                    << std::setw(12) << std::fixed << std::setprecision(3) << build_time
+                    << std::setprecision(2) << single / build_time << std::endl;
+            }
+        }
+    }
+
+    set_thread_count(0);
+
+    return 0;
+}
+
+// Sphere field whose spheres drift in random directions over a sequence of frames, with the tree updated
+// by refitting and rebuilding the subtrees whose cost degraded against a full SAH build every frame.
+// Update time, rebuilt subtrees and primary ray throughput are summed or averaged over the frames,
+// mismatches count the rays whose closest hits differ between the two trees and should be 0
+int bench_animation(const std::vector<std::string> & args)
+{
+    size_t field_size = args.size() > 0 ? std::stoull(args[0]) : 100'000;
+    int n_frames = args.size() > 1 ? std::stoi(args[1]) : 100;
+
+    const int w = 320, h = 180;
+
+    HittableList objects = sphere_field(field_size);
+    std::vector<Ray> rays = primary_rays(sphere_field_camera(field_size, double(w) / h), w, h);
+
+    std::vector<std::shared_ptr<Sphere>> spheres;
+    std::vector<Point3> start_centers;
+    std::vector<Vec3> velocities;
+
+    std::minstd_rand gen(0);
+    std::uniform_real_distribution<double> uniform(-1.0, 1.0);
+
+    for (const auto & object : objects.objects()) {
+        spheres.push_back(std::static_pointer_cast<Sphere>(object));
+        start_centers.push_back(spheres.back() -> center());
+        velocities.push_back(0.1 * Vec3(uniform(gen), 0, uniform(gen)));
+    }
+
+    BVH8 refitted(objects);
+
+    double refit_time = 0, rebuild_time = 0;
+    double refit_trace_time = 0, rebuild_trace_time = 0;
+    size_t subtrees = 0, rebuilt = 0, full_rebuilds = 0, mismatches = 0;
+
+    std::vector<std::optional<Hit>> refit_hits(rays.size()), rebuild_hits(rays.size());
+
+    auto trace = [&rays] (const BVH8 & bvh, std::vector<std::optional<Hit>> & hits) {
+        auto start = Clock::now();
+        parallel_for(rays.size(), [&] (size_t i) {
+            hits[i] = bvh.trace(rays[i], 0.0001, std::numeric_limits<float>::infinity());
+        }, 256);
+
+        return seconds_since(start);
+    };
+
+    for (int frame = 1; frame <= n_frames; ++frame) {
+        for (size_t i = 0; i < spheres.size(); ++i)
+            spheres[i] -> set_center(start_centers[i] + frame * velocities[i]);
+
+        auto start = Clock::now();
+        RefitStats stats = refitted.refit();
+        refit_time += seconds_since(start);
+
+        subtrees += stats.subtrees;
+        rebuilt += stats.rebuilt;
+        full_rebuilds += stats.full_rebuild;
+
+        start = Clock::now();
+        BVH8 built(objects);
+        rebuild_time += seconds_since(start);
+
+        refit_trace_time += trace(refitted, refit_hits);
+        rebuild_trace_time += trace(built, rebuild_hits);
+
+        for (size_t i = 0; i < rays.size(); ++i) {
+            const auto & a = refit_hits[i];
+            const auto & b = rebuild_hits[i];
+            mismatches += bool(a) != bool(b) || (a && a -> solution != b -> solution);
+        }
+    }
+
+    std::cout << std::left
+        << std::setw(12) << "update"
+        << std::setw(12) << "frames"
+        << std::setw(12) << "update s"
+        << std::setw(16) << "rebuilt"
+        << std::setw(16) << "full rebuilds"
+        << std::setw(12) << "Mrays/s"
+        << "mismatches" << std::endl;
+
+    std::cout << std::left
+        << std::setw(12) << "refit"
+        << std::setw(12) << n_frames
+        << std::setw(12) << std::fixed << std::setprecision(3) << refit_time
+        << std::setw(16) << std::to_string(rebuilt) + " / " + std::to_string(subtrees)
+        << std::setw(16) << full_rebuilds
+        << std::setw(12) << n_frames * rays.size() / refit_trace_time / 1e6
+        << mismatches << std::endl;
+
+    std::cout << std::left
+        << std::setw(12) << "rebuild"
+        << std::setw(12) << n_frames
+        << std::setw(12) << rebuild_time
+        << std::setw(16) << "-"
+        << std::setw(16) << n_frames
+        << std::setw(12) << n_frames * rays.size() / rebuild_trace_time / 1e6
+        << "-" << std::endl;
+
+    return 0;
+}
+
+// One sphere field cluster shared by N instances under a top-level BVH8 against the flattened scene of
+// transformed sphere copies in a single BVH8. Memory covers the acceleration structures with their
+// inline spheres and the instances, it stays flat with instancing while the flattened scene grows
+// with N. Rays whose closest hits differ between the two are counted as mismatches and should be 0
+int bench_instancing(const std::vector<std::string> & args)
+{
+    size_t cluster_size = args.empty() ? 10'000 : std::stoull(args[0]);
+
+    const int w = 640, h = 360;
+
+    HittableList cluster = sphere_field(cluster_size);
+    auto cluster_bvh = std::make_shared<BVH8>(cluster, BVH::Builder::LBVH);
+
+    // Clusters of a square grid with some room between them, turned about the vertical axis
+    double spacing = 1.5 * std::sqrt(double(cluster_size)) + 1;
+
+    std::minstd_rand gen(0);
+    std::uniform_real_distribution<double> uniform(0.0, 2 * std::numbers::pi);
+
+    std::cout << std::left
+        << std::setw(12) << "instances"
+        << std::setw(12) << "spheres"
+        << std::setw(16) << "instanced MiB"
+        << std::setw(16) << "flattened MiB"
+        << std::setw(16) << "instanced Mr/s"
+        << std::setw(16) << "flattened Mr/s"
+        << "mismatches" << std::endl;
+
+    for (int n : { 1, 4, 16, 64, 256 }) {
+        const int k = std::ceil(std::sqrt(double(n)));
+
+        HittableList instances;
+        HittableList flattened;
+
+        for (int i = 0; i < n; ++i) {
+            Vec3 offset((i % k - (k - 1) / 2.0) * spacing, 0, (i / k - (k - 1) / 2.0) * spacing);
+            Transform transform = Transform::translation(offset) * Transform::rotation(Vec3(0, 1, 0), uniform(gen));
+
+            instances.add(std::make_shared<Instance>(cluster_bvh, transform));
+
+            for (const auto & object : cluster.objects()) {
+                auto sphere = std::static_pointer_cast<Sphere>(object);
+                flattened.add(std::make_shared<Sphere>(transform.transform_point(sphere -> center()), sphere -> radius(), sphere -> material()));
+            }
+        }
+
+        BVH8 top(instances, BVH::Builder::SAH, BVH8::Layout::Full, BVH8::Primitives::Objects);
+        BVH8 flat(flattened, BVH::Builder::LBVH);
+
+        Camera camera = sphere_field_camera(size_t(k * spacing * k * spacing), double(w) / h);
+        std::vector<Ray> rays = primary_rays(camera, w, h);
+
+        std::vector<uint8_t> mismatch(rays.size());
+        parallel_for(rays.size(), [&] (size_t i) {
+            auto a = top.trace(rays[i], 0.0001, std::numeric_limits<float>::infinity());
+            auto b = flat.trace(rays[i], 0.0001, std::numeric_limits<float>::infinity());
+
+            mismatch[i] = bool(a) != bool(b) || (a && std::abs(a -> solution - b -> solution) > 1e-6 * b -> solution);
+        }, 256);
+
+        size_t instanced_memory = cluster_bvh -> memory_usage() + top.memory_usage() + n * sizeof(Instance);
+
+        std::cout << std::left
+            << std::setw(12) << n
+            << std::setw(12) << flattened.objects().size()
+            << std::setw(16) << std::fixed << std::setprecision(3) << instanced_memory / double(1 << 20)
+            << std::setw(16) << flat.memory_usage() / double(1 << 20)
+            << std::setw(16) << rays_per_second(top, rays) / 1e6
+            << std::setw(16) << rays_per_second(flat, rays) / 1e6
+            << std::accumulate(mismatch.begin(), mismatch.end(), size_t(0)) << std::endl;
+    }
+
+    return 0;
+}
+
+// Memory and closest hit throughput of the full and compressed BVH8 node layouts
+int bench_layouts(const std::vector<std::string> & args)
+{
+    size_t field_size = args.empty() ? 10'000'000 : std::stoull(args[0]);
+
+    const int w = 640, h = 360;
+
+    struct Scene {
+        std::string name;
+        std::function<HittableList()> objects;
+        std::function<Camera()> camera;
+        BVH::Builder builder;
+    };
+
+    std::vector<Scene> scenes = {
+        { "random_scene", [] () { return random_scene(); }, [=] () { return random_scene_camera(double(w) / h); }, BVH::Builder::SAH },
+        {
+            "sphere_field(" + std::to_string(field_size) + ")",
+            [=] () { return sphere_field(field_size); },
+            [=] () { return sphere_field_camera(field_size, double(w) / h); },
+            BVH::Builder::LBVH
+        }
+    };
+
+    std::cout << std::left
+        << std::setw(28) << "scene"
+        << std::setw(12) << "layout"
+        << std::setw(12) << "nodes"
+        << std::setw(14) << "memory MiB"
+        << std::setw(12) << "build s"
+        << "Mrays/s" << std::endl;
+
+    for (const auto & scene : scenes) {
+        HittableList objects = scene.objects();
+        std::vector<Ray> rays = primary_rays(scene.camera(), w, h);
+
+        for (auto layout : { BVH8::Layout::Full, BVH8::Layout::Compressed }) {
+            auto start = Clock::now();
+            BVH8 bvh(objects, scene.builder, layout);
+            double build_time = seconds_since(start);
+
+            double throughput = rays_per_second(bvh, rays);
+
+            std::cout << std::left
+                << std::setw(28) << scene.name
+                << std::setw(12) << (layout == BVH8::Layout::Full ? "full" : "compressed")
+                << std::setw(12) << bvh.node_count()
+                << std::setw(14) << std::fixed << std::setprecision(3) << bvh.memory_usage() / double(1 << 20)
+                << std::setw(12) << std::setprecision(3) << build_time
+                << std::setprecision(3) << throughput / 1e6 << std::endl;
+        }
+    }
+
+    return 0;
+}
+
+// Startup time of a sphere field with a cold BVH cache (build and store) and a warm one (map)
+int bench_cache(const std::vector<std::string> & args)
+{
+    size_t field_size = args.size() > 0 ? std::stoull(args[0]) : 10'000'000;
+    std::string directory = args.size() > 1 ? args[1] : (std::filesystem::temp_directory_path() / "bvh_cache").string();
+
+    const int w = 640, h = 360;
+
+    HittableList objects = sphere_field(field_size);
+    std::vector<Ray> rays = primary_rays(sphere_field_camera(field_size, double(w) / h), w, h);
+
+    auto file = BVHCache::path(directory, objects);
+    std::filesystem::remove(*file);
+
+    std::cout << std::left
+        << std::setw(12) << "cache"
+        << std::setw(12) << "startup s"
+        << "Mrays/s" << std::endl;
+
+    for (auto name : { "cold", "warm" }) {
+        auto start = Clock::now();
+        auto bvh = BVHCache::load_or_build(directory, objects, BVH::Builder::LBVH);
+        double startup_time = seconds_since(start);
+
+        double throughput = rays_per_second(*bvh, rays);
+
+        std::cout << std::left
+            << std::setw(12) << name
+            << std::setw(12) << std::fixed << std::setprecision(3) << startup_time
+            << std::setprecision(3) << throughput / 1e6 << std::endl;
+    }
+
+    std::cout << "cache file: " << *file << ", "
+        << std::filesystem::file_size(*file) / double(1 << 20) << " MiB" << std::endl;
+
+    return 0;
+}
+
+// Closest hit throughput of the uniform and hashed grids against the linear list and BVH8
+int bench_grid(const std::vector<std::string> & args)
+{
+    size_t field_size = args.empty() ? 1'000'000 : std::stoull(args[0]);
+
+    const int w = 640, h = 360;
+
+    struct Scene {
+        std::string name;
+        HittableList objects;
+        Camera camera;
+        bool with_list; // the linear list is only practical on small scenes
+    };
+
+    std::vector<Scene> scenes;
+    scenes.push_back({ "random_scene", random_scene(), random_scene_camera(double(w) / h), true });
+    scenes.push_back({
+        "sphere_field(" + std::to_string(field_size) + ")",
+        sphere_field(field_size),
+        sphere_field_camera(field_size, double(w) / h),
+        false });
+
+    std::cout << std::left
+        << std::setw(28) << "scene"
+        << std::setw(16) << "accelerator"
+        << std::setw(14) << "memory MiB"
+        << std::setw(12) << "build s"
+        << "Mrays/s" << std::endl;
+
+    for (const auto & scene : scenes) {
+        std::vector<Ray> rays = primary_rays(scene.camera, w, h);
+
+        auto report = [&] (const std::string & name, const Hittable & accelerator, size_t memory, double build_time) {
+            std::cout << std::left
+                << std::setw(28) << scene.name
+                << std::setw(16) << name
+                << std::setw(14) << std::fixed << std::setprecision(3) << memory / double(1 << 20)
+                << std::setw(12) << std::setprecision(3) << build_time
+                << std::setprecision(3) << rays_per_second(accelerator, rays) / 1e6 << std::endl;
+        };
+
+        if (scene.with_list)
+            report("list", scene.objects, 0, 0);
+
+        for (auto storage : { Grid::Storage::Dense, Grid::Storage::Hashed }) {
+            auto start = Clock::now();
+            Grid grid(scene.objects, storage);
+            double build_time = seconds_since(start);
+
+            report(storage == Grid::Storage::Dense ? "grid" : "hashed grid", grid, grid.memory_usage(), build_time);
+        }
+
+        auto start = Clock::now();
+        BVH8 bvh(scene.objects, BVH::Builder::LBVH);
+        double build_time = seconds_since(start);
+
+        report("bvh8", bvh, bvh.memory_usage(), build_time);
+    }
+
+    return 0;
+}
+
+// Throughput and cache misses per ray with leaves referencing the scene objects and with the spheres
+// copied inline in leaf order
+int bench_memory(const std::vector<std::string> & args)
+{
+    size_t field_size = args.empty() ? 1'000'000 : std::stoull(args[0]);
+
+    const int w = 640, h = 360;
+
+    struct Scene {
+        std::string name;
+        HittableList objects;
+        Camera camera;
+    };
+
+    std::vector<Scene> scenes;
+    scenes.push_back({ "random_scene", random_scene(), random_scene_camera(double(w) / h) });
+    scenes.push_back({
+        "sphere_field(" + std::to_string(field_size) + ")",
+        sphere_field(field_size),
+        sphere_field_camera(field_size, double(w) / h) });
+
+    std::cout << std::left
+        << std::setw(28) << "scene"
+        << std::setw(12) << "leaves"
+        << std::setw(12) << "Mrays/s"
+        << std::setw(16) << "L1D miss/ray"
+        << "LLC miss/ray" << std::endl;
+
+    auto per_ray = [] (const std::optional<uint64_t> & count, const size_t & n_rays) {
+        if (!count)
+            return std::string("n/a");
+
+        std::ostringstream s;
+        s << std::fixed << std::setprecision(2) << double(*count) / n_rays;
+        return s.str();
+    };
+
+    CacheMissCounter l1(CacheMissCounter::Level::L1D);
+    CacheMissCounter llc(CacheMissCounter::Level::LLC);
+
+    for (const auto & scene : scenes) {
+        std::vector<Ray> rays = primary_rays(scene.camera, w, h);
+
+        for (auto primitives : { BVH8::Primitives::Objects, BVH8::Primitives::Inline }) {
+            BVH8 bvh(scene.objects, BVH::Builder::LBVH, BVH8::Layout::Full, primitives);
+
+            l1.start();
+            llc.start();
+            double throughput = rays_per_second(bvh, rays);
+            auto l1_misses = l1.stop();
+            auto llc_misses = llc.stop();
+
+            std::cout << std::left
+                << std::setw(28) << scene.name
+                << std::setw(12) << (primitives == BVH8::Primitives::Objects ? "objects" : "inline")
+                << std::setw(12) << std::fixed << std::setprecision(3) << throughput / 1e6
+                << std::setw(16) << per_ray(l1_misses, rays.size())
+                << per_ray(llc_misses, rays.size()) << std::endl;
+        }
+    }
+
+    return 0;
+}
+
+// Shadow ray throughput of closest hit queries against any hit queries. Shadow rays start at the
+// primary hit points and point at a directional light
+int bench_occlusion(const std::vector<std::string> & args)
+{
+    size_t field_size = args.empty() ? 1'000'000 : std::stoull(args[0]);
+
+    const int w = 640, h = 360;
+    const Vec3 light = unit(Vec3(1, 2, 1));
+
+    struct Scene {
+        std::string name;
+        HittableList objects;
+        Camera camera;
+    };
+
+    std::vector<Scene> scenes;
+    scenes.push_back({ "random_scene", random_scene(), random_scene_camera(double(w) / h) });
+    scenes.push_back({
+        "sphere_field(" + std::to_string(field_size) + ")",
+        sphere_field(field_size),
+        sphere_field_camera(field_size, double(w) / h) });
+
+    std::cout << std::left
+        << std::setw(28) << "scene"
+        << std::setw(12) << "occluded"
+        << std::setw(16) << "trace Mrays/s"
+        << "occluded Mrays/s" << std::endl;
+
+    for (const auto & scene : scenes) {
+        BVH8 bvh(scene.objects, BVH::Builder::LBVH);
+
+        std::vector<Ray> shadow_rays;
+        for (const auto & r : primary_rays(scene.camera, w, h))
+            if (auto hit = bvh.trace(r, 0.0001, std::numeric_limits<float>::infinity()))
+                shadow_rays.emplace_back(hit -> point, light);
+
+        double trace_throughput = rays_per_second(bvh, shadow_rays);
+
+        size_t n_occluded = 0;
+        for (const auto & r : shadow_rays)
+            n_occluded += bvh.occluded(r, 0.0001, std::numeric_limits<float>::infinity());
+
+        auto start = Clock::now();
+        parallel_for(shadow_rays.size(), [&] (size_t i) {
+            bvh.occluded(shadow_rays[i], 0.0001, std::numeric_limits<float>::infinity());
+        }, 256);
+        double occluded_throughput = shadow_rays.size() / seconds_since(start);
+
+        std::cout << std::left
+            << std::setw(28) << scene.name
+            << std::setw(12) << std::fixed << std::setprecision(3) << double(n_occluded) / shadow_rays.size()
+            << std::setw(16) << trace_throughput / 1e6
+            << occluded_throughput / 1e6 << std::endl;
+    }
+
+    return 0;
+}
+
+// Primary and shadow ray throughput of single rays against packets of 8 (4x2 pixel tiles) and
+// 16 (4x4 pixel tiles) neighbouring rays, and the render time with and without primary ray packets
+int bench_packets(const std::vector<std::string> & args)
+{
+    size_t field_size = args.empty() ? 1'000'000 : std::stoull(args[0]);
+
+    const int w = 640, h = 360;
+    const Vec3 light = unit(Vec3(1, 2, 1));
+
+    struct Scene {
+        std::string name;
+        HittableList objects;
+        Camera camera;
+    };
+
+    std::vector<Scene> scenes;
+    scenes.push_back({ "random_scene", random_scene(), random_scene_camera(double(w) / h) });
+    scenes.push_back({
+        "sphere_field(" + std::to_string(field_size) + ")",
+        sphere_field(field_size),
+        sphere_field_camera(field_size, double(w) / h) });
+
+    std::cout << std::left
+        << std::setw(28) << "scene"
+        << std::setw(12) << "packet"
+        << std::setw(16) << "primary Mrays/s"
+        << "shadow Mrays/s" << std::endl;
+
+    for (const auto & scene : scenes) {
+        BVH8 bvh(scene.objects);
+
+        for (auto [tile_w, tile_h] : { std::pair(1, 1), std::pair(4, 2), std::pair(4, 4) }) {
+            const size_t packet_size = tile_w * tile_h;
+            const size_t n_packets = (w + tile_w - 1) / tile_w * ((h + tile_h - 1) / tile_h);
+
+            std::vector<Ray> rays = tiled_primary_rays(scene.camera, w, h, tile_w, tile_h);
+
+            // Packet p covers the rays [offsets[p], offsets[p + 1]), border tiles are smaller
+            std::vector<size_t> offsets;
+            for (size_t i = 0; i < rays.size(); i += packet_size)
+                offsets.push_back(i);
+            offsets.push_back(rays.size());
+
+            std::vector<std::optional<Hit>> hits(rays.size());
+
+            auto start = Clock::now();
+            parallel_for(n_packets, [&] (size_t p) {
+                if (packet_size == 1)
+                    hits[p] = bvh.trace(rays[p], 0.0001, std::numeric_limits<float>::infinity());
+                else
+                    bvh.trace(&rays[offsets[p]], offsets[p + 1] - offsets[p], 0.0001, std::numeric_limits<float>::infinity(), &hits[offsets[p]]);
+            }, 256 / packet_size);
+            double primary_throughput = rays.size() / seconds_since(start);
+
+            // Shadow rays of a packet start at its hit points, rays that missed keep an empty slot
+            std::vector<Ray> shadow_rays;
+            std::vector<size_t> shadow_offsets = { 0 };
+            for (size_t p = 0; p < n_packets; ++p) {
+                for (size_t i = offsets[p]; i < offsets[p + 1]; ++i)
+                    if (hits[i])
+                        shadow_rays.emplace_back(hits[i] -> point, light);
+                shadow_offsets.push_back(shadow_rays.size());
+            }
+
+            std::unique_ptr<bool[]> occluded(new bool[shadow_rays.size()]);
+
+            start = Clock::now();
+            parallel_for(n_packets, [&] (size_t p) {
+                size_t first = shadow_offsets[p], count = shadow_offsets[p + 1] - first;
+
+                if (packet_size == 1 && count == 1)
+                    occluded[first] = bvh.occluded(shadow_rays[first], 0.0001, std::numeric_limits<float>::infinity());
+                else if (count > 0)
+                    bvh.occluded(&shadow_rays[first], count, 0.0001, std::numeric_limits<float>::infinity(), &occluded[first]);
+            }, 256 / packet_size);
+            double shadow_throughput = shadow_rays.size() / seconds_since(start);
+
+            std::cout << std::left
+                << std::setw(28) << scene.name
+                << std::setw(12) << (packet_size == 1 ? std::string("single") : std::to_string(packet_size))
+                << std::setw(16) << std::fixed << std::setprecision(3) << primary_throughput / 1e6
+                << shadow_throughput / 1e6 << std::endl;
+        }
+    }
+
+    // Bounces are traced one ray at a time, only the primary rays of a render are packets
+    RenderSettings settings;
+    settings.width = w;
+    settings.height = h;
+
+    HittableList objects = random_scene();
+    Camera camera = random_scene_camera(double(w) / h);
+
+    std::cout << std::endl << std::left << std::setw(28) << "random_scene render" << "s" << std::endl;
+
+    for (bool packets : { false, true }) {
+        settings.packets = packets;
+        Render renderer(camera, objects, settings);
+
+        auto start = Clock::now();
+        renderer.render();
+
+        std::cout << std::left
+            << std::setw(28) << (packets ? "packets" : "single")
+            << std::fixed << std::setprecision(3) << seconds_since(start) << std::endl;
+    }
+
+    return 0;
+}
+
+// SphereSet standalone against the linear list, and as a BVH8 leaf payload against inline spheres
+int bench_sphere_set(const std::vector<std::string> & args)
+{
+    size_t field_size = args.empty() ? 1'000'000 : std::stoull(args[0]);
+
+    const int w = 640, h = 360;
+
+    HittableList scene = random_scene();
+    std::vector<Ray> scene_rays = primary_rays(random_scene_camera(double(w) / h), w, h);
+
+    HittableList field = sphere_field(field_size);
+    std::vector<Ray> field_rays = primary_rays(sphere_field_camera(field_size, double(w) / h), w, h);
+
+    std::cout << std::left
+        << std::setw(28) << "scene"
+        << std::setw(24) << "accelerator"
+        << "Mrays/s" << std::endl;
+
+    auto report = [] (const std::string & scene, const std::string & name, const Hittable & objects, const std::vector<Ray> & rays) {
+        std::cout << std::left
+            << std::setw(28) << scene
+            << std::setw(24) << name
+            << std::fixed << std::setprecision(3) << rays_per_second(objects, rays) / 1e6 << std::endl;
+    };
+
+    report("random_scene", "list", scene, scene_rays);
+    report("random_scene", "sphere set", SphereSet(scene), scene_rays);
+
+    for (auto [name, objects, rays] : {
+        std::tuple(std::string("random_scene"), &scene, &scene_rays),
+        std::tuple("sphere_field(" + std::to_string(field_size) + ")", &field, &field_rays) })
+    {
+        report(name, "bvh8 inline, leaf 4", BVH8(*objects, BVH::Builder::LBVH), *rays);
+
+        for (int leaf_size : { 4, 8, 16 }) {
+            BVH8 bvh(*objects, BVH::Builder::LBVH, BVH8::Layout::Full, BVH8::Primitives::SoA, leaf_size);
+            report(name, "bvh8 soa, leaf " + std::to_string(leaf_size), bvh, *rays);
+        }
+    }
+
+    // Rays aimed within 0.1% of the silhouettes of spheres of radius 0.2 at growing distances from
+    // the origin, the single precision test must keep every hit that Sphere finds
+    std::cout << std::endl << std::left
+        << std::setw(12) << "distance"
+        << std::setw(12) << "rays"
+        << std::setw(12) << "hits"
+        << "mismatches" << std::endl;
+
+    std::minstd_rand gen(0);
+    std::uniform_real_distribution<double> uniform(-1.0, 1.0);
+
+    auto random_direction = [&] () { return unit(Vec3(uniform(gen), uniform(gen), uniform(gen))); };
+
+    const int n_spheres = 64;
+    const int n_rays = 100'000;
+
+    for (double distance : { 10.0, 100.0, 1000.0, 3000.0 }) {
+        auto material = std::make_shared<Lambertian>(ColorRGB(0.5, 0.5, 0.5));
+        Point3 base = distance * unit(Vec3(1, 0.5, -0.3));
+
+        HittableList spheres;
+        for (int i = 0; i < n_spheres; ++i)
+            spheres.add(std::make_shared<Sphere>(base + 4 * random_direction(), 0.2, material));
+
+        SphereSet set(spheres);
+        int hits = 0, mismatches = 0;
+
+        for (int i = 0; i < n_rays; ++i) {
+            auto sphere = std::static_pointer_cast<Sphere>(spheres.objects()[i % n_spheres]);
+
+            Point3 origin = sphere -> center() + 8 * random_direction();
+            Vec3 side = unit(cross(sphere -> center() - origin, random_direction()));
+            Point3 target = sphere -> center() + sphere -> radius() * (1 + 1e-3 * uniform(gen)) * side;
+
+            Ray r(origin, target - origin);
+            auto expected = spheres.trace(r, 0.0001, std::numeric_limits<float>::infinity());
+            auto found = set.trace(r, 0.0001, std::numeric_limits<float>::infinity());
+
+            hits += bool(expected);
+            mismatches += bool(expected) != bool(found) || (expected && expected -> solution != found -> solution);
+        }
+
+        std::cout << std::left
+            << std::setw(12) << std::setprecision(0) << distance
+            << std::setw(12) << n_rays
+            << std::setw(12) << hits
+            << mismatches << std::endl;
+    }
+
+    return 0;
+}
+
+// Cost of a motion blurred frame traced once with time-sampled rays against the motion-aware
+// accelerators, and rendered as the average of `n` sub-frames over static snapshots of the scene
+int bench_motion(const std::vector<std::string> & args)
+{
+    int n_subframes = args.empty() ? 8 : std::stoi(args[0]);
+
+    const int w = 1280, h = 720;
+
+    Camera camera = random_scene_camera(double(w) / h);
+    std::vector<Ray> static_rays = primary_rays(camera, w, h);
+
+    camera.set_shutter(0, 1);
+    std::vector<Ray> rays = primary_rays(camera, w, h);
+
+    HittableList still = random_scene();
+    HittableList moving = random_scene(0, 0.5);
+
+    std::cout << std::left
+        << std::setw(40) << "accelerator"
+        << std::setw(12) << "build s"
+        << std::setw(12) << "trace s"
+        << "Mrays/s" << std::endl;
+
+    auto report = [&] (const std::string & name, double build, double trace, size_t n_rays) {
+        std::cout << std::left
+            << std::setw(40) << name
+            << std::setw(12) << std::fixed << std::setprecision(3) << build
+            << std::setw(12) << trace
+            << n_rays / (build + trace) / 1e6 << std::endl;
+    };
+
+    auto measure = [&] (const std::string & name, const HittableList & objects, const std::vector<Ray> & rays, auto build) {
+        auto start = Clock::now();
+        auto accelerator = build(objects);
+        double build_time = seconds_since(start);
+
+        report(name, build_time, rays.size() / rays_per_second(*accelerator, rays), rays.size());
+    };
+
+    auto bvh = [] (const HittableList & objects) { return std::make_shared<BVH>(objects); };
+    auto bvh8 = [] (const HittableList & objects) { return std::make_shared<BVH8>(objects); };
+
+    measure("static bvh", still, static_rays, bvh);
+    measure("static bvh8", still, static_rays, bvh8);
+    measure("moving bvh", moving, rays, bvh);
+    measure("moving bvh8", moving, rays, bvh8);
+
+    // Every sub-frame is a full frame of rays against a fresh accelerator over a frozen scene
+    double build_time = 0, trace_time = 0;
+
+    for (int k = 0; k < n_subframes; ++k) {
+        double time = (k + 0.5) / n_subframes;
+
+        HittableList snapshot;
+        for (const auto & object : moving.objects()) {
+            if (auto sphere = std::dynamic_pointer_cast<MovingSphere>(object))
+                snapshot.add(std::make_shared<Sphere>(sphere -> center(time), sphere -> radius(), sphere -> material()));
+            else
+                snapshot.add(object);
+        }
+
+        auto start = Clock::now();
+        BVH8 accelerator(snapshot);
+        build_time += seconds_since(start);
+
+        trace_time += static_rays.size() / rays_per_second(accelerator, static_rays);
+    }
+
+    report(std::to_string(n_subframes) + " sub-frames of static bvh8", build_time, trace_time, static_rays.size());
+
+    return 0;
+}
+
+// Full render of random_scene with the former radius 1000 ground sphere and with the ground plane
+int bench_ground(const std::vector<std::string> & args)
+{
+    RenderSettings settings;
+    settings.height = args.size() > 0 ? std::stoi(args[0]) : 720;
+    settings.width = settings.height * 16 / 9;
+    settings.n_samples = args.size() > 1 ? std::stoi(args[1]) : 16;
+
+    HittableList plane_ground = random_scene();
+
+    // The plane is the first object of the scene
+    HittableList sphere_ground;
+    auto plane = std::dynamic_pointer_cast<Plane>(plane_ground.objects().front());
+    sphere_ground.add(std::make_shared<Sphere>(Point3(0, -1000, 0), 1000, plane -> material()));
+    for (size_t i = 1; i < plane_ground.objects().size(); ++i)
+        sphere_ground.add(plane_ground.objects()[i]);
+
+    std::cout << std::left
+        << std::setw(16) << "ground"
+        << std::setw(12) << "SAH cost"
+        << "render s" << std::endl;
+
+    for (auto [name, objects] : {
+        std::pair(std::string("sphere"), &sphere_ground),
+        std::pair(std::string("plane"), &plane_ground) })
+    {
+        Camera camera = random_scene_camera(double(settings.width) / settings.height);
+        Render renderer(camera, *objects, settings);
+
+        auto start = Clock::now();
+        renderer.render();
+        double render_time = seconds_since(start);
+
+        std::cout << std::left
+            << std::setw(16) << name
+            << std::setw(12) << std::fixed << std::setprecision(3) << renderer.quality().sah_cost
+            << render_time << std::endl;
+    }
+
+    return 0;
+}
+
+// Render time and noise of random_scene with every path traced to full depth and with Russian roulette.
+// Noise is the per-pixel variance estimated from two independent renders, efficiency is the inverse of
+// time times noise, so equal efficiency means equal noise for equal time
+int bench_roulette(const std::vector<std::string> & args)
+{
+    RenderSettings settings;
+    settings.height = args.size() > 0 ? std::stoi(args[0]) : 360;
+    settings.width = settings.height * 16 / 9;
+    settings.n_samples = args.size() > 1 ? std::stoi(args[1]) : 16;
+
+    HittableList objects = random_scene();
+    Camera camera = random_scene_camera(double(settings.width) / settings.height);
+
+    std::cout << std::left
+        << std::setw(16) << "roulette depth"
+        << std::setw(12) << "threshold"
+        << std::setw(12) << "render s"
+        << std::setw(12) << "variance"
+        << "efficiency" << std::endl;
+
+    for (auto [depth, threshold] : {
+        std::pair(settings.bounces, 1.0f),
+        std::pair(3u, 1.0f),
+        std::pair(1u, 1.0f),
+        std::pair(1u, 0.25f) })
+    {
+        settings.roulette_depth = depth;
+        settings.roulette_threshold = threshold;
+        Render renderer(camera, objects, settings);
+
+        auto start = Clock::now();
+        Image<float, 3> a = renderer.render();
+        Image<float, 3> b = renderer.render();
+        double render_time = seconds_since(start) / 2;
+
+        double variance = 0;
+        for (int i = 0; i < settings.height; ++i)
+            for (int j = 0; j < settings.width; ++j) {
+                ColorRGB d = a(i, j) - b(i, j);
+                variance += (d.r * d.r + d.g * d.g + d.b * d.b) / 6;
+            }
+        variance /= settings.width * settings.height;
+
+        std::cout << std::left
+            << std::setw(16) << (depth == settings.bounces ? std::string("off") : std::to_string(depth))
+            << std::setw(12) << std::fixed << std::setprecision(2) << threshold
+            << std::setw(12) << std::setprecision(3) << render_time
+            << std::setw(12) << std::setprecision(6) << variance
+            << std::setprecision(1) << 1 / (render_time * variance) << std::endl;
+    }
+
+    return 0;
+}
+
+// Primary ray throughput of single ray traces against trace_batch calls over 4x4 pixel tiles
+// for the linear list and the accelerators
+int bench_batch(const std::vector<std::string> &)
+{
+    const int w = 640, h = 360;
+    const size_t batch_size = 16;
+
+    HittableList scene = random_scene();
+    std::vector<Ray> rays = tiled_primary_rays(random_scene_camera(double(w) / h), w, h, 4, 4);
+
+    std::cout << std::left
+        << std::setw(16) << "accelerator"
+        << std::setw(16) << "single Mrays/s"
+        << "batch Mrays/s" << std::endl;
+
+    auto report = [&rays, batch_size] (const std::string & name, const Hittable & objects) {
+        // Both variants store their hits
+        std::vector<std::optional<Hit>> hits(rays.size());
+
+        auto start = Clock::now();
+        parallel_for(rays.size(), [&] (size_t i) {
+            hits[i] = objects.trace(rays[i], 0.0001, std::numeric_limits<float>::infinity());
+        }, 256);
+        double single = rays.size() / seconds_since(start);
+
+        std::fill(hits.begin(), hits.end(), std::nullopt);
+
+        start = Clock::now();
+        parallel_for((rays.size() + batch_size - 1) / batch_size, [&] (size_t b) {
+            size_t begin = b * batch_size;
+            size_t count = std::min(batch_size, rays.size() - begin);
+
+            objects.trace_batch(
+                std::span(rays).subspan(begin, count),
+                0.0001,
+                std::numeric_limits<float>::infinity(),
+                std::span(hits).subspan(begin, count));
+        }, 16);
+        double batch = rays.size() / seconds_since(start);
+
+        std::cout << std::left
+            << std::setw(16) << name
+            << std::setw(16) << std::fixed << std::setprecision(3) << single / 1e6
+            << batch / 1e6 << std::endl;
+    };
+
+    report("list", scene);
+    report("bvh", BVH(scene));
+    report("bvh8", BVH8(scene));
+    report("grid", Grid(scene));
+
+    return 0;
+}
+
+// Throughput of first bounce rays traced in scatter order against rays sorted by direction octant and
+// origin, including the cost of the sort, and the wavefront render time with and without the sort
+int bench_ray_sorting(const std::vector<std::string> & args)
+{
+    size_t field_size = args.empty() ? 1'000'000 : std::stoull(args[0]);
+
+    const int w = 640, h = 360;
+
+    struct Scene {
+        std::string name;
+        HittableList objects;
+        Camera camera;
+    };
+
+    std::vector<Scene> scenes;
+    scenes.push_back({ "random_scene", random_scene(), random_scene_camera(double(w) / h) });
+    scenes.push_back({
+        "sphere_field(" + std::to_string(field_size) + ")",
+        sphere_field(field_size),
+        sphere_field_camera(field_size, double(w) / h) });
+
+    std::cout << std::left
+        << std::setw(28) << "scene"
+        << std::setw(16) << "rays"
+        << std::setw(12) << "sort ms"
+        << std::setw(16) << "trace Mrays/s"
+        << "wavefront render s" << std::endl;
+
+    for (const auto & scene : scenes) {
+        BVH8 bvh(scene.objects);
+
+        // Four samples per pixel scattered once off the primary hits
+        std::vector<Ray> rays;
+        for (int s = 0; s < 4; ++s)
+            for (const auto & r : primary_rays(scene.camera, w, h))
+                if (auto hit = bvh.trace(r, 0.0001, std::numeric_limits<float>::infinity()))
+                    if (auto scattered = hit -> material -> scatter(r, *hit))
+                        rays.push_back(std::get<1>(*scattered));
+
+        for (bool sorted : { false, true }) {
+            auto start = Clock::now();
+
+            std::vector<Ray> order = rays;
+            if (sorted) {
+                AABB box;
+                for (const auto & r : rays)
+                    box.extend(r.origin());
+
+                box = cube(box);
+
+                std::vector<uint64_t> keys(rays.size());
+                std::vector<uint32_t> ids(rays.size());
+
+                for (size_t i = 0; i < rays.size(); ++i) {
+                    keys[i] = ray_key(rays[i].origin(), rays[i].direction(), box);
+                    ids[i] = i;
+                }
+
+                radix_sort(keys, ids);
+
+                for (size_t i = 0; i < ids.size(); ++i)
+                    order[i] = rays[ids[i]];
+            }
+
+            double sort_time = seconds_since(start);
+            double throughput = rays_per_second(bvh, order);
+
+            RenderSettings settings;
+            settings.width = w;
+            settings.height = h;
+            settings.integrator = RenderSettings::Integrator::Wavefront;
+            settings.sort_rays = sorted;
+
+            HittableList objects = scene.objects;
+            Camera camera = scene.camera;
+            Render renderer(camera, objects, settings);
+
+            start = Clock::now();
+            renderer.render();
+            double render_time = seconds_since(start);
+
+            std::cout << std::left
+                << std::setw(28) << scene.name
+                << std::setw(16) << (sorted ? "sorted" : "scatter order")
+                << std::setw(12) << std::fixed << std::setprecision(2) << sort_time * 1e3
+                << std::setw(16) << std::setprecision(3) << throughput / 1e6
+                << render_time << std::endl;
+        }
+    }
+
+    return 0;
+}
+
+// Render time of the depth-first path tracer and the wavefront integrator on random_scene. Both renders
+// of an integrator are compared to a reference render of the path tracer: for equivalent estimates the
+// mean pixel value agrees and the variance of the difference is the same for both integrators
+int bench_wavefront(const std::vector<std::string> & args)
+{
+    RenderSettings settings;
+    settings.height = args.size() > 0 ? std::stoi(args[0]) : 360;
+    settings.width = settings.height * 16 / 9;
+    settings.n_samples = args.size() > 1 ? std::stoi(args[1]) : 16;
+
+    HittableList objects = random_scene();
+    Camera camera = random_scene_camera(double(settings.width) / settings.height);
+
+    Image<float, 3> reference = Render(camera, objects, settings).render();
+
+    std::cout << std::left
+        << std::setw(16) << "integrator"
+        << std::setw(12) << "render s"
+        << std::setw(12) << "mean"
+        << "variance" << std::endl;
+
+    using Integrator = RenderSettings::Integrator;
+
+    for (auto [name, integrator] : {
+        std::pair("path tracer", Integrator::PathTracer),
+        std::pair("wavefront", Integrator::Wavefront) })
+    {
+        settings.integrator = integrator;
+        Render renderer(camera, objects, settings);
+
+        auto start = Clock::now();
+        Image<float, 3> img = renderer.render();
+        double render_time = seconds_since(start);
+
+        double mean = 0, variance = 0;
+        for (int i = 0; i < settings.height; ++i)
+            for (int j = 0; j < settings.width; ++j) {
+                ColorRGB c = img(i, j);
+                ColorRGB d = c - reference(i, j);
+                mean += (c.r + c.g + c.b) / 3;
+                variance += (d.r * d.r + d.g * d.g + d.b * d.b) / 6;
+            }
+        mean /= settings.width * settings.height;
+        variance /= settings.width * settings.height;
+
+        std::cout << std::left
+            << std::setw(16) << name
+            << std::setw(12) << std::fixed << std::setprecision(3) << render_time
+            << std::setw(12) << std::setprecision(5) << mean
+            << std::setprecision(6) << variance << std::endl;
+    }
+
+    return 0;
+}
+
+// Mean radiance of two independent renders and the variance of their difference per pixel,
+// as the mean, median and 90th percentile over the pixels. `display` is the mean squared difference
+// of the saved images, in which directly seen lights and other values above 1 are clipped
+struct Noise {
+    double mean;
+    double variance;
+    double p50;
+    double p90;
+    double display;
+};
+
+Noise noise(Image<float, 3> & a, Image<float, 3> & b)
+{
+    // Renders are gamma encoded with a square root
+    auto [width, height] = a.size();
+
+    double mean = 0, display = 0;
+    std::vector<double> variances;
+    for (int i = 0; i < height; ++i)
+        for (int j = 0; j < width; ++j) {
+            ColorRGB x = a(i, j) * a(i, j), y = b(i, j) * b(i, j), d = x - y;
+            mean += (x.r + x.g + x.b + y.r + y.g + y.b) / 6;
+            variances.push_back((d.r * d.r + d.g * d.g + d.b * d.b) / 6);
+
+            for (int c = 0; c < 3; ++c) {
+                double e = std::min(1.0f, a(i, j)[c]) - std::min(1.0f, b(i, j)[c]);
+                display += e * e / 6;
+            }
+        }
+
+    Noise n;
+    n.mean = mean / variances.size();
+    n.display = display / variances.size();
+    n.variance = std::accumulate(variances.begin(), variances.end(), 0.0) / variances.size();
+
+    std::nth_element(variances.begin(), variances.begin() + variances.size() * 9 / 10, variances.end());
+    n.p90 = variances[variances.size() * 9 / 10];
+    std::nth_element(variances.begin(), variances.begin() + variances.size() / 2, variances.end());
+    n.p50 = variances[variances.size() / 2];
+
+    return n;
+}
+
+// Noise of the night scene lit by small emissive spheres with and without next event estimation.
+// Pixel variances are estimated in linear radiance from two independent renders. The mean is dominated
+// by light reflected off metal and glass, which is never sampled explicitly, the 90th percentile shows
+// the diffusely lit majority of the pixels
+int bench_nee(const std::vector<std::string> & args)
+{
+    RenderSettings settings;
+    settings.height = args.size() > 0 ? std::stoi(args[0]) : 360;
+    settings.width = settings.height * 16 / 9;
+    settings.sky_intensity = 0.02;
+
+    const unsigned int n_samples = args.size() > 1 ? std::stoi(args[1]) : 16;
+
+    HittableList objects = random_scene(0, 0, 24);
+    Camera camera = random_scene_camera(double(settings.width) / settings.height);
+
+    std::cout << std::left
+        << std::setw(8) << "nee"
+        << std::setw(8) << "spp"
+        << std::setw(12) << "render s"
+        << std::setw(12) << "mean"
+        << std::setw(12) << "variance"
+        << "p90 variance" << std::endl;
+
+    for (auto [nee, spp] : { std::pair(false, n_samples), std::pair(false, 8 * n_samples), std::pair(true, n_samples) }) {
+        settings.next_event_estimation = nee;
+        settings.n_samples = spp;
+        Render renderer(camera, objects, settings);
+
+        auto start = Clock::now();
+        Image<float, 3> a = renderer.render();
+        Image<float, 3> b = renderer.render();
+        double render_time = seconds_since(start) / 2;
+
+        Noise n = noise(a, b);
+
+        std::cout << std::left
+            << std::setw(8) << (nee ? "on" : "off")
+            << std::setw(8) << spp
+            << std::setw(12) << std::fixed << std::setprecision(3) << render_time
+            << std::setw(12) << std::setprecision(5) << n.mean
+            << std::setw(12) << n.variance
+            << n.p90 << std::endl;
+    }
+
+    return 0;
+}
+
+// Noise and time of renders lit by a growing number of lights of the same total power, with each
+// light sample picked uniformly or through the light BVH
+int bench_light_bvh(const std::vector<std::string> & args)
+{
+    RenderSettings settings;
+    settings.height = args.size() > 0 ? std::stoi(args[0]) : 180;
+    settings.width = settings.height * 16 / 9;
+    settings.n_samples = args.size() > 1 ? std::stoi(args[1]) : 4;
+    settings.sky_intensity = 0.02;
+
+    std::cout << std::left
+        << std::setw(10) << "lights"
+        << std::setw(10) << "select"
+        << std::setw(12) << "build ms"
+        << std::setw(12) << "render s"
+        << std::setw(12) << "mean"
+        << std::setw(12) << "variance"
+        << std::setw(12) << "p50"
+        << "p90" << std::endl;
+
+    for (int n_lights : { 10, 100, 1000, 10000, 100000 }) {
+        HittableList objects = random_scene(0, 0, n_lights);
+        Camera camera = random_scene_camera(double(settings.width) / settings.height);
+
+        for (auto selection : { LightList::Selection::Uniform, LightList::Selection::BVH }) {
+            auto start = Clock::now();
+            LightList lights(objects, selection);
+            double build_time = seconds_since(start);
+
+            settings.light_selection = selection;
+            Render renderer(camera, objects, settings);
+
+            start = Clock::now();
+            Image<float, 3> a = renderer.render();
+            Image<float, 3> b = renderer.render();
+            double render_time = seconds_since(start) / 2;
+
+            // Paths that reach small lights through specular bounces cannot be sampled and dominate the
+            // mean, the median and 90th percentile pixel variances show the light sampling noise
+            Noise n = noise(a, b);
+
+            std::cout << std::left
+                << std::setw(10) << n_lights
+                << std::setw(10) << (selection == LightList::Selection::BVH ? "bvh" : "uniform")
+                << std::setw(12) << std::fixed << std::setprecision(2) << 1000 * build_time
+                << std::setw(12) << std::setprecision(3) << render_time
+                << std::setw(12) << std::setprecision(5) << n.mean
+                << std::setw(12) << n.variance
+                << std::setw(12) << n.p50
+                << n.p90 << std::endl;
+        }
+    }
+
+    return 0;
+}
+
+// Noise of the glossy scene at n, 4n and 16n samples per pixel with light sampling alone, scattering
+// alone and both combined by multiple importance sampling
+int bench_mis(const std::vector<std::string> & args)
+{
+    RenderSettings settings;
+    settings.height = args.size() > 0 ? std::stoi(args[0]) : 90;
+    settings.width = settings.height * 16 / 9;
+    settings.sky_intensity = 0;
+
+    const unsigned int n_samples = args.size() > 1 ? std::stoi(args[1]) : 8;
+
+    HittableList objects = glossy_scene();
+    Camera camera = glossy_scene_camera(double(settings.width) / settings.height);
+
+    std::cout << std::left
+        << std::setw(10) << "spp"
+        << std::setw(10) << "strategy"
+        << std::setw(12) << "render s"
+        << std::setw(12) << "mean"
+        << std::setw(12) << "variance"
+        << "display" << std::endl;
+
+    const std::tuple<const char *, bool, bool> strategies[] = {
+        { "scatter", false, false },
+        { "light", true, false },
+        { "mis", true, true }
+    };
+
+    for (unsigned int spp : { n_samples, 4 * n_samples, 16 * n_samples })
+        for (auto [name, nee, mis] : strategies) {
+            settings.next_event_estimation = nee;
+            settings.multiple_importance_sampling = mis;
+            settings.n_samples = spp;
+            Render renderer(camera, objects, settings);
+
+            auto start = Clock::now();
+            Image<float, 3> a = renderer.render();
+            Image<float, 3> b = renderer.render();
+            double render_time = seconds_since(start) / 2;
+
+            Noise n = noise(a, b);
+
+            std::cout << std::left
+                << std::setw(10) << spp
+                << std::setw(10) << name
+                << std::setw(12) << std::fixed << std::setprecision(3) << render_time
+                << std::setw(12) << std::setprecision(5) << n.mean
+                << std::setw(12) << n.variance
+                << std::setprecision(6) << n.display << std::endl;
+        }
+
+    return 0;
+}
+
+// Sky of `width` x `height` pixels with a gradient from the horizon to the zenith and a sun
+// half a degree wide that dominates the light
+Image<float, 3> sun_sky(const int & width, const int & height)
+{
+    Image<float, 3> map(width, height);
+    Vec3 sun = unit(Vec3(1, 0.6, 0.4));
+
+    parallel_for(height, [&] (size_t i) {
+        double theta = std::numbers::pi * (i + 0.5) / height;
+
+        for (int j = 0; j < width; ++j) {
+            double phi = 2 * std::numbers::pi * (j + 0.5) / width - std::numbers::pi;
+            Vec3 d(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi));
+
+            float t = 0.5 * (d.y + 1);
+            map(i, j) = (1 - t) * ColorRGB(0.3, 0.3, 0.3) + t * ColorRGB(0.2, 0.35, 0.6);
+
+            if (dot(d, sun) > std::cos(0.5 * std::numbers::pi / 180))
+                map(i, j) = ColorRGB(4000, 3600, 3000);
+        }
+    }, 16);
+
+    return map;
+}
+
+// Table build time of environment maps of growing size, then the error of the random scene lit by a sun
+// and sky map when escaped rays find the sun by chance and when it is sampled explicitly. Errors are
+// measured against an explicitly sampled render at 16 times the samples, a render that finds the sun
+// in no sample of a pixel is wrong but shows no variance between two runs
+int bench_environment(const std::vector<std::string> & args)
+{
+    std::cout << std::left
+        << std::setw(16) << "map"
+        << "build ms" << std::endl;
+
+    for (int width : { 1024, 2048, 4096, 8192 }) {
+        Image<float, 3> map = sun_sky(width, width / 2);
+
+        auto start = Clock::now();
+        EnvironmentLight environment(map);
+        double build_time = seconds_since(start);
+
+        std::cout << std::left
+            << std::setw(16) << (std::to_string(width) + "x" + std::to_string(width / 2))
+            << std::fixed << std::setprecision(1) << 1000 * build_time << std::endl;
+    }
+
+    RenderSettings settings;
+    settings.height = args.size() > 0 ? std::stoi(args[0]) : 90;
+    settings.width = settings.height * 16 / 9;
+
+    const unsigned int n_samples = args.size() > 1 ? std::stoi(args[1]) : 16;
+
+    // Render loads the map from a file
+    std::filesystem::path path = std::filesystem::temp_directory_path() / "render_bench_sky.hdr";
+    Image<float, 3> map = sun_sky(2048, 1024);
+    stbi_write_hdr(path.c_str(), 2048, 1024, 3, reinterpret_cast<const float *>(&map(0, 0)));
+    settings.environment_map = path;
+
+    HittableList objects = random_scene();
+    Camera camera = random_scene_camera(double(settings.width) / settings.height);
+
+    settings.n_samples = 16 * n_samples;
+    Image<float, 3> reference = Render(camera, objects, settings).render();
+
+    std::cout << std::endl << std::left
+        << std::setw(12) << "sampling"
+        << std::setw(8) << "spp"
+        << std::setw(12) << "render s"
+        << std::setw(12) << "mean"
+        << std::setw(12) << "error"
+        << std::setw(12) << "p50"
+        << "p90" << std::endl;
+
+    for (auto [nee, spp] : { std::pair(false, n_samples), std::pair(false, 8 * n_samples), std::pair(true, n_samples) }) {
+        settings.next_event_estimation = nee;
+        settings.n_samples = spp;
+        Render renderer(camera, objects, settings);
+
+        auto start = Clock::now();
+        Image<float, 3> img = renderer.render();
+        double render_time = seconds_since(start);
+
+        Noise n = noise(img, reference);
+
+        std::cout << std::left
+            << std::setw(12) << (nee ? "explicit" : "chance")
+            << std::setw(8) << spp
+            << std::setw(12) << std::fixed << std::setprecision(3) << render_time
+            << std::setw(12) << std::setprecision(5) << n.mean
+            << std::setw(12) << n.variance
+            << std::setw(12) << n.p50
+            << n.p90 << std::endl;
+    }
+
+    std::filesystem::remove(path);
+
+    return 0;
+}
+
+// Noise of the night scene with directions sampled from the materials at n and 2n samples per pixel and
+// from the learned guiding distribution at n, against an unguided render at 16n. Guiding pays off when
+// its error and percentiles fall below those of the material row of similar render time
+int bench_guiding(const std::vector<std::string> & args)
+{
+    RenderSettings settings;
+    settings.height = args.size() > 0 ? std::stoi(args[0]) : 90;
+    settings.width = settings.height * 16 / 9;
+    settings.sky_intensity = 0.02;
+
+    const unsigned int n_samples = args.size() > 1 ? std::stoi(args[1]) : 32;
+
+    // Night scene lit by small lights with most small spheres made of glass, much of the light
+    // reaches diffuse surfaces through glass
+    HittableList objects = random_scene(0, 0, 24, 0.6);
+    Camera camera = random_scene_camera(double(settings.width) / settings.height);
+
+    settings.n_samples = 16 * n_samples;
+    Image<float, 3> reference = Render(camera, objects, settings).render();
+
+    std::cout << std::left
+        << std::setw(12) << "sampling"
+        << std::setw(8) << "spp"
+        << std::setw(12) << "render s"
+        << std::setw(12) << "mean"
+        << std::setw(12) << "error"
+        << std::setw(12) << "p50"
+        << "p90" << std::endl;
+
+    for (auto [guiding, spp] : { std::pair(false, n_samples), std::pair(false, 2 * n_samples), std::pair(true, n_samples) }) {
+        settings.path_guiding = guiding;
+        settings.n_samples = spp;
+        Render renderer(camera, objects, settings);
+
+        auto start = Clock::now();
+        Image<float, 3> img = renderer.render();
+        double render_time = seconds_since(start);
+
+        Noise n = noise(img, reference);
+
+        std::cout << std::left
+            << std::setw(12) << (guiding ? "guided" : "material")
+            << std::setw(8) << spp
+            << std::setw(12) << std::fixed << std::setprecision(3) << render_time
+            << std::setw(12) << std::setprecision(5) << n.mean
+            << std::setw(12) << n.variance
+            << std::setw(12) << n.p50
+            << n.p90 << std::endl;
+    }
+
+    return 0;
+}
+
+// Render time and noise of the room scene with the radiance cache off and read from growing path depths
+// on, against an uncached render at 16n samples per pixel. Bias is the relative offset of the mean
+// brightness from the reference, it should stay within the noise while the time drops
+int bench_radiance_cache(const std::vector<std::string> & args)
+{
+    RenderSettings settings;
+    settings.height = args.size() > 0 ? std::stoi(args[0]) : 90;
+    settings.width = settings.height * 16 / 9;
+
+    const unsigned int n_samples = args.size() > 1 ? std::stoi(args[1]) : 32;
+
+    HittableList objects = room_scene();
+    Camera camera = room_scene_camera(double(settings.width) / settings.height);
+
+    settings.n_samples = 16 * n_samples;
+    Image<float, 3> reference = Render(camera, objects, settings).render();
+
+    std::cout << std::left
+        << std::setw(12) << "cache depth"
+        << std::setw(12) << "render s"
+        << std::setw(12) << "mean"
+        << std::setw(12) << "bias %"
+        << std::setw(12) << "error"
+        << std::setw(12) << "p50"
+        << "p90" << std::endl;
+
+    const Noise converged = noise(reference, reference);
+
+    // Depth 0 disables the cache
+    for (unsigned int depth : { 0, 1, 2, 3, 4 }) {
+        settings.radiance_cache = depth > 0;
+        settings.radiance_cache_depth = depth;
+        settings.n_samples = n_samples;
+        Render renderer(camera, objects, settings);
+
+        auto start = Clock::now();
+        Image<float, 3> img = renderer.render();
+        double render_time = seconds_since(start);
+
+        Noise n = noise(img, reference);
+
+        // Noise averages both images, twice its mean less the reference mean is the mean of the render
+        double mean = 2 * n.mean - converged.mean;
+
+        std::cout << std::left
+            << std::setw(12) << (depth > 0 ? std::to_string(depth) : "off")
+            << std::setw(12) << std::fixed << std::setprecision(3) << render_time
+            << std::setw(12) << std::setprecision(5) << mean
+            << std::setw(12) << std::setprecision(2) << 100 * (mean / converged.mean - 1)
+            << std::setw(12) << std::setprecision(5) << n.variance
+            << std::setw(12) << n.p50
+            << n.p90 << std::endl;
+    }
+
+    return 0;
+}
+
+} // namespace
+
+
+int run_benchmark(const std::vector<std::string> & args)
+{
+    const std::map<std::string, std::function<int(const std::vector<std::string> &)>> benchmarks = {
+        { "animation", bench_animation },
+        { "batch", bench_batch },
+        { "builders", bench_builders },
+        { "cache", bench_cache },
+        { "environment", bench_environment },
+        { "grid", bench_grid },
+        { "ground", bench_ground },
+        { "guiding", bench_guiding },
+        { "instancing", bench_instancing },
+        { "layouts", bench_layouts },
+        { "light_bvh", bench_light_bvh },
+        { "memory", bench_memory },
+        { "mis", bench_mis },
+        { "motion", bench_motion },
+        { "nee", bench_nee },
+        { "occlusion", bench_occlusion },
+        { "packets", bench_packets },
+        { "radiance_cache", bench_radiance_cache },
+        { "ray_sorting", bench_ray_sorting },
+        { "roulette", bench_roulette },
+        { "sphere_set", bench_sphere_set },
+        { "wavefront", bench_wavefront }
+    };
+
+    if (args.empty() || !benchmarks.contains(args[0])) {
+        std::cerr << "Usage: render bench <name> [args], available benchmarks:";
+        for (const auto & [name, f] : benchmarks)
+            std::cerr << " " << name;
+        std::cerr << std::endl;
+        return 1;
+    }
+
+    return benchmarks.at(args[0])(std::vector<std::string>(args.begin() + 1, args.end()));
+}
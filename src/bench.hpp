@@ -0,0 +1,14 @@
+#ifndef BENCH_HPP
+#define BENCH_HPP
+
+
+#include <string>
+#include <vector>
+
+
+// Runs the benchmark named by args[0] with the remaining arguments and prints the results,
+// returns the process exit code
+int run_benchmark(const std::vector<std::string> & args);
+
+
+#endif // BENCH_HPP
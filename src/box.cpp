@@ -0,0 +1,111 @@
+#include "box.hpp"
+
+
+#include <limits>
+
+
+Box::Box(const Point3 & min, const Point3 & max, std::shared_ptr<Material> material) :
+    min_(min),
+    max_(max),
+    material_(material)
+{}
+
+Point3 Box::min() const
+{
+    return min_;
+}
+
+Point3 Box::max() const
+{
+    return max_;
+}
+
+std::shared_ptr<Material> Box::material() const
+{
+    return material_;
+}
+
+bool Box::slabs(const Ray & r, double & t_near, double & t_far, int & axis_near, int & axis_far) const
+{
+    Point3 o = r.origin();
+    Vec3 d = r.direction();
+
+    t_near = -std::numeric_limits<double>::infinity();
+    t_far = std::numeric_limits<double>::infinity();
+    axis_near = axis_far = 0;
+
+    for (int i = 0; i < 3; ++i) {
+        if (d[i] == 0) {
+            if (o[i] < min_[i] || o[i] > max_[i])
+                return false;
+            continue;
+        }
+
+        double t_0 = (min_[i] - o[i]) / d[i];
+        double t_1 = (max_[i] - o[i]) / d[i];
+
+        if (d[i] < 0)
+            std::swap(t_0, t_1);
+
+        if (t_0 > t_near) {
+            t_near = t_0;
+            axis_near = i;
+        }
+
+        if (t_1 < t_far) {
+            t_far = t_1;
+            axis_far = i;
+        }
+    }
+
+    return t_near <= t_far;
+}
+
+std::optional<Hit> Box::trace(const Ray & r, double t_min, double t_max) const
+{
+    double t_near, t_far;
+    int axis_near, axis_far;
+
+    if (!slabs(r, t_near, t_far, axis_near, axis_far))
+        return std::nullopt;
+
+    // Rays starting inside the box leave it through the far face
+    double t = t_near;
+    int axis = axis_near;
+    bool entering = true;
+
+    if (t < t_min || t_max < t) {
+        t = t_far;
+        axis = axis_far;
+        entering = false;
+
+        if (t < t_min || t_max < t)
+            return std::nullopt;
+    }
+
+    Point3 p = r(t);
+
+    // Outward normal of the crossed face, the ray enters against it and leaves along it
+    Vec3 n_out(0, 0, 0);
+    n_out[axis] = (r.direction()[axis] < 0) == entering ? 1 : -1;
+
+    bool front_face = dot(r.direction(), n_out) < 0;
+
+    return Hit { p, front_face ? n_out : -n_out, t, front_face, material_ };
+}
+
+bool Box::occluded(const Ray & r, double t_min, double t_max) const
+{
+    double t_near, t_far;
+    int axis_near, axis_far;
+
+    if (!slabs(r, t_near, t_far, axis_near, axis_far))
+        return false;
+
+    return (t_min <= t_near && t_near <= t_max) || (t_min <= t_far && t_far <= t_max);
+}
+
+AABB Box::bounding_box() const
+{
+    return AABB(min_, max_);
+}
@@ -0,0 +1,43 @@
+#ifndef BOX_HPP
+#define BOX_HPP
+
+
+#include "vec.hpp"
+#include "ray.hpp"
+#include "hittable.hpp"
+#include "material.hpp"
+
+
+#include <memory>
+#include <optional>
+
+
+// Solid axis-aligned box, intersected analytically with a slab test. Its bounding box is the box itself
+class Box : public Hittable {
+public:
+
+    Box(const Point3 & min, const Point3 & max, std::shared_ptr<Material> material);
+
+    Point3 min() const;
+    Point3 max() const;
+    std::shared_ptr<Material> material() const;
+
+    virtual std::optional<Hit> trace(const Ray & r, double t_min, double t_max) const override;
+
+    virtual bool occluded(const Ray & r, double t_min, double t_max) const override;
+
+    virtual AABB bounding_box() const override;
+
+private:
+
+    // Distances at which the ray enters and leaves the box and the axes of the faces crossed there,
+    // false if the ray misses it
+    bool slabs(const Ray & r, double & t_near, double & t_far, int & axis_near, int & axis_far) const;
+
+    Point3 min_;
+    Point3 max_;
+    std::shared_ptr<Material> material_;
+};
+
+
+#endif // BOX_HPP
@@ -0,0 +1,954 @@
+#include "bvh.hpp"
+#include "parallel.hpp"
+#include "morton.hpp"
+
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cassert>
+#include <limits>
+
+
+namespace {
+
+constexpr int n_bins = 16;
+
+struct Split {
+    int axis = -1;
+    int bin = 0;
+    double cost = std::numeric_limits<double>::infinity(); // sum of area times weight of both sides
+};
+
+inline int bin_index(const double & c, const double & c_min, const double & scale)
+{
+    return std::min(n_bins - 1, static_cast<int>((c - c_min) * scale));
+}
+
+// Cheapest binned SAH split of `ids`, `box(id)` is the bounds of an item and `weight(id)`
+// the number of objects behind it
+template<typename B, typename W>
+Split find_split(const uint32_t * ids, uint32_t n, const AABB & centroid_box, B box, W weight)
+{
+    Split best;
+
+    for (int axis = 0; axis < 3; ++axis) {
+        double c_min = centroid_box.min()[axis];
+        double c_extent = centroid_box.max()[axis] - c_min;
+
+        if (c_extent <= 0)
+            continue;
+
+        AABB bin_boxes[n_bins];
+        uint32_t bin_counts[n_bins] = {};
+        double scale = n_bins / c_extent;
+
+        for (uint32_t i = 0; i < n; ++i) {
+            AABB b = box(ids[i]);
+            int k = bin_index(b.center()[axis], c_min, scale);
+            bin_counts[k] += weight(ids[i]);
+            bin_boxes[k].extend(b);
+        }
+
+        // Sweep from the right to accumulate the cost of the right partitions
+        double right_area[n_bins];
+        uint32_t right_count[n_bins];
+        AABB acc;
+        uint32_t count = 0;
+
+        for (int k = n_bins - 1; k > 0; --k) {
+            acc.extend(bin_boxes[k]);
+            count += bin_counts[k];
+            right_area[k] = acc.surface_area();
+            right_count[k] = count;
+        }
+
+        acc = AABB();
+        count = 0;
+
+        for (int k = 0; k < n_bins - 1; ++k) {
+            acc.extend(bin_boxes[k]);
+            count += bin_counts[k];
+
+            if (count == 0 || right_count[k + 1] == 0)
+                continue;
+
+            double cost = acc.surface_area() * count + right_area[k + 1] * right_count[k + 1];
+
+            if (cost < best.cost) {
+                best.cost = cost;
+                best.axis = axis;
+                best.bin = k;
+            }
+        }
+    }
+
+    return best;
+}
+
+} // namespace
+
+
+BVH::BVH(const HittableList & list, const Builder & builder, const int & max_leaf_size) :
+    max_leaf_size_(max_leaf_size)
+{
+    std::vector<std::shared_ptr<Hittable>> objects;
+
+    for (const auto & object : list.objects()) {
+        if (object -> bounding_box().bounded())
+            objects.push_back(object);
+        else if (auto plane = std::dynamic_pointer_cast<Plane>(object))
+            planes_.push_back(plane);
+        else
+            unbounded_.push_back(object);
+    }
+
+    if (objects.empty())
+        return;
+
+    if (builder == Builder::SAH)
+        build_sah(objects);
+    else
+        build_linear(objects, builder == Builder::HLBVH);
+
+    costs_.resize(nodes_.size());
+    refit_range(0, nodes_.size(), nullptr, costs_);
+
+    build_motion_bounds();
+}
+
+void BVH::build_sah(const std::vector<std::shared_ptr<Hittable>> & objects)
+{
+    std::vector<AABB> boxes(objects.size());
+    std::vector<Point3> centroids(objects.size());
+    std::vector<uint32_t> indices(objects.size());
+
+    for (size_t i = 0; i < objects.size(); ++i) {
+        boxes[i] = objects[i] -> bounding_box();
+        centroids[i] = boxes[i].center();
+        indices[i] = i;
+    }
+
+    nodes_.reserve(2 * objects.size());
+    build_recursive(nodes_, indices, boxes, centroids, 0, objects.size(), 0);
+
+    // Store objects in leaf order so that a leaf references a contiguous range
+    objects_.reserve(objects.size());
+    for (auto i : indices)
+        objects_.push_back(objects[i]);
+}
+
+uint32_t BVH::build_recursive(
+    std::vector<Node> & nodes,
+    std::vector<uint32_t> & indices,
+    const std::vector<AABB> & boxes,
+    const std::vector<Point3> & centroids,
+    uint32_t begin,
+    uint32_t end,
+    int depth) const
+{
+    uint32_t node_id = nodes.size();
+    nodes.emplace_back();
+
+    AABB box, centroid_box;
+    for (uint32_t i = begin; i < end; ++i) {
+        box.extend(boxes[indices[i]]);
+        centroid_box.extend(centroids[indices[i]]);
+    }
+
+    nodes[node_id].box = box;
+
+    uint32_t n = end - begin;
+
+    auto make_leaf = [&] () {
+        nodes[node_id].offset = begin;
+        nodes[node_id].count = n;
+        return node_id;
+    };
+
+    // Medians below guarantee a single object at the last level
+    if (n == 1 || depth >= max_depth - 1)
+        return make_leaf();
+
+    Split split;
+    uint32_t mid;
+
+    if (depth >= max_depth - 1 - 32) {
+        // Close to the depth limit object medians take over, 32 halvings bring any node down to one object
+        split.axis = centroid_box.longest_axis();
+        mid = begin + n / 2;
+
+        std::nth_element(
+            indices.begin() + begin,
+            indices.begin() + mid,
+            indices.begin() + end,
+            [&] (uint32_t i, uint32_t j) { return centroids[i][split.axis] < centroids[j][split.axis]; });
+    } else {
+        split = find_split(
+            indices.data() + begin, n, centroid_box,
+            [&boxes] (uint32_t i) { return boxes[i]; },
+            [] (uint32_t) { return 1u; });
+
+        if (split.axis < 0) {
+            // Coincident centroids, there is nothing to gain from a split unless the leaf is too large
+            if (n <= static_cast<uint32_t>(max_leaf_size_))
+                return make_leaf();
+
+            split.axis = 0;
+            mid = begin + n / 2;
+        } else {
+            // Traversal step is considered as expensive as a single primitive test
+            double leaf_cost = n;
+            double split_cost = 1 + split.cost / box.surface_area();
+
+            if (n <= static_cast<uint32_t>(max_leaf_size_) && split_cost >= leaf_cost)
+                return make_leaf();
+
+            double c_min = centroid_box.min()[split.axis];
+            double scale = n_bins / (centroid_box.max()[split.axis] - c_min);
+
+            auto middle = std::partition(
+                indices.begin() + begin,
+                indices.begin() + end,
+                [&] (uint32_t i) { return bin_index(centroids[i][split.axis], c_min, scale) <= split.bin; });
+
+            mid = middle - indices.begin();
+        }
+    }
+
+    build_recursive(nodes, indices, boxes, centroids, begin, mid, depth + 1);
+    uint32_t second = build_recursive(nodes, indices, boxes, centroids, mid, end, depth + 1);
+
+    nodes[node_id].offset = second;
+    nodes[node_id].count = 0;
+    nodes[node_id].axis = split.axis;
+
+    return node_id;
+}
+
+void BVH::build_linear(const std::vector<std::shared_ptr<Hittable>> & objects, bool refine_top)
+{
+    const uint32_t n = objects.size();
+    const uint32_t none = std::numeric_limits<uint32_t>::max();
+
+    // Object bounds and centroid bounds
+    std::vector<AABB> boxes(n);
+    std::vector<AABB> chunk_boxes(thread_count());
+
+    parallel_chunks(n, [&] (unsigned int c, size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            boxes[i] = objects[i] -> bounding_box();
+            chunk_boxes[c].extend(boxes[i].center());
+        }
+    });
+
+    AABB centroid_box;
+    for (const auto & b : chunk_boxes)
+        centroid_box.extend(b);
+
+    // Sort objects along the Morton curve
+    std::vector<uint64_t> keys(n);
+    std::vector<uint32_t> order(n);
+
+    parallel_for(n, [&] (size_t i) {
+        keys[i] = morton_code(boxes[i].center(), centroid_box);
+        order[i] = i;
+    });
+
+    radix_sort(keys, order);
+
+    // Binary radix tree (Karras 2012): interior nodes are [0, n - 1), leaves are [n - 1, 2n - 1)
+    std::vector<BuildNode> build_nodes(2 * n - 1);
+    std::vector<uint32_t> parents(2 * n - 1, none);
+
+    // Length of the common prefix of keys i and j, ties are broken by the index
+    auto delta = [&keys, n] (int64_t i, int64_t j) {
+        if (j < 0 || j >= n)
+            return -1;
+
+        if (keys[i] == keys[j])
+            return 64 + std::countl_zero(static_cast<uint32_t>(i ^ j));
+
+        return std::countl_zero(keys[i] ^ keys[j]);
+    };
+
+    parallel_for(n - 1, [&] (size_t node) {
+        int64_t i = node;
+
+        // Direction of the range and the upper bound of its length
+        int d = delta(i, i + 1) > delta(i, i - 1) ? 1 : -1;
+        int delta_min = delta(i, i - d);
+
+        int64_t l_max = 2;
+        while (delta(i, i + l_max * d) > delta_min)
+            l_max *= 2;
+
+        // The other end of the range
+        int64_t l = 0;
+        for (int64_t t = l_max / 2; t >= 1; t /= 2)
+            if (delta(i, i + (l + t) * d) > delta_min)
+                l += t;
+
+        int64_t j = i + l * d;
+        int delta_node = delta(i, j);
+
+        // Split position
+        int64_t s = 0;
+        int64_t t = l;
+        do {
+            t = (t + 1) / 2;
+            if (delta(i, i + (s + t) * d) > delta_node)
+                s += t;
+        } while (t > 1);
+
+        int64_t gamma = i + s * d + std::min(d, 0);
+
+        uint32_t left = std::min(i, j) == gamma ? n - 1 + gamma : gamma;
+        uint32_t right = std::max(i, j) == gamma + 1 ? n - 1 + gamma + 1 : gamma + 1;
+
+        auto & b = build_nodes[node];
+        b.children[0] = left;
+        b.children[1] = right;
+        b.first = std::min(i, j);
+        b.count = std::abs(j - i) + 1;
+
+        parents[left] = node;
+        parents[right] = node;
+    });
+
+    // Bottom-up bounds, the second thread to reach an interior node processes it
+    std::vector<std::atomic<uint32_t>> visits(n - 1);
+
+    parallel_for(n, [&] (size_t k) {
+        uint32_t node = n - 1 + k;
+
+        auto & leaf = build_nodes[node];
+        leaf.box = boxes[order[k]];
+        leaf.first = k;
+        leaf.count = 1;
+        leaf.size = 1;
+        leaf.height = 0;
+        leaf.leaf = true;
+
+        for (uint32_t p = parents[node]; p != none; p = parents[p]) {
+            if (visits[p].fetch_add(1, std::memory_order_acq_rel) == 0)
+                break;
+
+            auto & b = build_nodes[p];
+            const auto & left = build_nodes[b.children[0]];
+            const auto & right = build_nodes[b.children[1]];
+
+            b.box = merge(left.box, right.box);
+
+            // Collapse small subtrees into a single leaf when the SAH favours it
+            double split_cost =
+                1 + (left.box.surface_area() * left.count + right.box.surface_area() * right.count) /
+                b.box.surface_area();
+
+            b.leaf = b.count <= static_cast<uint32_t>(max_leaf_size_) && b.count <= split_cost;
+            b.size = b.leaf ? 1 : 1 + left.size + right.size;
+            b.height = b.leaf ? 0 : 1 + std::max(left.height, right.height);
+        }
+    }, 4096);
+
+    // With a single object the only leaf takes the place of the root
+    uint32_t root = 0;
+
+    if (refine_top && !build_nodes[root].leaf) {
+        // Cut the radix tree into clusters and rebuild the tree above them with the SAH
+        uint32_t cluster_size = std::max<uint32_t>(max_leaf_size_, n / 4096);
+
+        std::vector<uint32_t> clusters;
+        std::vector<uint32_t> stack = { root };
+
+        while (!stack.empty()) {
+            uint32_t id = stack.back();
+            stack.pop_back();
+
+            const auto & b = build_nodes[id];
+            if (b.leaf || b.count <= cluster_size) {
+                clusters.push_back(id);
+            } else {
+                stack.push_back(b.children[0]);
+                stack.push_back(b.children[1]);
+            }
+        }
+
+        root = build_top(build_nodes, clusters, 0, clusters.size(), 0);
+    }
+
+    // Traversal stacks hold max_depth entries
+    assert(build_nodes[root].height < max_depth);
+
+    nodes_.resize(build_nodes[root].size);
+    objects_.resize(n);
+
+    std::vector<std::array<uint32_t, 3>> tasks;
+    flatten(build_nodes, order, objects, root, 0, 0, &tasks);
+
+    parallel_for(tasks.size(), [&] (size_t i) {
+        flatten(build_nodes, order, objects, tasks[i][0], tasks[i][1], tasks[i][2]);
+    }, 1);
+}
+
+uint32_t BVH::build_top(
+    std::vector<BuildNode> & build_nodes,
+    std::vector<uint32_t> & clusters,
+    uint32_t begin,
+    uint32_t end,
+    int depth)
+{
+    uint32_t n = end - begin;
+
+    if (n == 1)
+        return clusters[begin];
+
+    AABB box, centroid_box;
+    int height = 0;
+
+    for (uint32_t i = begin; i < end; ++i) {
+        box.extend(build_nodes[clusters[i]].box);
+        centroid_box.extend(build_nodes[clusters[i]].box.center());
+        height = std::max<int>(height, build_nodes[clusters[i]].height);
+    }
+
+    Split split = find_split(
+        clusters.data() + begin, n, centroid_box,
+        [&build_nodes] (uint32_t i) { return build_nodes[i].box; },
+        [&build_nodes] (uint32_t i) { return build_nodes[i].count; });
+
+    uint32_t mid = begin + n / 2;
+
+    if (split.axis >= 0) {
+        double c_min = centroid_box.min()[split.axis];
+        double scale = n_bins / (centroid_box.max()[split.axis] - c_min);
+
+        auto middle = std::partition(
+            clusters.begin() + begin,
+            clusters.begin() + end,
+            [&] (uint32_t i) { return bin_index(build_nodes[i].box.center()[split.axis], c_min, scale) <= split.bin; });
+
+        mid = middle - clusters.begin();
+    }
+
+    // The SAH split is kept while median splits below it could still end every cluster above the
+    // depth limit, otherwise medians halve the clusters and take one level less each time
+    uint32_t larger = std::max(mid - begin, end - mid);
+
+    if (depth + 1 + std::bit_width(larger - 1) + height > max_depth - 1) {
+        int axis = centroid_box.longest_axis();
+        mid = begin + n / 2;
+
+        std::nth_element(
+            clusters.begin() + begin,
+            clusters.begin() + mid,
+            clusters.begin() + end,
+            [&] (uint32_t i, uint32_t j) { return build_nodes[i].box.center()[axis] < build_nodes[j].box.center()[axis]; });
+    }
+
+    uint32_t left = build_top(build_nodes, clusters, begin, mid, depth + 1);
+    uint32_t right = build_top(build_nodes, clusters, mid, end, depth + 1);
+
+    BuildNode b;
+    b.box = box;
+    b.children[0] = left;
+    b.children[1] = right;
+    b.first = 0;
+    b.count = build_nodes[left].count + build_nodes[right].count;
+    b.size = 1 + build_nodes[left].size + build_nodes[right].size;
+    b.height = 1 + std::max(build_nodes[left].height, build_nodes[right].height);
+    b.leaf = false;
+
+    build_nodes.push_back(b);
+
+    return build_nodes.size() - 1;
+}
+
+void BVH::flatten(
+    const std::vector<BuildNode> & build_nodes,
+    const std::vector<uint32_t> & order,
+    const std::vector<std::shared_ptr<Hittable>> & objects,
+    uint32_t build_id,
+    uint32_t node_id,
+    uint32_t object_id,
+    std::vector<std::array<uint32_t, 3>> * tasks)
+{
+    // Subtrees below this size are not worth a separate task
+    constexpr uint32_t task_grain = 1 << 12;
+
+    const auto & b = build_nodes[build_id];
+
+    if (tasks && b.count <= task_grain) {
+        tasks -> push_back({ build_id, node_id, object_id });
+        return;
+    }
+
+    Node & node = nodes_[node_id];
+    node.box = b.box;
+
+    if (b.leaf) {
+        node.offset = object_id;
+        node.count = b.count;
+        node.axis = 0;
+
+        for (uint32_t i = 0; i < b.count; ++i)
+            objects_[object_id + i] = objects[order[b.first + i]];
+
+        return;
+    }
+
+    // Split along the axis that separates the children the most, the lower child goes first
+    const auto * first = &build_nodes[b.children[0]];
+    const auto * second = &build_nodes[b.children[1]];
+    uint32_t first_id = b.children[0];
+    uint32_t second_id = b.children[1];
+
+    Vec3 separation = second -> box.center() - first -> box.center();
+    int axis = 0;
+    for (int i = 1; i < 3; ++i)
+        if (std::abs(separation[i]) > std::abs(separation[axis]))
+            axis = i;
+
+    if (separation[axis] < 0) {
+        std::swap(first, second);
+        std::swap(first_id, second_id);
+    }
+
+    node.offset = node_id + 1 + first -> size;
+    node.count = 0;
+    node.axis = axis;
+
+    flatten(build_nodes, order, objects, first_id, node_id + 1, object_id, tasks);
+    flatten(build_nodes, order, objects, second_id, node.offset, object_id + first -> count, tasks);
+}
+
+RefitStats BVH::refit(const double & rebuild_threshold)
+{
+    // Subtrees below this size are refitted and rebuilt as a whole
+    constexpr uint32_t subtree_grain = 1 << 12;
+
+    RefitStats stats;
+
+    if (nodes_.empty())
+        return stats;
+
+    std::vector<AABB> boxes(objects_.size());
+    parallel_for(objects_.size(), [&] (size_t i) { boxes[i] = objects_[i] -> bounding_box(); });
+
+    // In depth-first order every subtree occupies a contiguous node range, split the tree
+    // into the top part and independent subtrees below it
+    struct Subtree {
+        uint32_t begin;
+        uint32_t end;
+        int depth;
+    };
+
+    std::vector<Subtree> subtrees;
+    std::vector<uint32_t> top;
+    std::vector<Subtree> stack = { { 0, static_cast<uint32_t>(nodes_.size()), 0 } };
+
+    while (!stack.empty()) {
+        Subtree t = stack.back();
+        stack.pop_back();
+
+        const Node & node = nodes_[t.begin];
+
+        if (node.count > 0 || t.end - t.begin <= subtree_grain) {
+            subtrees.push_back(t);
+        } else {
+            top.push_back(t.begin);
+            stack.push_back({ node.offset, t.end, t.depth + 1 });
+            stack.push_back({ t.begin + 1, node.offset, t.depth + 1 });
+        }
+    }
+
+    std::vector<float> costs(nodes_.size());
+
+    parallel_for(subtrees.size(), [&] (size_t i) {
+        refit_range(subtrees[i].begin, subtrees[i].end, &boxes, costs);
+    }, 1);
+
+    // Rebuild subtrees whose quality degraded, each one keeps its range of objects
+    std::vector<Subtree> degraded;
+    for (const auto & t : subtrees)
+        if (costs[t.begin] > rebuild_threshold * costs_[t.begin])
+            degraded.push_back(t);
+
+    stats.subtrees = subtrees.size();
+    stats.rebuilt = degraded.size();
+
+    if (!degraded.empty()) {
+        std::vector<uint32_t> indices(objects_.size());
+        std::vector<Point3> centroids(objects_.size());
+        std::vector<std::vector<Node>> rebuilt(degraded.size());
+
+        parallel_for(degraded.size(), [&] (size_t i) {
+            const auto & t = degraded[i];
+
+            // Objects of a subtree are the range between its leftmost and rightmost leaves
+            uint32_t first = t.begin;
+            while (nodes_[first].count == 0)
+                first += 1;
+
+            uint32_t last = t.begin;
+            while (nodes_[last].count == 0)
+                last = nodes_[last].offset;
+
+            uint32_t object_begin = nodes_[first].offset;
+            uint32_t object_end = nodes_[last].offset + nodes_[last].count;
+
+            for (uint32_t k = object_begin; k < object_end; ++k) {
+                indices[k] = k;
+                centroids[k] = boxes[k].center();
+            }
+
+            build_recursive(rebuilt[i], indices, boxes, centroids, object_begin, object_end, t.depth);
+
+            std::vector<std::shared_ptr<Hittable>> objects(
+                objects_.begin() + object_begin, objects_.begin() + object_end);
+            std::vector<AABB> object_boxes(boxes.begin() + object_begin, boxes.begin() + object_end);
+
+            for (uint32_t k = object_begin; k < object_end; ++k) {
+                objects_[k] = objects[indices[k] - object_begin];
+                boxes[k] = object_boxes[indices[k] - object_begin];
+            }
+        }, 1);
+
+        // Splice the rebuilt subtrees in, node indices after each of them shift by the change
+        // of its size, `shifts[i]` is the accumulated shift after the i-th subtree
+        std::vector<int64_t> shifts(degraded.size());
+        int64_t shift = 0;
+
+        for (size_t i = 0; i < degraded.size(); ++i) {
+            shift += static_cast<int64_t>(rebuilt[i].size()) - (degraded[i].end - degraded[i].begin);
+            shifts[i] = shift;
+        }
+
+        auto remap = [&] (uint32_t id) {
+            auto it = std::upper_bound(
+                degraded.begin(), degraded.end(), id,
+                [] (uint32_t id, const Subtree & t) { return id < t.end; });
+
+            return static_cast<uint32_t>(it == degraded.begin() ? id : id + shifts[it - degraded.begin() - 1]);
+        };
+
+        std::vector<Node> nodes;
+        std::vector<float> current, reference;
+        std::vector<uint32_t> bases(degraded.size());
+
+        nodes.reserve(nodes_.size() + shift);
+        current.reserve(nodes_.size() + shift);
+        reference.reserve(nodes_.size() + shift);
+
+        uint32_t id = 0;
+        for (size_t i = 0; i <= degraded.size(); ++i) {
+            uint32_t end = i < degraded.size() ? degraded[i].begin : nodes_.size();
+
+            for (; id < end; ++id) {
+                nodes.push_back(nodes_[id]);
+                current.push_back(costs[id]);
+                reference.push_back(costs_[id]);
+
+                if (nodes.back().count == 0)
+                    nodes.back().offset = remap(nodes.back().offset);
+            }
+
+            if (i == degraded.size())
+                break;
+
+            bases[i] = nodes.size();
+            for (auto node : rebuilt[i]) {
+                if (node.count == 0)
+                    node.offset += bases[i];
+                nodes.push_back(node);
+            }
+
+            current.resize(nodes.size());
+            reference.resize(nodes.size());
+
+            id = degraded[i].end;
+        }
+
+        nodes_ = std::move(nodes);
+        costs = std::move(current);
+        costs_ = std::move(reference);
+
+        // Rebuilt subtrees start over from their new cost
+        for (size_t i = 0; i < degraded.size(); ++i) {
+            refit_range(bases[i], bases[i] + rebuilt[i].size(), nullptr, costs);
+            std::copy_n(costs.begin() + bases[i], rebuilt[i].size(), costs_.begin() + bases[i]);
+        }
+
+        for (auto & t : top)
+            t = remap(t);
+    }
+
+    // Top part in reverse depth-first order, children before parents
+    for (auto it = top.rbegin(); it != top.rend(); ++it)
+        refit_range(*it, *it + 1, &boxes, costs);
+
+    if (costs[0] > rebuild_threshold * costs_[0]) {
+        // The top of the tree degraded, start from scratch
+        auto objects = std::move(objects_);
+        nodes_.clear();
+        objects_.clear();
+        build_sah(objects);
+        costs_.assign(nodes_.size(), 0);
+        refit_range(0, nodes_.size(), nullptr, costs_);
+
+        stats.full_rebuild = true;
+    }
+
+    build_motion_bounds();
+
+    return stats;
+}
+
+void BVH::refit_range(uint32_t begin, uint32_t end, const std::vector<AABB> * boxes, std::vector<float> & costs)
+{
+    for (uint32_t i = end; i-- > begin;) {
+        Node & node = nodes_[i];
+
+        if (node.count > 0) {
+            if (boxes) {
+                node.box = AABB();
+                for (uint32_t k = node.offset; k < node.offset + node.count; ++k)
+                    node.box.extend((*boxes)[k]);
+            }
+
+            costs[i] = node.count;
+        } else {
+            const Node & first = nodes_[i + 1];
+            const Node & second = nodes_[node.offset];
+
+            if (boxes)
+                node.box = merge(first.box, second.box);
+
+            double area = node.box.surface_area();
+            costs[i] = area > 0 ?
+                1 + (first.box.surface_area() * costs[i + 1] + second.box.surface_area() * costs[node.offset]) / area :
+                1 + costs[i + 1] + costs[node.offset];
+        }
+    }
+}
+
+void BVH::build_motion_bounds()
+{
+    motion_boxes_.clear();
+
+    if (std::none_of(objects_.begin(), objects_.end(), [] (const auto & object) { return object -> moving(); }))
+        return;
+
+    motion_boxes_.resize(nodes_.size());
+
+    // Children follow their parents, so a reverse sweep visits them first
+    for (uint32_t i = nodes_.size(); i-- > 0;) {
+        const Node & node = nodes_[i];
+
+        if (node.count > 0) {
+            for (uint32_t k = node.offset; k < node.offset + node.count; ++k)
+                for (int j = 0; j < 2; ++j)
+                    motion_boxes_[i][j].extend(objects_[k] -> bounding_box_at(j));
+        } else {
+            for (int j = 0; j < 2; ++j)
+                motion_boxes_[i][j] = merge(motion_boxes_[i + 1][j], motion_boxes_[node.offset][j]);
+        }
+    }
+}
+
+AABB BVH::box_at(uint32_t node_id, const double & time) const
+{
+    if (motion_boxes_.empty())
+        return nodes_[node_id].box;
+
+    return lerp(motion_boxes_[node_id][0], motion_boxes_[node_id][1], time);
+}
+
+const Plane * BVH::nearest_plane(const Ray & r, double t_min, double & t_max) const
+{
+    const Plane * nearest = nullptr;
+
+    for (const auto & plane : planes_) {
+        double t = plane -> solution(r);
+
+        if (t >= t_min && t <= t_max) {
+            t_max = t;
+            nearest = plane.get();
+        }
+    }
+
+    return nearest;
+}
+
+std::optional<Hit> BVH::trace_unbounded(const Ray & r, double t_min, double & t_max) const
+{
+    std::optional<Hit> hit = std::nullopt;
+
+    for (const auto & object : unbounded_) {
+        if (auto hit_tmp = object -> trace(r, t_min, t_max)) {
+            t_max = hit_tmp -> solution;
+            hit = hit_tmp;
+        }
+    }
+
+    return hit;
+}
+
+bool BVH::occluded_unbounded(const Ray & r, double t_min, double t_max) const
+{
+    for (const auto & plane : planes_) {
+        double t = plane -> solution(r);
+        if (t >= t_min && t <= t_max)
+            return true;
+    }
+
+    for (const auto & object : unbounded_)
+        if (object -> occluded(r, t_min, t_max))
+            return true;
+
+    return false;
+}
+
+std::optional<Hit> BVH::trace(const Ray & r, double t_min, double t_max) const
+{
+    const Plane * plane = nearest_plane(r, t_min, t_max);
+    std::optional<Hit> hit = trace_unbounded(r, t_min, t_max);
+
+    if (hit)
+        plane = nullptr;
+
+    if (nodes_.empty())
+        return plane ? plane -> hit(r, t_max) : hit;
+
+    Point3 origin = r.origin();
+    Vec3 d = r.direction();
+    Vec3 inv_direction(1 / d.x, 1 / d.y, 1 / d.z);
+    bool negative[3] = { d.x < 0, d.y < 0, d.z < 0 };
+    double time = std::clamp(r.time(), 0.0, 1.0);
+
+    uint32_t stack[max_depth];
+    int stack_size = 0;
+    uint32_t node_id = 0;
+
+    while (true) {
+        const Node & node = nodes_[node_id];
+
+        if (box_at(node_id, time).hit(origin, inv_direction, t_min, t_max)) {
+            if (node.count > 0) {
+                for (uint32_t i = node.offset; i < node.offset + node.count; ++i) {
+                    if (auto hit_tmp = objects_[i] -> trace(r, t_min, t_max)) {
+                        t_max = hit_tmp -> solution;
+                        hit = hit_tmp;
+                    }
+                }
+            } else {
+                // Visit the child closer to the ray origin first
+                if (negative[node.axis]) {
+                    stack[stack_size++] = node_id + 1;
+                    node_id = node.offset;
+                } else {
+                    stack[stack_size++] = node.offset;
+                    node_id = node_id + 1;
+                }
+
+                continue;
+            }
+        }
+
+        if (stack_size == 0)
+            break;
+
+        node_id = stack[--stack_size];
+    }
+
+    // Without a closer hit in the tree t_max is still the distance of the plane
+    if (!hit && plane)
+        return plane -> hit(r, t_max);
+
+    return hit;
+}
+
+void BVH::trace_batch(std::span<const Ray> rays, double t_min, double t_max, std::span<std::optional<Hit>> hits) const
+{
+    for (size_t k = 0; k < rays.size(); ++k)
+        if (auto hit = BVH::trace(rays[k], t_min, hits[k] ? hits[k] -> solution : t_max))
+            hits[k] = hit;
+}
+
+bool BVH::occluded(const Ray & r, double t_min, double t_max) const
+{
+    if (occluded_unbounded(r, t_min, t_max))
+        return true;
+
+    if (nodes_.empty())
+        return false;
+
+    Point3 origin = r.origin();
+    Vec3 d = r.direction();
+    Vec3 inv_direction(1 / d.x, 1 / d.y, 1 / d.z);
+    double time = std::clamp(r.time(), 0.0, 1.0);
+
+    // Any intersection ends the query, so the children are visited in storage order
+    uint32_t stack[max_depth];
+    int stack_size = 0;
+    uint32_t node_id = 0;
+
+    while (true) {
+        const Node & node = nodes_[node_id];
+
+        if (box_at(node_id, time).hit(origin, inv_direction, t_min, t_max)) {
+            if (node.count > 0) {
+                for (uint32_t i = node.offset; i < node.offset + node.count; ++i)
+                    if (objects_[i] -> occluded(r, t_min, t_max))
+                        return true;
+            } else {
+                stack[stack_size++] = node.offset;
+                node_id = node_id + 1;
+                continue;
+            }
+        }
+
+        if (stack_size == 0)
+            break;
+
+        node_id = stack[--stack_size];
+    }
+
+    return false;
+}
+
+AABB BVH::bounding_box() const
+{
+    AABB box = nodes_.empty() ? AABB() : nodes_[0].box;
+
+    for (const auto & plane : planes_)
+        box.extend(plane -> bounding_box());
+
+    for (const auto & object : unbounded_)
+        box.extend(object -> bounding_box());
+
+    return box;
+}
+
+bool BVH::moving() const
+{
+    return !motion_boxes_.empty();
+}
+
+AABB BVH::bounding_box_at(const double & time) const
+{
+    AABB box = nodes_.empty() ? AABB() : box_at(0, std::clamp(time, 0.0, 1.0));
+
+    for (const auto & plane : planes_)
+        box.extend(plane -> bounding_box_at(time));
+
+    for (const auto & object : unbounded_)
+        box.extend(object -> bounding_box_at(time));
+
+    return box;
+}
+
+size_t BVH::node_count() const
+{
+    return nodes_.size();
+}
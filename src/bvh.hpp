@@ -0,0 +1,139 @@
+#ifndef BVH_HPP
+#define BVH_HPP
+
+
+#include "aabb.hpp"
+#include "ray.hpp"
+#include "hittable.hpp"
+#include "plane.hpp"
+#include "diagnostics.hpp"
+
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <vector>
+#include <memory>
+
+
+// Bounding volume hierarchy over the objects of a HittableList. With moving objects every node
+// also keeps its bounds at shutter open and close, which traversal interpolates to the ray time.
+// Objects without finite bounds (planes) would stretch the root over everything, they are kept
+// out of the tree and tested on every ray before it
+class BVH : public Hittable {
+public:
+
+    enum class Builder {
+        SAH,    // top-down binned surface area heuristic, single threaded
+        LBVH,   // parallel linear BVH over Morton codes of object centroids
+        HLBVH   // LBVH with the top levels rebuilt using the binned SAH
+    };
+
+    BVH(const HittableList & list, const Builder & builder = Builder::SAH, const int & max_leaf_size = 4);
+
+    virtual std::optional<Hit> trace(const Ray & r, double t_min, double t_max) const override;
+
+    // Single ray traversals without the virtual dispatch of the default
+    virtual void trace_batch(std::span<const Ray> rays, double t_min, double t_max, std::span<std::optional<Hit>> hits) const override;
+
+    virtual bool occluded(const Ray & r, double t_min, double t_max) const override;
+
+    virtual AABB bounding_box() const override;
+
+    virtual bool moving() const override;
+    virtual AABB bounding_box_at(const double & time) const override;
+
+    // Recomputes the node bounds bottom-up after objects have moved, subtrees whose SAH cost
+    // grew by more than `rebuild_threshold` times since they were built are rebuilt
+    RefitStats refit(const double & rebuild_threshold = 1.5);
+
+    size_t node_count() const;
+
+private:
+
+    friend class BVH8;
+    friend class BVHCache;
+
+    // Nodes are stored in depth-first order: the first child of an interior node
+    // immediately follows it, the second child is at `offset`
+    struct Node {
+        AABB box;
+        uint32_t offset; // interior: second child index, leaf: first object index
+        uint16_t count;  // number of objects in a leaf, 0 for interior nodes
+        uint16_t axis;   // split axis of an interior node, the first child lies on its lower side
+    };
+
+    // Intermediate binary tree produced by the linear builders
+    struct BuildNode {
+        AABB box;
+        uint32_t children[2];
+        uint32_t first;   // first object in Morton order, valid for radix tree nodes
+        uint32_t count;   // number of objects in the subtree
+        uint32_t size;    // number of nodes in the flattened subtree
+        uint16_t height;  // levels below the node, 0 for leaves
+        bool leaf;
+    };
+
+    static constexpr int max_depth = 128;
+
+    void build_sah(const std::vector<std::shared_ptr<Hittable>> & objects);
+    void build_linear(const std::vector<std::shared_ptr<Hittable>> & objects, bool refine_top);
+
+    uint32_t build_recursive(
+        std::vector<Node> & nodes,
+        std::vector<uint32_t> & indices,
+        const std::vector<AABB> & boxes,
+        const std::vector<Point3> & centroids,
+        uint32_t begin,
+        uint32_t end,
+        int depth) const;
+
+    uint32_t build_top(
+        std::vector<BuildNode> & build_nodes,
+        std::vector<uint32_t> & clusters,
+        uint32_t begin,
+        uint32_t end,
+        int depth);
+
+    // Writes the subtree of `build_id` to nodes_ starting at `node_id`, when `tasks` is given
+    // large subtrees are unfolded and the remaining ones are appended to it for parallel flattening
+    void flatten(
+        const std::vector<BuildNode> & build_nodes,
+        const std::vector<uint32_t> & order,
+        const std::vector<std::shared_ptr<Hittable>> & objects,
+        uint32_t build_id,
+        uint32_t node_id,
+        uint32_t object_id,
+        std::vector<std::array<uint32_t, 3>> * tasks = nullptr);
+
+    // Bounds and SAH costs of the nodes in [begin, end) from the bounds of the objects, the range
+    // must be closed under taking children, when `boxes` is null only the costs are computed
+    void refit_range(uint32_t begin, uint32_t end, const std::vector<AABB> * boxes, std::vector<float> & costs);
+
+    // Node bounds at shutter open and close when some object moves, the tree itself is built over
+    // the bounds of the whole shutter interval
+    void build_motion_bounds();
+
+    // Bounds of a node at the ray time
+    AABB box_at(uint32_t node_id, const double & time) const;
+
+    // Closest plane within [t_min, t_max], shrinks t_max to its distance. Its hit record is built
+    // only when nothing closer is found in the tree
+    const Plane * nearest_plane(const Ray & r, double t_min, double & t_max) const;
+
+    // Closest hit among the other unbounded objects, shrinks t_max when one is found
+    std::optional<Hit> trace_unbounded(const Ray & r, double t_min, double & t_max) const;
+
+    bool occluded_unbounded(const Ray & r, double t_min, double t_max) const;
+
+    std::vector<Node> nodes_;
+    std::vector<float> costs_; // SAH cost of every node at the time its subtree was built
+    std::vector<std::array<AABB, 2>> motion_boxes_; // empty when no object moves
+    std::vector<std::shared_ptr<Hittable>> objects_;     // in leaf order
+    std::vector<std::shared_ptr<Hittable>> unbounded_;   // outside the tree, planes excluded
+    std::vector<std::shared_ptr<Plane>> planes_;
+    int max_leaf_size_;
+};
+
+
+#endif // BVH_HPP
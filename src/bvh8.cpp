@@ -0,0 +1,1294 @@
+#include "bvh8.hpp"
+#include "parallel.hpp"
+
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include <unordered_map>
+
+#if defined(__AVX512F__) && defined(__GNUC__) && !defined(__clang__)
+// GCC 12 flags the undefined vector placeholders inside its own AVX-512 intrinsic headers
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+
+namespace {
+
+// Conservative conversion of the node bounds to single precision
+inline float round_down(const double & x)
+{
+    float f = static_cast<float>(x);
+    return f > x ? std::nextafter(f, -std::numeric_limits<float>::infinity()) : f;
+}
+
+inline float round_up(const double & x)
+{
+    float f = static_cast<float>(x);
+    return f < x ? std::nextafter(f, std::numeric_limits<float>::infinity()) : f;
+}
+
+// Compensates rounding errors of the single precision slab test
+constexpr float far_scale = 1 + 4 * std::numeric_limits<float>::epsilon();
+
+// Largest leaf the byte-wide counts of compressed nodes hold
+constexpr uint16_t max_compressed_leaf = std::numeric_limits<uint8_t>::max();
+
+// Widest packet with vector box tests, without AVX-512 two packets of 8 rays beat a scalar one of 16
+#ifdef __AVX512F__
+constexpr int simd_packet_size = 16;
+#else
+constexpr int simd_packet_size = 8;
+#endif
+
+// Moves a pair of lower bounds at shutter open and close down by the rounding error of their
+// single precision interpolation, so that interpolated node bounds stay conservative
+inline void pad_down(float & open, float & close)
+{
+    float pad = 2 * std::numeric_limits<float>::epsilon() * std::max(std::abs(open), std::abs(close));
+    open -= pad;
+    close -= pad;
+}
+
+inline void pad_up(float & open, float & close)
+{
+    float pad = 2 * std::numeric_limits<float>::epsilon() * std::max(std::abs(open), std::abs(close));
+    open += pad;
+    close += pad;
+}
+
+} // namespace
+
+
+BVH8::BVH8(
+    const HittableList & list,
+    const BVH::Builder & builder,
+    const Layout & layout,
+    const Primitives & primitives,
+    const int & max_leaf_size) :
+
+    bvh_(list, builder, max_leaf_size),
+    layout_(bvh_.moving() ? Layout::Full : layout),
+    primitives_(primitives)
+{
+    build();
+}
+
+RefitStats BVH8::refit(const double & rebuild_threshold)
+{
+    RefitStats stats = bvh_.refit(rebuild_threshold);
+    build();
+
+    return stats;
+}
+
+void BVH8::build()
+{
+    nodes_.clear();
+    close_nodes_.clear();
+    compressed_nodes_.clear();
+    spheres_.clear();
+    materials_.clear();
+
+    if (primitives_ == Primitives::Inline) {
+        std::unordered_map<const Material *, uint32_t> material_index;
+        spheres_.reserve(bvh_.objects_.size());
+
+        for (const auto & object : bvh_.objects_) {
+            auto sphere = dynamic_cast<const Sphere *>(object.get());
+
+            if (!sphere) {
+                spheres_.clear();
+                materials_.clear();
+                break;
+            }
+
+            auto [it, inserted] = material_index.emplace(sphere -> material().get(), materials_.size());
+            if (inserted)
+                materials_.push_back(sphere -> material());
+
+            spheres_.push_back({ sphere -> center(), sphere -> radius(), it -> second });
+        }
+
+        spheres_.shrink_to_fit();
+    }
+
+    sphere_set_ = SphereSet();
+
+    if (primitives_ == Primitives::SoA) {
+        sphere_set_ = SphereSet(bvh_.objects_);
+
+        if (sphere_set_.size() != bvh_.objects_.size())
+            sphere_set_ = SphereSet();
+    }
+
+    if (bvh_.nodes_.empty())
+        return;
+
+    nodes_.reserve(bvh_.nodes_.size() / 4 + 1);
+    collapse(0);
+
+    // Refitting may have set objects in motion after construction
+    if (bvh_.moving())
+        layout_ = Layout::Full;
+
+    // Compressed nodes count leaf objects in a byte, larger leaves come from the depth limit of the binary BVH
+    if (layout_ == Layout::Compressed) {
+        bool oversized = std::any_of(nodes_.begin(), nodes_.end(), [] (const Node & node) {
+            return *std::max_element(node.count, node.count + width) > max_compressed_leaf;
+        });
+
+        if (oversized)
+            layout_ = Layout::Full;
+    }
+
+    if (layout_ == Layout::Compressed) {
+        compressed_nodes_.resize(nodes_.size());
+        parallel_for(nodes_.size(), [this] (size_t i) { compressed_nodes_[i] = compress(nodes_[i]); });
+
+        nodes_.clear();
+        nodes_.shrink_to_fit();
+    }
+}
+
+uint32_t BVH8::collapse(uint32_t binary_id)
+{
+    // Open the interior child with the largest surface area until the node is full
+    uint32_t children[width] = { binary_id };
+    int n_children = 1;
+
+    while (n_children < width) {
+        int best = -1;
+        double best_area = -1;
+
+        for (int i = 0; i < n_children; ++i) {
+            const auto & b = bvh_.nodes_[children[i]];
+            if (b.count == 0 && b.box.surface_area() > best_area) {
+                best = i;
+                best_area = b.box.surface_area();
+            }
+        }
+
+        if (best < 0)
+            break;
+
+        children[n_children++] = bvh_.nodes_[children[best]].offset;
+        children[best] += 1;
+    }
+
+    // Unused lanes of moving nodes hold finite bounds, whose interpolation stays an empty box
+    bool motion = !bvh_.motion_boxes_.empty();
+    float empty = motion ? std::numeric_limits<float>::max() : std::numeric_limits<float>::infinity();
+
+    uint32_t node_id = nodes_.size();
+    nodes_.emplace_back();
+
+    Node & node = nodes_[node_id];
+    std::fill_n(node.min_x, width, empty);
+    std::fill_n(node.min_y, width, empty);
+    std::fill_n(node.min_z, width, empty);
+    std::fill_n(node.max_x, width, -empty);
+    std::fill_n(node.max_y, width, -empty);
+    std::fill_n(node.max_z, width, -empty);
+    std::fill_n(node.child, width, 0);
+    std::fill_n(node.count, width, 0);
+
+    if (motion)
+        close_nodes_.push_back(node);
+
+    for (int i = 0; i < n_children; ++i) {
+        const auto & b = bvh_.nodes_[children[i]];
+
+        uint32_t child = b.count > 0 ? b.offset : collapse(children[i]);
+
+        // Recursion may have reallocated the node array
+        Node & n = nodes_[node_id];
+        const AABB & box = motion ? bvh_.motion_boxes_[children[i]][0] : b.box;
+
+        n.min_x[i] = round_down(box.min().x);
+        n.min_y[i] = round_down(box.min().y);
+        n.min_z[i] = round_down(box.min().z);
+        n.max_x[i] = round_up(box.max().x);
+        n.max_y[i] = round_up(box.max().y);
+        n.max_z[i] = round_up(box.max().z);
+        n.child[i] = child;
+        n.count[i] = b.count;
+
+        if (motion) {
+            Node & c = close_nodes_[node_id];
+            const AABB & close = bvh_.motion_boxes_[children[i]][1];
+
+            c.min_x[i] = round_down(close.min().x);
+            c.min_y[i] = round_down(close.min().y);
+            c.min_z[i] = round_down(close.min().z);
+            c.max_x[i] = round_up(close.max().x);
+            c.max_y[i] = round_up(close.max().y);
+            c.max_z[i] = round_up(close.max().z);
+
+            pad_down(n.min_x[i], c.min_x[i]);
+            pad_down(n.min_y[i], c.min_y[i]);
+            pad_down(n.min_z[i], c.min_z[i]);
+            pad_up(n.max_x[i], c.max_x[i]);
+            pad_up(n.max_y[i], c.max_y[i]);
+            pad_up(n.max_z[i], c.max_z[i]);
+        }
+    }
+
+    return node_id;
+}
+
+void BVH8::interpolate(const Node & open, const Node & close, float time, Node & node)
+{
+    for (int i = 0; i < width; ++i) {
+        node.min_x[i] = open.min_x[i] + time * (close.min_x[i] - open.min_x[i]);
+        node.min_y[i] = open.min_y[i] + time * (close.min_y[i] - open.min_y[i]);
+        node.min_z[i] = open.min_z[i] + time * (close.min_z[i] - open.min_z[i]);
+        node.max_x[i] = open.max_x[i] + time * (close.max_x[i] - open.max_x[i]);
+        node.max_y[i] = open.max_y[i] + time * (close.max_y[i] - open.max_y[i]);
+        node.max_z[i] = open.max_z[i] + time * (close.max_z[i] - open.max_z[i]);
+    }
+
+    std::copy_n(open.child, width, node.child);
+    std::copy_n(open.count, width, node.count);
+}
+
+BVH8::CompressedNode BVH8::compress(const Node & node)
+{
+    CompressedNode c;
+
+    const float * min[3] = { node.min_x, node.min_y, node.min_z };
+    const float * max[3] = { node.max_x, node.max_y, node.max_z };
+    uint8_t * q_min[3] = { c.q_min_x, c.q_min_y, c.q_min_z };
+    uint8_t * q_max[3] = { c.q_max_x, c.q_max_y, c.q_max_z };
+
+    for (int a = 0; a < 3; ++a) {
+        float lo = *std::min_element(min[a], min[a] + width);
+        float hi = *std::max_element(max[a], max[a] + width);
+
+        // Smallest power of two step that covers the node bounds with 255 steps
+        int exponent;
+        std::frexp((double(hi) - lo) / 255, &exponent);
+        exponent = std::clamp(exponent, -126, 127);
+
+        double step = std::ldexp(1.0, exponent);
+
+        c.origin[a] = lo;
+        c.exponent[a] = exponent;
+
+        for (int i = 0; i < width; ++i) {
+            if (min[a][i] > max[a][i]) {
+                // Empty slot, the lower plane lies above the upper one
+                q_min[a][i] = 255;
+                q_max[a][i] = 0;
+            } else {
+                q_min[a][i] = std::clamp(std::floor((min[a][i] - double(lo)) / step), 0.0, 255.0);
+                q_max[a][i] = std::clamp(std::ceil((max[a][i] - double(lo)) / step), 0.0, 255.0);
+            }
+        }
+    }
+
+    for (int i = 0; i < width; ++i) {
+        assert(node.count[i] <= max_compressed_leaf);
+
+        c.child[i] = node.child[i];
+        c.count[i] = node.count[i];
+    }
+
+    return c;
+}
+
+BVH8::Node BVH8::decompress(const CompressedNode & c)
+{
+    Node node;
+
+    float * min[3] = { node.min_x, node.min_y, node.min_z };
+    float * max[3] = { node.max_x, node.max_y, node.max_z };
+    const uint8_t * q_min[3] = { c.q_min_x, c.q_min_y, c.q_min_z };
+    const uint8_t * q_max[3] = { c.q_max_x, c.q_max_y, c.q_max_z };
+
+    for (int a = 0; a < 3; ++a) {
+        for (int i = 0; i < width; ++i) {
+            min[a][i] = c.origin[a] + std::ldexp(float(q_min[a][i]), c.exponent[a]);
+            max[a][i] = c.origin[a] + std::ldexp(float(q_max[a][i]), c.exponent[a]);
+        }
+    }
+
+    for (int i = 0; i < width; ++i) {
+        node.child[i] = c.child[i];
+        node.count[i] = c.count[i];
+    }
+
+    return node;
+}
+
+int BVH8::intersect(
+    const Node & node,
+    const float origin[3],
+    const float inv_direction[3],
+    const bool negative[3],
+    float t_min,
+    float t_max,
+    float distances[width])
+{
+    // Near and far planes are selected by the ray direction sign
+    const float * near_x = negative[0] ? node.max_x : node.min_x;
+    const float * near_y = negative[1] ? node.max_y : node.min_y;
+    const float * near_z = negative[2] ? node.max_z : node.min_z;
+    const float * far_x = negative[0] ? node.min_x : node.max_x;
+    const float * far_y = negative[1] ? node.min_y : node.max_y;
+    const float * far_z = negative[2] ? node.min_z : node.max_z;
+
+#ifdef __AVX2__
+    __m256 o_x = _mm256_set1_ps(origin[0]);
+    __m256 o_y = _mm256_set1_ps(origin[1]);
+    __m256 o_z = _mm256_set1_ps(origin[2]);
+    __m256 i_x = _mm256_set1_ps(inv_direction[0]);
+    __m256 i_y = _mm256_set1_ps(inv_direction[1]);
+    __m256 i_z = _mm256_set1_ps(inv_direction[2]);
+
+    __m256 t_near = _mm256_max_ps(
+        _mm256_max_ps(
+            _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(near_x), o_x), i_x),
+            _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(near_y), o_y), i_y)),
+        _mm256_max_ps(
+            _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(near_z), o_z), i_z),
+            _mm256_set1_ps(t_min)));
+
+    __m256 t_far = _mm256_min_ps(
+        _mm256_min_ps(
+            _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(far_x), o_x), i_x),
+            _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(far_y), o_y), i_y)),
+        _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(far_z), o_z), i_z));
+
+    t_far = _mm256_min_ps(_mm256_mul_ps(t_far, _mm256_set1_ps(far_scale)), _mm256_set1_ps(t_max));
+
+    _mm256_storeu_ps(distances, t_near);
+
+    return _mm256_movemask_ps(_mm256_cmp_ps(t_near, t_far, _CMP_LE_OQ));
+#else
+    int mask = 0;
+
+    for (int i = 0; i < width; ++i) {
+        float t_near = std::max(
+            std::max((near_x[i] - origin[0]) * inv_direction[0], (near_y[i] - origin[1]) * inv_direction[1]),
+            std::max((near_z[i] - origin[2]) * inv_direction[2], t_min));
+
+        float t_far = std::min(
+            std::min((far_x[i] - origin[0]) * inv_direction[0], (far_y[i] - origin[1]) * inv_direction[1]),
+            (far_z[i] - origin[2]) * inv_direction[2]);
+
+        t_far = std::min(t_far * far_scale, t_max);
+
+        distances[i] = t_near;
+        mask |= (t_near <= t_far) << i;
+    }
+
+    return mask;
+#endif
+}
+
+int BVH8::intersect(
+    const CompressedNode & node,
+    const float origin[3],
+    const float inv_direction[3],
+    const bool negative[3],
+    float t_min,
+    float t_max,
+    float distances[width])
+{
+    // Plane distance is q * a + b with a = step / d and b = (node origin - ray origin) / d
+    float a[3], b[3];
+    for (int i = 0; i < 3; ++i) {
+        // 2^exponent assembled directly from the exponent bits
+        float step = std::bit_cast<float>(static_cast<uint32_t>(node.exponent[i] + 127) << 23);
+        a[i] = step * inv_direction[i];
+        b[i] = (node.origin[i] - origin[i]) * inv_direction[i];
+    }
+
+    const uint8_t * near_x = negative[0] ? node.q_max_x : node.q_min_x;
+    const uint8_t * near_y = negative[1] ? node.q_max_y : node.q_min_y;
+    const uint8_t * near_z = negative[2] ? node.q_max_z : node.q_min_z;
+    const uint8_t * far_x = negative[0] ? node.q_min_x : node.q_max_x;
+    const uint8_t * far_y = negative[1] ? node.q_min_y : node.q_max_y;
+    const uint8_t * far_z = negative[2] ? node.q_min_z : node.q_max_z;
+
+#ifdef __AVX2__
+    auto plane = [] (const uint8_t * q, const float & a, const float & b) {
+        __m256 f = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(q))));
+        return _mm256_add_ps(_mm256_mul_ps(f, _mm256_set1_ps(a)), _mm256_set1_ps(b));
+    };
+
+    __m256 t_near = _mm256_max_ps(
+        _mm256_max_ps(plane(near_x, a[0], b[0]), plane(near_y, a[1], b[1])),
+        _mm256_max_ps(plane(near_z, a[2], b[2]), _mm256_set1_ps(t_min)));
+
+    __m256 t_far = _mm256_min_ps(
+        _mm256_min_ps(plane(far_x, a[0], b[0]), plane(far_y, a[1], b[1])),
+        plane(far_z, a[2], b[2]));
+
+    t_far = _mm256_min_ps(_mm256_mul_ps(t_far, _mm256_set1_ps(far_scale)), _mm256_set1_ps(t_max));
+
+    _mm256_storeu_ps(distances, t_near);
+
+    return _mm256_movemask_ps(_mm256_cmp_ps(t_near, t_far, _CMP_LE_OQ));
+#else
+    int mask = 0;
+
+    for (int i = 0; i < width; ++i) {
+        float t_near = std::max(
+            std::max(near_x[i] * a[0] + b[0], near_y[i] * a[1] + b[1]),
+            std::max(near_z[i] * a[2] + b[2], t_min));
+
+        float t_far = std::min(
+            std::min(far_x[i] * a[0] + b[0], far_y[i] * a[1] + b[1]),
+            far_z[i] * a[2] + b[2]);
+
+        t_far = std::min(t_far * far_scale, t_max);
+
+        distances[i] = t_near;
+        mask |= (t_near <= t_far) << i;
+    }
+
+    return mask;
+#endif
+}
+
+void BVH8::prepare(const Ray & r, float origin[3], float inv_direction[3], bool negative[3])
+{
+    Point3 o = r.origin();
+    Vec3 d = r.direction();
+
+    // Zero direction components are nudged so that slab distances never turn into 0 * inf
+    auto inverse = [] (const double & x) {
+        return float(1 / (std::abs(x) > 1e-20 ? x : std::copysign(1e-20, x)));
+    };
+
+    for (int i = 0; i < 3; ++i) {
+        origin[i] = float(o[i]);
+        inv_direction[i] = inverse(d[i]);
+        negative[i] = inv_direction[i] < 0;
+    }
+}
+
+std::optional<Hit> BVH8::trace(const Ray & r, double t_min, double t_max) const
+{
+    TraversalStats stats;
+    return closest_hit<false>(r, t_min, t_max, stats);
+}
+
+std::optional<Hit> BVH8::trace(const Ray & r, double t_min, double t_max, TraversalStats & stats) const
+{
+    return closest_hit<true>(r, t_min, t_max, stats);
+}
+
+template<bool Count>
+std::optional<Hit> BVH8::closest_hit(const Ray & r, double t_min, double t_max, TraversalStats & stats) const
+{
+    // Unbounded objects first, their hit bounds the tree traversal
+    const Plane * plane = bvh_.nearest_plane(r, t_min, t_max);
+    std::optional<Hit> unbounded_hit = bvh_.trace_unbounded(r, t_min, t_max);
+
+    if (unbounded_hit)
+        plane = nullptr;
+
+    // Hit records of planes are built only when the tree holds nothing closer, t_max is then
+    // still the distance of the plane
+    auto closest = [&] (const std::optional<Hit> & hit) {
+        if (hit)
+            return hit;
+
+        return plane ? std::optional<Hit>(plane -> hit(r, t_max)) : unbounded_hit;
+    };
+
+    if (node_count() == 0)
+        return closest(std::nullopt);
+
+    // Nodes of moving scenes are interpolated to the ray time on every visit
+    Node interpolated;
+    float time = std::clamp(r.time(), 0.0, 1.0);
+
+    auto counted = [&stats] (auto fetch) {
+        return [&stats, fetch] (uint32_t i) -> decltype(auto) {
+            if constexpr (Count)
+                ++stats.nodes;
+            return fetch(i);
+        };
+    };
+
+    auto trace_nodes = [&] (auto leaf) {
+        auto counted_leaf = [&stats, leaf] (uint32_t first, uint32_t count, const Ray & r, double t_min, double & t_max, std::optional<Hit> & hit) {
+            if constexpr (Count)
+                stats.primitives += count;
+            leaf(first, count, r, t_min, t_max, hit);
+        };
+
+        std::optional<Hit> hit;
+
+        if (!close_nodes_.empty()) {
+            hit = traverse(counted([&] (uint32_t i) -> const Node & {
+                interpolate(nodes_[i], close_nodes_[i], time, interpolated);
+                return interpolated;
+            }), r, t_min, t_max, counted_leaf);
+        } else if (layout_ == Layout::Compressed) {
+            hit = traverse(counted([this] (uint32_t i) -> const CompressedNode & { return compressed_nodes_[i]; }), r, t_min, t_max, counted_leaf);
+        } else {
+            hit = traverse(counted([this] (uint32_t i) -> const Node & { return nodes_[i]; }), r, t_min, t_max, counted_leaf);
+        }
+
+        return closest(hit);
+    };
+
+    if (!spheres_.empty()) {
+        return trace_nodes([this] (uint32_t first, uint32_t count, const Ray & r, double t_min, double & t_max, std::optional<Hit> & hit) {
+            intersect_spheres(spheres_.data(), materials_, first, count, r, t_min, t_max, hit);
+        });
+    }
+
+    if (sphere_set_.size() > 0) {
+        return trace_nodes([this] (uint32_t first, uint32_t count, const Ray & r, double t_min, double & t_max, std::optional<Hit> & hit) {
+            sphere_set_.intersect(first, count, r, t_min, t_max, hit);
+        });
+    }
+
+    return trace_nodes([this] (uint32_t first, uint32_t count, const Ray & r, double t_min, double & t_max, std::optional<Hit> & hit) {
+        for (uint32_t i = first; i < first + count; ++i) {
+            if (auto hit_tmp = bvh_.objects_[i] -> trace(r, t_min, t_max)) {
+                t_max = hit_tmp -> solution;
+                hit = hit_tmp;
+            }
+        }
+    });
+}
+
+bool BVH8::occluded(const Ray & r, double t_min, double t_max) const
+{
+    if (bvh_.occluded_unbounded(r, t_min, t_max))
+        return true;
+
+    if (node_count() == 0)
+        return false;
+
+    Node interpolated;
+    float time = std::clamp(r.time(), 0.0, 1.0);
+
+    auto trace_nodes = [&] (auto leaf) {
+        if (!close_nodes_.empty()) {
+            return traverse_any([&] (uint32_t i) -> const Node & {
+                interpolate(nodes_[i], close_nodes_[i], time, interpolated);
+                return interpolated;
+            }, r, t_min, t_max, leaf);
+        }
+
+        if (layout_ == Layout::Compressed)
+            return traverse_any([this] (uint32_t i) -> const CompressedNode & { return compressed_nodes_[i]; }, r, t_min, t_max, leaf);
+
+        return traverse_any([this] (uint32_t i) -> const Node & { return nodes_[i]; }, r, t_min, t_max, leaf);
+    };
+
+    if (!spheres_.empty()) {
+        return trace_nodes([this] (uint32_t first, uint32_t count, const Ray & r, double t_min, double t_max) {
+            return intersects_spheres(spheres_.data(), first, count, r, t_min, t_max);
+        });
+    }
+
+    if (sphere_set_.size() > 0) {
+        return trace_nodes([this] (uint32_t first, uint32_t count, const Ray & r, double t_min, double t_max) {
+            return sphere_set_.intersects(first, count, r, t_min, t_max);
+        });
+    }
+
+    return trace_nodes([this] (uint32_t first, uint32_t count, const Ray & r, double t_min, double t_max) {
+        for (uint32_t i = first; i < first + count; ++i)
+            if (bvh_.objects_[i] -> occluded(r, t_min, t_max))
+                return true;
+
+        return false;
+    });
+}
+
+bool BVH8::intersects_spheres(
+    const SphereRecord * spheres,
+    uint32_t first,
+    uint32_t count,
+    const Ray & r,
+    double t_min,
+    double t_max)
+{
+    for (uint32_t i = first; i < first + count; ++i)
+        if (Sphere::intersects(spheres[i].center, spheres[i].radius, r, t_min, t_max))
+            return true;
+
+    return false;
+}
+
+void BVH8::intersect_spheres(
+    const SphereRecord * spheres,
+    const std::vector<std::shared_ptr<Material>> & materials,
+    uint32_t first,
+    uint32_t count,
+    const Ray & r,
+    double t_min,
+    double & t_max,
+    std::optional<Hit> & hit)
+{
+    for (uint32_t i = first; i < first + count; ++i) {
+        const SphereRecord & s = spheres[i];
+
+        if (auto hit_tmp = Sphere::intersect(s.center, s.radius, materials[s.material], r, t_min, t_max)) {
+            t_max = hit_tmp -> solution;
+            hit = hit_tmp;
+        }
+    }
+}
+
+template<typename F, typename L>
+std::optional<Hit> BVH8::traverse(F fetch, const Ray & r, double t_min, double t_max, L leaf)
+{
+    std::optional<Hit> hit = std::nullopt;
+
+    float origin[3], inv_direction[3];
+    bool negative[3];
+    prepare(r, origin, inv_direction, negative);
+
+    struct Entry {
+        uint32_t child;
+        uint32_t count;
+        float distance;
+    };
+
+    // Every level pushes at most width - 1 entries more than it pops
+    Entry stack[(width - 1) * BVH::max_depth + 1];
+    int stack_size = 0;
+
+    stack[stack_size++] = { 0, 0, -std::numeric_limits<float>::infinity() };
+
+    while (stack_size > 0) {
+        Entry e = stack[--stack_size];
+
+        // Skip subtrees behind the closest hit found so far
+        if (e.distance > t_max)
+            continue;
+
+        if (e.count > 0) {
+            leaf(e.child, e.count, r, t_min, t_max, hit);
+            continue;
+        }
+
+        const auto & node = fetch(e.child);
+
+        float distances[width];
+        int mask = intersect(node, origin, inv_direction, negative, t_min, t_max, distances);
+
+        // Push the hit children farthest first so that the nearest one is visited next
+        int order[width];
+        int n_hits = 0;
+
+        for (; mask; mask &= mask - 1) {
+            int i = std::countr_zero(static_cast<unsigned int>(mask));
+            int k = n_hits++;
+
+            for (; k > 0 && distances[order[k - 1]] < distances[i]; --k)
+                order[k] = order[k - 1];
+
+            order[k] = i;
+        }
+
+        for (int k = 0; k < n_hits; ++k)
+            stack[stack_size++] = { node.child[order[k]], node.count[order[k]], distances[order[k]] };
+    }
+
+    return hit;
+}
+
+template<typename F, typename L>
+bool BVH8::traverse_any(F fetch, const Ray & r, double t_min, double t_max, L leaf)
+{
+    float origin[3], inv_direction[3];
+    bool negative[3];
+    prepare(r, origin, inv_direction, negative);
+
+    struct Entry {
+        uint32_t child;
+        uint32_t count;
+    };
+
+    // Any intersection ends the query, so hit children are pushed without sorting
+    Entry stack[(width - 1) * BVH::max_depth + 1];
+    int stack_size = 0;
+
+    stack[stack_size++] = { 0, 0 };
+
+    while (stack_size > 0) {
+        Entry e = stack[--stack_size];
+
+        if (e.count > 0) {
+            if (leaf(e.child, e.count, r, t_min, t_max))
+                return true;
+
+            continue;
+        }
+
+        const auto & node = fetch(e.child);
+
+        float distances[width];
+        int mask = intersect(node, origin, inv_direction, negative, t_min, t_max, distances);
+
+        for (; mask; mask &= mask - 1) {
+            int i = std::countr_zero(static_cast<unsigned int>(mask));
+            stack[stack_size++] = { node.child[i], node.count[i] };
+        }
+    }
+
+    return false;
+}
+
+template<int P>
+int BVH8::intersect(const Node & node, int i, const Packet<P> & packet, int active, float t_min, float & distance)
+{
+    // Near and far planes are selected per ray by the direction sign, so that the inverted boxes
+    // of unused slots are never hit
+#if defined(__AVX512F__)
+    if constexpr (P == 16) {
+        __m512 i_x = _mm512_load_ps(packet.i_x);
+        __m512 i_y = _mm512_load_ps(packet.i_y);
+        __m512 i_z = _mm512_load_ps(packet.i_z);
+
+        __m512 lo_x = _mm512_mul_ps(_mm512_sub_ps(_mm512_set1_ps(node.min_x[i]), _mm512_load_ps(packet.o_x)), i_x);
+        __m512 lo_y = _mm512_mul_ps(_mm512_sub_ps(_mm512_set1_ps(node.min_y[i]), _mm512_load_ps(packet.o_y)), i_y);
+        __m512 lo_z = _mm512_mul_ps(_mm512_sub_ps(_mm512_set1_ps(node.min_z[i]), _mm512_load_ps(packet.o_z)), i_z);
+        __m512 hi_x = _mm512_mul_ps(_mm512_sub_ps(_mm512_set1_ps(node.max_x[i]), _mm512_load_ps(packet.o_x)), i_x);
+        __m512 hi_y = _mm512_mul_ps(_mm512_sub_ps(_mm512_set1_ps(node.max_y[i]), _mm512_load_ps(packet.o_y)), i_y);
+        __m512 hi_z = _mm512_mul_ps(_mm512_sub_ps(_mm512_set1_ps(node.max_z[i]), _mm512_load_ps(packet.o_z)), i_z);
+
+        __m512 zero = _mm512_setzero_ps();
+        __mmask16 n_x = _mm512_cmp_ps_mask(i_x, zero, _CMP_LT_OQ);
+        __mmask16 n_y = _mm512_cmp_ps_mask(i_y, zero, _CMP_LT_OQ);
+        __mmask16 n_z = _mm512_cmp_ps_mask(i_z, zero, _CMP_LT_OQ);
+
+        __m512 t_near = _mm512_max_ps(
+            _mm512_max_ps(_mm512_mask_blend_ps(n_x, lo_x, hi_x), _mm512_mask_blend_ps(n_y, lo_y, hi_y)),
+            _mm512_max_ps(_mm512_mask_blend_ps(n_z, lo_z, hi_z), _mm512_set1_ps(t_min)));
+
+        __m512 t_far = _mm512_min_ps(
+            _mm512_min_ps(_mm512_mask_blend_ps(n_x, hi_x, lo_x), _mm512_mask_blend_ps(n_y, hi_y, lo_y)),
+            _mm512_mask_blend_ps(n_z, hi_z, lo_z));
+
+        t_far = _mm512_min_ps(_mm512_mul_ps(t_far, _mm512_set1_ps(far_scale)), _mm512_load_ps(packet.t_max));
+
+        __mmask16 mask = _mm512_mask_cmp_ps_mask(__mmask16(active), t_near, t_far, _CMP_LE_OQ);
+
+        if (mask)
+            distance = _mm512_mask_reduce_min_ps(mask, t_near);
+
+        return mask;
+    }
+#endif
+
+#if defined(__AVX2__)
+    if constexpr (P == 8) {
+        __m256 i_x = _mm256_load_ps(packet.i_x);
+        __m256 i_y = _mm256_load_ps(packet.i_y);
+        __m256 i_z = _mm256_load_ps(packet.i_z);
+
+        __m256 lo_x = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(node.min_x[i]), _mm256_load_ps(packet.o_x)), i_x);
+        __m256 lo_y = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(node.min_y[i]), _mm256_load_ps(packet.o_y)), i_y);
+        __m256 lo_z = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(node.min_z[i]), _mm256_load_ps(packet.o_z)), i_z);
+        __m256 hi_x = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(node.max_x[i]), _mm256_load_ps(packet.o_x)), i_x);
+        __m256 hi_y = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(node.max_y[i]), _mm256_load_ps(packet.o_y)), i_y);
+        __m256 hi_z = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(node.max_z[i]), _mm256_load_ps(packet.o_z)), i_z);
+
+        // blendv selects by the sign bit, which is set for negative inverse directions
+        __m256 t_near = _mm256_max_ps(
+            _mm256_max_ps(_mm256_blendv_ps(lo_x, hi_x, i_x), _mm256_blendv_ps(lo_y, hi_y, i_y)),
+            _mm256_max_ps(_mm256_blendv_ps(lo_z, hi_z, i_z), _mm256_set1_ps(t_min)));
+
+        __m256 t_far = _mm256_min_ps(
+            _mm256_min_ps(_mm256_blendv_ps(hi_x, lo_x, i_x), _mm256_blendv_ps(hi_y, lo_y, i_y)),
+            _mm256_blendv_ps(hi_z, lo_z, i_z));
+
+        t_far = _mm256_min_ps(_mm256_mul_ps(t_far, _mm256_set1_ps(far_scale)), _mm256_load_ps(packet.t_max));
+
+        int mask = _mm256_movemask_ps(_mm256_cmp_ps(t_near, t_far, _CMP_LE_OQ)) & active;
+
+        if (mask) {
+            alignas(32) float near[8];
+            _mm256_store_ps(near, t_near);
+
+            distance = std::numeric_limits<float>::infinity();
+            for (int m = mask; m; m &= m - 1)
+                distance = std::min(distance, near[std::countr_zero(static_cast<unsigned int>(m))]);
+        }
+
+        return mask;
+    }
+#endif
+
+    int mask = 0;
+    distance = std::numeric_limits<float>::infinity();
+
+    for (int m = active; m; m &= m - 1) {
+        int k = std::countr_zero(static_cast<unsigned int>(m));
+
+        auto slab = [] (float lo, float hi, float o, float inv, float & near, float & far) {
+            near = (inv < 0 ? hi - o : lo - o) * inv;
+            far = (inv < 0 ? lo - o : hi - o) * inv;
+        };
+
+        float n_x, f_x, n_y, f_y, n_z, f_z;
+        slab(node.min_x[i], node.max_x[i], packet.o_x[k], packet.i_x[k], n_x, f_x);
+        slab(node.min_y[i], node.max_y[i], packet.o_y[k], packet.i_y[k], n_y, f_y);
+        slab(node.min_z[i], node.max_z[i], packet.o_z[k], packet.i_z[k], n_z, f_z);
+
+        float t_near = std::max(std::max(n_x, n_y), std::max(n_z, t_min));
+        float t_far = std::min(std::min(std::min(f_x, f_y), f_z) * far_scale, packet.t_max[k]);
+
+        if (t_near <= t_far) {
+            mask |= 1 << k;
+            distance = std::min(distance, t_near);
+        }
+    }
+
+    return mask;
+}
+
+template<int P, typename L>
+void BVH8::traverse_packet(Packet<P> & packet, int active, float t_min, L leaf) const
+{
+    struct Entry {
+        uint32_t child;
+        uint32_t count;
+        int mask;         // rays that hit the child
+        float distance;   // smallest entry distance among them
+    };
+
+    Entry stack[(width - 1) * BVH::max_depth + 1];
+    int stack_size = 0;
+
+    stack[stack_size++] = { 0, 0, active, -std::numeric_limits<float>::infinity() };
+
+    while (stack_size > 0) {
+        Entry e = stack[--stack_size];
+
+        // Rays that finished or found a hit before the child no longer need it
+        int mask = 0;
+        for (int m = e.mask & active; m; m &= m - 1) {
+            int k = std::countr_zero(static_cast<unsigned int>(m));
+            if (e.distance <= packet.t_max[k])
+                mask |= 1 << k;
+        }
+
+        if (!mask)
+            continue;
+
+        if (e.count > 0) {
+            for (; mask; mask &= mask - 1) {
+                int k = std::countr_zero(static_cast<unsigned int>(mask));
+                if (leaf(e.child, e.count, k))
+                    active &= ~(1 << k);
+            }
+
+            continue;
+        }
+
+        const Node & node = nodes_[e.child];
+
+        Entry hits[width];
+        int n_hits = 0;
+
+        for (int i = 0; i < width; ++i) {
+            float distance;
+            int child_mask = intersect(node, i, packet, mask, t_min, distance);
+
+            if (!child_mask)
+                continue;
+
+            // Keep the hit children sorted nearest first
+            int k = n_hits++;
+            for (; k > 0 && hits[k - 1].distance > distance; --k)
+                hits[k] = hits[k - 1];
+
+            hits[k] = { node.child[i], node.count[i], child_mask, distance };
+        }
+
+        // Farthest first so that the nearest child is visited next
+        for (int k = n_hits; k-- > 0;)
+            stack[stack_size++] = hits[k];
+    }
+}
+
+void BVH8::intersect_leaf(
+    uint32_t first,
+    uint32_t count,
+    const Ray & r,
+    double t_min,
+    double & t_max,
+    std::optional<Hit> & hit) const
+{
+    if (!spheres_.empty()) {
+        intersect_spheres(spheres_.data(), materials_, first, count, r, t_min, t_max, hit);
+        return;
+    }
+
+    if (sphere_set_.size() > 0) {
+        sphere_set_.intersect(first, count, r, t_min, t_max, hit);
+        return;
+    }
+
+    for (uint32_t i = first; i < first + count; ++i) {
+        if (auto hit_tmp = bvh_.objects_[i] -> trace(r, t_min, t_max)) {
+            t_max = hit_tmp -> solution;
+            hit = hit_tmp;
+        }
+    }
+}
+
+bool BVH8::intersects_leaf(uint32_t first, uint32_t count, const Ray & r, double t_min, double t_max) const
+{
+    if (!spheres_.empty())
+        return intersects_spheres(spheres_.data(), first, count, r, t_min, t_max);
+
+    if (sphere_set_.size() > 0)
+        return sphere_set_.intersects(first, count, r, t_min, t_max);
+
+    for (uint32_t i = first; i < first + count; ++i)
+        if (bvh_.objects_[i] -> occluded(r, t_min, t_max))
+            return true;
+
+    return false;
+}
+
+template<int P>
+void BVH8::trace_packet(const Ray rays[], int n, double t_min, double t_max, std::optional<Hit> hits[]) const
+{
+    Packet<P> packet;
+    double ray_t_max[P];
+    const Plane * planes[P];
+    int active = 0;
+
+    for (int k = 0; k < P; ++k) {
+        float origin[3], inv_direction[3];
+        bool negative[3];
+
+        // Unused slots repeat the first ray and stay inactive
+        const Ray & r = rays[k < n ? k : 0];
+        prepare(r, origin, inv_direction, negative);
+
+        packet.o_x[k] = origin[0];
+        packet.o_y[k] = origin[1];
+        packet.o_z[k] = origin[2];
+        packet.i_x[k] = inv_direction[0];
+        packet.i_y[k] = inv_direction[1];
+        packet.i_z[k] = inv_direction[2];
+        packet.t_max[k] = t_max;
+
+        if (k >= n)
+            continue;
+
+        // Unbounded objects first, as for single rays
+        ray_t_max[k] = t_max;
+        planes[k] = bvh_.nearest_plane(r, t_min, ray_t_max[k]);
+        hits[k] = bvh_.trace_unbounded(r, t_min, ray_t_max[k]);
+
+        if (hits[k])
+            planes[k] = nullptr;
+
+        packet.t_max[k] = ray_t_max[k];
+        active |= 1 << k;
+    }
+
+    traverse_packet(packet, active, t_min, [&] (uint32_t first, uint32_t count, int k) {
+        std::optional<Hit> hit;
+        intersect_leaf(first, count, rays[k], t_min, ray_t_max[k], hit);
+
+        if (hit) {
+            hits[k] = hit;
+            planes[k] = nullptr;
+            packet.t_max[k] = ray_t_max[k];
+        }
+
+        return false;
+    });
+
+    // Plane hits are built only for rays that found nothing closer
+    for (int k = 0; k < n; ++k)
+        if (planes[k])
+            hits[k] = planes[k] -> hit(rays[k], ray_t_max[k]);
+}
+
+template<int P>
+void BVH8::occluded_packet(const Ray rays[], int n, double t_min, double t_max, bool occluded[]) const
+{
+    Packet<P> packet;
+    int active = 0;
+
+    for (int k = 0; k < P; ++k) {
+        float origin[3], inv_direction[3];
+        bool negative[3];
+
+        const Ray & r = rays[k < n ? k : 0];
+        prepare(r, origin, inv_direction, negative);
+
+        packet.o_x[k] = origin[0];
+        packet.o_y[k] = origin[1];
+        packet.o_z[k] = origin[2];
+        packet.i_x[k] = inv_direction[0];
+        packet.i_y[k] = inv_direction[1];
+        packet.i_z[k] = inv_direction[2];
+        packet.t_max[k] = t_max;
+
+        if (k >= n)
+            continue;
+
+        occluded[k] = bvh_.occluded_unbounded(r, t_min, t_max);
+
+        if (!occluded[k])
+            active |= 1 << k;
+    }
+
+    traverse_packet(packet, active, t_min, [&] (uint32_t first, uint32_t count, int k) {
+        occluded[k] = intersects_leaf(first, count, rays[k], t_min, t_max);
+        return occluded[k];
+    });
+}
+
+void BVH8::trace(const Ray rays[], int n, double t_min, double t_max, std::optional<Hit> hits[]) const
+{
+    for (int begin = 0; begin < n; begin += simd_packet_size) {
+        int size = std::min(n - begin, simd_packet_size);
+
+        if (!close_nodes_.empty() || layout_ == Layout::Compressed || nodes_.empty()) {
+            for (int k = begin; k < begin + size; ++k)
+                hits[k] = trace(rays[k], t_min, t_max);
+        } else if (size <= 8) {
+            trace_packet<8>(rays + begin, size, t_min, t_max, hits + begin);
+        } else {
+            trace_packet<16>(rays + begin, size, t_min, t_max, hits + begin);
+        }
+    }
+}
+
+void BVH8::trace_batch(std::span<const Ray> rays, double t_min, double t_max, std::span<std::optional<Hit>> hits) const
+{
+    for (size_t begin = 0; begin < rays.size(); begin += max_packet_size) {
+        size_t end = std::min(begin + max_packet_size, rays.size());
+
+        if (std::none_of(&hits[begin], &hits[begin] + (end - begin), [] (const auto & hit) { return hit.has_value(); })) {
+            trace(&rays[begin], end - begin, t_min, t_max, &hits[begin]);
+            continue;
+        }
+
+        for (size_t k = begin; k < end; ++k)
+            if (auto hit = BVH8::trace(rays[k], t_min, hits[k] ? hits[k] -> solution : t_max))
+                hits[k] = hit;
+    }
+}
+
+void BVH8::occluded(const Ray rays[], int n, double t_min, double t_max, bool occluded[]) const
+{
+    for (int begin = 0; begin < n; begin += simd_packet_size) {
+        int size = std::min(n - begin, simd_packet_size);
+
+        if (!close_nodes_.empty() || layout_ == Layout::Compressed || nodes_.empty()) {
+            for (int k = begin; k < begin + size; ++k)
+                occluded[k] = this -> occluded(rays[k], t_min, t_max);
+        } else if (size <= 8) {
+            occluded_packet<8>(rays + begin, size, t_min, t_max, occluded + begin);
+        } else {
+            occluded_packet<16>(rays + begin, size, t_min, t_max, occluded + begin);
+        }
+    }
+}
+
+AABB BVH8::bounding_box() const
+{
+    return bvh_.bounding_box();
+}
+
+bool BVH8::moving() const
+{
+    return bvh_.moving();
+}
+
+AABB BVH8::bounding_box_at(const double & time) const
+{
+    return bvh_.bounding_box_at(time);
+}
+
+size_t BVH8::node_count() const
+{
+    return layout_ == Layout::Compressed ? compressed_nodes_.size() : nodes_.size();
+}
+
+AcceleratorQuality BVH8::quality() const
+{
+    AcceleratorQuality quality;
+    quality.node_count = node_count();
+
+    if (quality.node_count == 0)
+        return quality;
+
+    auto node_at = [this] (uint32_t i) {
+        return layout_ == Layout::Compressed ? decompress(compressed_nodes_[i]) : nodes_[i];
+    };
+
+    // Surface area of child box `i`, or of the intersection of children `i` and `j`
+    auto area = [] (const Node & node, int i, int j) {
+        double e[3] = {
+            std::min(node.max_x[i], node.max_x[j]) - std::max(node.min_x[i], node.min_x[j]),
+            std::min(node.max_y[i], node.max_y[j]) - std::max(node.min_y[i], node.min_y[j]),
+            std::min(node.max_z[i], node.max_z[j]) - std::max(node.min_z[i], node.min_z[j]) };
+
+        if (e[0] < 0 || e[1] < 0 || e[2] < 0)
+            return 0.0;
+
+        return 2 * (e[0] * e[1] + e[1] * e[2] + e[2] * e[0]);
+    };
+
+    auto empty = [] (const Node & node, int i) {
+        return node.min_x[i] > node.max_x[i] || node.min_y[i] > node.max_y[i] || node.min_z[i] > node.max_z[i];
+    };
+
+    double root_area = bvh_.nodes_[0].box.surface_area();
+    if (!(root_area > 0))
+        root_area = 1;
+
+    double child_area = 0;
+    double overlap_area = 0;
+
+    // Every node costs one visit per ray that hits its box, which is the box of its slot in the parent
+    std::vector<std::pair<uint32_t, uint32_t>> stack = { { 0, 0 } };
+    quality.sah_cost = 1;
+
+    while (!stack.empty()) {
+        auto [node_id, depth] = stack.back();
+        stack.pop_back();
+
+        Node node = node_at(node_id);
+
+        for (int i = 0; i < width; ++i) {
+            if (empty(node, i))
+                continue;
+
+            double a = area(node, i, i);
+            child_area += a;
+
+            for (int j = i + 1; j < width; ++j)
+                if (!empty(node, j))
+                    overlap_area += area(node, i, j);
+
+            if (node.count[i] > 0) {
+                quality.sah_cost += a / root_area * node.count[i];
+                ++quality.leaf_count;
+
+                if (quality.depth_histogram.size() <= depth + 1)
+                    quality.depth_histogram.resize(depth + 2);
+                if (quality.leaf_size_histogram.size() <= node.count[i])
+                    quality.leaf_size_histogram.resize(node.count[i] + 1);
+
+                ++quality.depth_histogram[depth + 1];
+                ++quality.leaf_size_histogram[node.count[i]];
+            } else {
+                quality.sah_cost += a / root_area;
+                stack.push_back({ node.child[i], depth + 1 });
+            }
+        }
+    }
+
+    quality.overlap = child_area > 0 ? overlap_area / child_area : 0;
+
+    return quality;
+}
+
+size_t BVH8::memory_usage() const
+{
+    return
+        (nodes_.size() + close_nodes_.size()) * sizeof(Node) +
+        compressed_nodes_.size() * sizeof(CompressedNode) +
+        spheres_.size() * sizeof(SphereRecord) +
+        sphere_set_.memory_usage();
+}
+
+
+MappedBVH8::MappedBVH8(
+    std::shared_ptr<const void> storage,
+    const BVH8::Layout & layout,
+    const void * nodes,
+    size_t node_count,
+    const SphereRecord * spheres,
+    std::vector<std::shared_ptr<Material>> materials,
+    std::vector<std::shared_ptr<Hittable>> unbounded,
+    const AABB & box) :
+
+    storage_(storage),
+    layout_(layout),
+    nodes_(nodes),
+    node_count_(node_count),
+    spheres_(spheres),
+    materials_(std::move(materials)),
+    unbounded_(std::move(unbounded)),
+    box_(box)
+{}
+
+std::optional<Hit> MappedBVH8::trace(const Ray & r, double t_min, double t_max) const
+{
+    std::optional<Hit> unbounded_hit = std::nullopt;
+
+    for (const auto & object : unbounded_) {
+        if (auto hit_tmp = object -> trace(r, t_min, t_max)) {
+            t_max = hit_tmp -> solution;
+            unbounded_hit = hit_tmp;
+        }
+    }
+
+    if (node_count_ == 0)
+        return unbounded_hit;
+
+    auto leaf = [this] (uint32_t first, uint32_t count, const Ray & r, double t_min, double & t_max, std::optional<Hit> & hit) {
+        BVH8::intersect_spheres(spheres_, materials_, first, count, r, t_min, t_max, hit);
+    };
+
+    std::optional<Hit> hit;
+
+    if (layout_ == BVH8::Layout::Compressed)
+        hit = BVH8::traverse([nodes = static_cast<const BVH8::CompressedNode *>(nodes_)] (uint32_t i) -> const BVH8::CompressedNode & { return nodes[i]; }, r, t_min, t_max, leaf);
+    else
+        hit = BVH8::traverse([nodes = static_cast<const BVH8::Node *>(nodes_)] (uint32_t i) -> const BVH8::Node & { return nodes[i]; }, r, t_min, t_max, leaf);
+
+    return hit ? hit : unbounded_hit;
+}
+
+bool MappedBVH8::occluded(const Ray & r, double t_min, double t_max) const
+{
+    for (const auto & object : unbounded_)
+        if (object -> occluded(r, t_min, t_max))
+            return true;
+
+    if (node_count_ == 0)
+        return false;
+
+    auto leaf = [this] (uint32_t first, uint32_t count, const Ray & r, double t_min, double t_max) {
+        return BVH8::intersects_spheres(spheres_, first, count, r, t_min, t_max);
+    };
+
+    if (layout_ == BVH8::Layout::Compressed)
+        return BVH8::traverse_any([nodes = static_cast<const BVH8::CompressedNode *>(nodes_)] (uint32_t i) -> const BVH8::CompressedNode & { return nodes[i]; }, r, t_min, t_max, leaf);
+
+    return BVH8::traverse_any([nodes = static_cast<const BVH8::Node *>(nodes_)] (uint32_t i) -> const BVH8::Node & { return nodes[i]; }, r, t_min, t_max, leaf);
+}
+
+AABB MappedBVH8::bounding_box() const
+{
+    return box_;
+}
+
+size_t MappedBVH8::node_count() const
+{
+    return node_count_;
+}
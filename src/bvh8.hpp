@@ -0,0 +1,266 @@
+#ifndef BVH8_HPP
+#define BVH8_HPP
+
+
+#include "aabb.hpp"
+#include "ray.hpp"
+#include "hittable.hpp"
+#include "bvh.hpp"
+#include "sphere.hpp"
+#include "sphere_set.hpp"
+#include "diagnostics.hpp"
+
+
+#include <cstdint>
+#include <optional>
+#include <vector>
+#include <memory>
+
+
+class MappedBVH8;
+
+
+// 8-wide BVH obtained by collapsing a binary BVH, each node tests all of its children
+// with a single AVX2 slab test (scalar loop when AVX2 is not enabled at compile time).
+// For scenes with moving objects nodes keep child bounds at shutter open and close, which are
+// interpolated to the ray time during traversal. Such scenes always use the full layout
+class BVH8 : public Hittable {
+public:
+
+    enum class Layout {
+        Full,       // single precision child bounds, 256 bytes per node
+        Compressed  // child bounds quantized to 8 bits within the node bounds, 104 bytes per node
+    };
+
+    enum class Primitives {
+        Objects,    // leaves reference the scene objects through their shared pointers
+        Inline,     // spheres are copied in leaf order into one array and intersected without virtual calls,
+                    // scenes with other objects fall back to Objects
+        SoA         // as Inline, but the spheres go into a SphereSet and every leaf is tested 8 or 16 spheres
+                    // at a time, best paired with a max_leaf_size of the SIMD width
+    };
+
+    BVH8(
+        const HittableList & list,
+        const BVH::Builder & builder = BVH::Builder::SAH,
+        const Layout & layout = Layout::Full,
+        const Primitives & primitives = Primitives::Inline,
+        const int & max_leaf_size = 4);
+
+    virtual std::optional<Hit> trace(const Ray & r, double t_min, double t_max) const override;
+
+    // Closest hit that also counts the visited nodes and the tested primitives, for diagnostics
+    std::optional<Hit> trace(const Ray & r, double t_min, double t_max, TraversalStats & stats) const;
+
+    virtual bool occluded(const Ray & r, double t_min, double t_max) const override;
+
+    // Traces the batch as packets of max_packet_size consecutive rays, rays of packets that carry
+    // hits from earlier objects are traced one at a time
+    virtual void trace_batch(std::span<const Ray> rays, double t_min, double t_max, std::span<std::optional<Hit>> hits) const override;
+
+    // Largest number of rays traced together by the packet traversals
+    static constexpr int max_packet_size = 16;
+
+    // Closest hits of coherent rays, neighbouring primary rays for instance, in packets of up to
+    // max_packet_size rays, or 8 rays on CPUs without AVX-512.
+    // The packet walks the tree together: every node is fetched once and tested against all active rays,
+    // each child is visited with the mask of the rays that hit it, and a ray leaves the packet once its
+    // subtrees are missed. Moving scenes and the compressed layout trace the rays one at a time
+    void trace(const Ray rays[], int n, double t_min, double t_max, std::optional<Hit> hits[]) const;
+
+    // Any hit queries of a packet, shadow rays towards one light for instance
+    void occluded(const Ray rays[], int n, double t_min, double t_max, bool occluded[]) const;
+
+    virtual AABB bounding_box() const override;
+
+    virtual bool moving() const override;
+    virtual AABB bounding_box_at(const double & time) const override;
+
+    // Refits the underlying binary BVH and collapses it again
+    RefitStats refit(const double & rebuild_threshold = 1.5);
+
+    size_t node_count() const;
+
+    // Size of the node and inline primitive arrays in bytes
+    size_t memory_usage() const;
+
+    // SAH cost, sibling overlap and leaf statistics of the 8-wide tree, moving scenes are measured
+    // with their bounds at shutter open
+    AcceleratorQuality quality() const;
+
+private:
+
+    static constexpr int width = 8;
+
+    // Child bounds in SoA layout, unused slots hold empty boxes that are never hit.
+    // Nodes start on cache lines so that the bounds of a node span exactly three of them
+    struct alignas(64) Node {
+        float min_x[width], min_y[width], min_z[width];
+        float max_x[width], max_y[width], max_z[width];
+        uint32_t child[width]; // interior child: node index, leaf child: first object index
+        uint16_t count[width]; // number of objects of a leaf child, 0 for interior children
+    };
+
+    // Child box i along axis a is origin[a] + 2^exponent[a] * [q_min, q_max]
+    struct alignas(8) CompressedNode {
+        float origin[3];
+        int8_t exponent[3];
+        uint8_t q_min_x[width], q_min_y[width], q_min_z[width];
+        uint8_t q_max_x[width], q_max_y[width], q_max_z[width];
+        uint8_t count[width];
+        uint32_t child[width];
+    };
+
+    // Rays of a packet in SoA layout, directions are stored inverted
+    template<int P>
+    struct alignas(64) Packet {
+        float o_x[P], o_y[P], o_z[P];
+        float i_x[P], i_y[P], i_z[P];
+        float t_max[P];
+    };
+
+    uint32_t collapse(uint32_t binary_id);
+
+    // Builds the layout selected at construction from the binary BVH, nodes are emitted depth-first
+    // and the inline primitives in leaf order
+    void build();
+
+    static CompressedNode compress(const Node & node);
+    static Node decompress(const CompressedNode & node);
+
+    template<bool Count>
+    std::optional<Hit> closest_hit(const Ray & r, double t_min, double t_max, TraversalStats & stats) const;
+
+    // Entry distances of the children of `node` and the mask of the children that are hit
+    static int intersect(
+        const Node & node,
+        const float origin[3],
+        const float inv_direction[3],
+        const bool negative[3],
+        float t_min,
+        float t_max,
+        float distances[width]);
+
+    static int intersect(
+        const CompressedNode & node,
+        const float origin[3],
+        const float inv_direction[3],
+        const bool negative[3],
+        float t_min,
+        float t_max,
+        float distances[width]);
+
+    // Closest hit over the nodes returned by `fetch(index)`, `leaf(first, count, r, t_min, t_max, hit)`
+    // traces the objects of a leaf and shrinks t_max when it finds a closer hit
+    template<typename F, typename L>
+    static std::optional<Hit> traverse(F fetch, const Ray & r, double t_min, double t_max, L leaf);
+
+    // Any hit, `leaf(first, count, r, t_min, t_max)` returns whether a leaf is hit
+    template<typename F, typename L>
+    static bool traverse_any(F fetch, const Ray & r, double t_min, double t_max, L leaf);
+
+    // Child bounds of a moving node at `time` from its bounds at shutter open and close
+    static void interpolate(const Node & open, const Node & close, float time, Node & node);
+
+    // Ray setup shared by the traversals
+    static void prepare(const Ray & r, float origin[3], float inv_direction[3], bool negative[3]);
+
+    // Mask of the rays among `active` that hit child `i` of `node`, `distance` receives their smallest
+    // entry distance
+    template<int P>
+    static int intersect(const Node & node, int i, const Packet<P> & packet, int active, float t_min, float & distance);
+
+    // Packet traversal over nodes_, `leaf(first, count, k)` handles ray k of a leaf and returns true
+    // when the ray is done and leaves the packet
+    template<int P, typename L>
+    void traverse_packet(Packet<P> & packet, int active, float t_min, L leaf) const;
+
+    template<int P>
+    void trace_packet(const Ray rays[], int n, double t_min, double t_max, std::optional<Hit> hits[]) const;
+
+    template<int P>
+    void occluded_packet(const Ray rays[], int n, double t_min, double t_max, bool occluded[]) const;
+
+    // Closest hit and any hit among the primitives [first, first + count) of a leaf
+    void intersect_leaf(
+        uint32_t first,
+        uint32_t count,
+        const Ray & r,
+        double t_min,
+        double & t_max,
+        std::optional<Hit> & hit) const;
+
+    bool intersects_leaf(uint32_t first, uint32_t count, const Ray & r, double t_min, double t_max) const;
+
+    // Leaf test over a range of inline spheres
+    static void intersect_spheres(
+        const SphereRecord * spheres,
+        const std::vector<std::shared_ptr<Material>> & materials,
+        uint32_t first,
+        uint32_t count,
+        const Ray & r,
+        double t_min,
+        double & t_max,
+        std::optional<Hit> & hit);
+
+    static bool intersects_spheres(
+        const SphereRecord * spheres,
+        uint32_t first,
+        uint32_t count,
+        const Ray & r,
+        double t_min,
+        double t_max);
+
+    friend class BVHCache;
+    friend class MappedBVH8;
+
+    BVH bvh_;
+    Layout layout_;
+    Primitives primitives_;
+    std::vector<Node> nodes_;              // for moving scenes: child bounds at shutter open
+    std::vector<Node> close_nodes_;        // child bounds at shutter close, empty for static scenes
+    std::vector<CompressedNode> compressed_nodes_;
+
+    std::vector<SphereRecord> spheres_;                 // inline primitives in leaf order
+    std::vector<std::shared_ptr<Material>> materials_;  // indexed by SphereRecord::material
+    SphereSet sphere_set_;                              // SoA primitives in leaf order
+};
+
+
+// BVH8 over spheres whose nodes and primitives live in external read-only memory, typically a
+// memory mapped cache file (see BVHCache). Materials are shared with the live scene through a table
+class MappedBVH8 : public Hittable {
+public:
+
+    MappedBVH8(
+        std::shared_ptr<const void> storage,
+        const BVH8::Layout & layout,
+        const void * nodes,
+        size_t node_count,
+        const SphereRecord * spheres,
+        std::vector<std::shared_ptr<Material>> materials,
+        std::vector<std::shared_ptr<Hittable>> unbounded,
+        const AABB & box);
+
+    virtual std::optional<Hit> trace(const Ray & r, double t_min, double t_max) const override;
+
+    virtual bool occluded(const Ray & r, double t_min, double t_max) const override;
+
+    virtual AABB bounding_box() const override;
+
+    size_t node_count() const;
+
+private:
+
+    std::shared_ptr<const void> storage_; // keeps the mapping alive
+    BVH8::Layout layout_;
+    const void * nodes_;
+    size_t node_count_;
+    const SphereRecord * spheres_;
+    std::vector<std::shared_ptr<Material>> materials_;
+    std::vector<std::shared_ptr<Hittable>> unbounded_;  // objects outside the tree, not stored in the file
+    AABB box_;
+};
+
+
+#endif // BVH8_HPP
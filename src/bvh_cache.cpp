@@ -0,0 +1,314 @@
+#include "bvh_cache.hpp"
+#include "sphere.hpp"
+#include "plane.hpp"
+
+
+#include <bit>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <unordered_map>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+namespace {
+
+constexpr char magic[8] = { 'R', 'T', 'B', 'V', 'H', '8', 0, 0 };
+
+// Sections start on cache line boundaries
+constexpr uint64_t alignment = 64;
+
+uint64_t align(const uint64_t & offset)
+{
+    return (offset + alignment - 1) / alignment * alignment;
+}
+
+// Distinct materials of the list in order of first use
+struct MaterialTable {
+    std::vector<std::shared_ptr<Material>> materials;
+    std::unordered_map<const Material *, uint32_t> index;
+
+    explicit MaterialTable(const HittableList & list)
+    {
+        for (const auto & object : list.objects()) {
+            auto sphere = std::dynamic_pointer_cast<Sphere>(object);
+            if (sphere && index.emplace(sphere -> material().get(), materials.size()).second)
+                materials.push_back(sphere -> material());
+        }
+    }
+};
+
+// Planes are traced from the list, only the spheres go into the file
+std::vector<std::shared_ptr<Hittable>> planes(const HittableList & list)
+{
+    std::vector<std::shared_ptr<Hittable>> planes;
+
+    for (const auto & object : list.objects())
+        if (std::dynamic_pointer_cast<Plane>(object))
+            planes.push_back(object);
+
+    return planes;
+}
+
+// 64-bit multiply-xorshift hash over whole words
+class Hasher {
+public:
+
+    void add(const uint64_t & word)
+    {
+        h_ = (h_ ^ word) * 0x9e3779b97f4a7c15ull;
+        h_ ^= h_ >> 32;
+    }
+
+    void add(const double & x)
+    {
+        add(std::bit_cast<uint64_t>(x));
+    }
+
+    uint64_t value() const
+    {
+        return h_;
+    }
+
+private:
+
+    uint64_t h_ = 0xcbf29ce484222325ull;
+};
+
+} // namespace
+
+
+std::optional<uint64_t> BVHCache::scene_hash(const HittableList & list)
+{
+    MaterialTable table(list);
+    Hasher hasher;
+
+    hasher.add(uint64_t(list.objects().size()));
+
+    for (const auto & object : list.objects()) {
+        if (auto plane = std::dynamic_pointer_cast<Plane>(object)) {
+            hasher.add(~uint64_t(0));
+            hasher.add(plane -> point().x);
+            hasher.add(plane -> point().y);
+            hasher.add(plane -> point().z);
+            hasher.add(plane -> normal().x);
+            hasher.add(plane -> normal().y);
+            hasher.add(plane -> normal().z);
+            continue;
+        }
+
+        auto sphere = std::dynamic_pointer_cast<Sphere>(object);
+        if (!sphere)
+            return std::nullopt;
+
+        hasher.add(sphere -> center().x);
+        hasher.add(sphere -> center().y);
+        hasher.add(sphere -> center().z);
+        hasher.add(sphere -> radius());
+        hasher.add(uint64_t(table.index.at(sphere -> material().get())));
+    }
+
+    return hasher.value();
+}
+
+std::optional<std::string> BVHCache::path(
+    const std::string & directory,
+    const HittableList & list,
+    const BVH8::Layout & layout)
+{
+    auto hash = scene_hash(list);
+    if (!hash)
+        return std::nullopt;
+
+    return path(directory, *hash, layout);
+}
+
+std::string BVHCache::path(const std::string & directory, const uint64_t & hash, const BVH8::Layout & layout)
+{
+    char name[64];
+    std::snprintf(
+        name, sizeof(name), "%016llx-%s.bvh8",
+        static_cast<unsigned long long>(hash), layout == BVH8::Layout::Full ? "full" : "compressed");
+
+    return (std::filesystem::path(directory) / name).string();
+}
+
+bool BVHCache::store(const std::string & path, const BVH8 & bvh, const HittableList & list)
+{
+    auto hash = scene_hash(list);
+    if (!hash || bvh.bvh_.objects_.size() + planes(list).size() != list.objects().size())
+        return false;
+
+    MaterialTable table(list);
+
+    // Spheres in leaf order so that leaf ranges index them directly
+    std::vector<SphereRecord> spheres;
+    spheres.reserve(bvh.bvh_.objects_.size());
+
+    for (const auto & object : bvh.bvh_.objects_) {
+        auto sphere = std::dynamic_pointer_cast<Sphere>(object);
+        if (!sphere || !table.index.contains(sphere -> material().get()))
+            return false;
+
+        spheres.push_back({ sphere -> center(), sphere -> radius(), table.index.at(sphere -> material().get()) });
+    }
+
+    bool compressed = bvh.layout_ == BVH8::Layout::Compressed;
+    const char * nodes = compressed ?
+        reinterpret_cast<const char *>(bvh.compressed_nodes_.data()) :
+        reinterpret_cast<const char *>(bvh.nodes_.data());
+
+    Header header;
+    std::memcpy(header.magic, magic, sizeof(magic));
+    header.version = version;
+    header.layout = static_cast<uint32_t>(bvh.layout_);
+    header.scene_hash = *hash;
+    header.node_size = compressed ? sizeof(BVH8::CompressedNode) : sizeof(BVH8::Node);
+    header.node_offset = align(sizeof(Header));
+    header.node_count = bvh.node_count();
+    header.sphere_offset = align(header.node_offset + header.node_count * header.node_size);
+    header.sphere_count = spheres.size();
+    header.material_count = table.materials.size();
+
+    AABB box = bvh.bounding_box();
+    for (int a = 0; a < 3; ++a) {
+        header.bounds[a] = box.min()[a];
+        header.bounds[a + 3] = box.max()[a];
+    }
+
+    // Written next to the target and renamed, so readers never observe a partial file
+    std::string tmp_path = path + ".tmp" + std::to_string(getpid());
+
+    {
+        std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+        if (!file)
+            return false;
+
+        auto pad_to = [&file] (const uint64_t & offset) {
+            static const char zeros[alignment] = {};
+            file.write(zeros, offset - uint64_t(file.tellp()));
+        };
+
+        file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        pad_to(header.node_offset);
+        file.write(nodes, header.node_count * header.node_size);
+        pad_to(header.sphere_offset);
+        file.write(reinterpret_cast<const char *>(spheres.data()), spheres.size() * sizeof(SphereRecord));
+
+        if (!file.flush()) {
+            std::filesystem::remove(tmp_path);
+            return false;
+        }
+    }
+
+    std::error_code error;
+    std::filesystem::rename(tmp_path, path, error);
+
+    if (error) {
+        std::filesystem::remove(tmp_path, error);
+        return false;
+    }
+
+    return true;
+}
+
+std::shared_ptr<MappedBVH8> BVHCache::load(const std::string & path, const HittableList & list)
+{
+    auto hash = scene_hash(list);
+    if (!hash)
+        return nullptr;
+
+    return load(path, list, *hash);
+}
+
+std::shared_ptr<MappedBVH8> BVHCache::load(const std::string & path, const HittableList & list, const uint64_t & hash)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return nullptr;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || size_t(info.st_size) < sizeof(Header)) {
+        close(fd);
+        return nullptr;
+    }
+
+    size_t size = info.st_size;
+    void * base = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    // The mapping stays valid after the descriptor is closed
+    close(fd);
+
+    if (base == MAP_FAILED)
+        return nullptr;
+
+    std::shared_ptr<const void> storage(base, [size] (const void * p) { munmap(const_cast<void *>(p), size); });
+
+    const char * data = static_cast<const char *>(base);
+    const Header & header = *reinterpret_cast<const Header *>(data);
+
+    MaterialTable table(list);
+
+    bool compressed = header.layout == static_cast<uint32_t>(BVH8::Layout::Compressed);
+    uint64_t node_size = compressed ? sizeof(BVH8::CompressedNode) : sizeof(BVH8::Node);
+
+    bool valid =
+        std::memcmp(header.magic, magic, sizeof(magic)) == 0 &&
+        header.version == version &&
+        header.scene_hash == hash &&
+        header.layout <= static_cast<uint32_t>(BVH8::Layout::Compressed) &&
+        header.node_size == node_size &&
+        header.node_offset % alignment == 0 &&
+        header.sphere_offset % alignment == 0 &&
+        header.node_offset + header.node_count * node_size <= header.sphere_offset &&
+        header.sphere_offset + header.sphere_count * sizeof(SphereRecord) <= size &&
+        header.sphere_count + planes(list).size() == list.objects().size() &&
+        header.material_count == table.materials.size();
+
+    if (!valid)
+        return nullptr;
+
+    AABB box(
+        Point3(header.bounds[0], header.bounds[1], header.bounds[2]),
+        Point3(header.bounds[3], header.bounds[4], header.bounds[5]));
+
+    return std::make_shared<MappedBVH8>(
+        storage,
+        static_cast<BVH8::Layout>(header.layout),
+        data + header.node_offset,
+        header.node_count,
+        reinterpret_cast<const SphereRecord *>(data + header.sphere_offset),
+        std::move(table.materials),
+        planes(list),
+        box);
+}
+
+std::shared_ptr<MappedBVH8> BVHCache::load_or_build(
+    const std::string & directory,
+    const HittableList & list,
+    const BVH::Builder & builder,
+    const BVH8::Layout & layout)
+{
+    auto hash = scene_hash(list);
+    if (!hash)
+        return nullptr;
+
+    std::string file = path(directory, *hash, layout);
+
+    if (auto mapped = load(file, list, *hash))
+        return mapped;
+
+    std::error_code error;
+    std::filesystem::create_directories(directory, error);
+
+    if (!store(file, BVH8(list, builder, layout, BVH8::Primitives::Objects), list))
+        return nullptr;
+
+    return load(file, list, *hash);
+}
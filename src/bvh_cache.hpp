@@ -0,0 +1,71 @@
+#ifndef BVH_CACHE_HPP
+#define BVH_CACHE_HPP
+
+
+#include "hittable.hpp"
+#include "bvh8.hpp"
+
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+
+
+// On-disk cache of BVH8 structures over sphere scenes. A cache file holds the nodes and the spheres in
+// leaf order, it is memory mapped read-only on load and traced in place without any deserialization.
+// Planes of the scene stay outside the tree, they are traced from the list and not stored.
+// Files are keyed by a hash of the scene geometry, so a changed scene simply misses the cache.
+// The format is native: files are not portable between machines of different endianness
+class BVHCache {
+public:
+
+    // Hash of the sphere and plane geometry and of the sphere material assignment, nullopt if the list
+    // holds anything but spheres and planes
+    static std::optional<uint64_t> scene_hash(const HittableList & list);
+
+    // Cache file of `list` inside `directory`
+    static std::optional<std::string> path(
+        const std::string & directory,
+        const HittableList & list,
+        const BVH8::Layout & layout = BVH8::Layout::Full);
+
+    // Writes `bvh`, built over `list`, to `path`, returns false on failure
+    static bool store(const std::string & path, const BVH8 & bvh, const HittableList & list);
+
+    // Maps the structure stored at `path`, nullptr if the file is missing, corrupt or built for another scene
+    static std::shared_ptr<MappedBVH8> load(const std::string & path, const HittableList & list);
+
+    // Loads the cached structure of `list` from `directory`, builds and stores it first on a miss.
+    // Returns nullptr when the scene cannot be cached
+    static std::shared_ptr<MappedBVH8> load_or_build(
+        const std::string & directory,
+        const HittableList & list,
+        const BVH::Builder & builder = BVH::Builder::SAH,
+        const BVH8::Layout & layout = BVH8::Layout::Full);
+
+private:
+
+    static constexpr uint32_t version = 1;
+
+    static std::string path(const std::string & directory, const uint64_t & hash, const BVH8::Layout & layout);
+
+    static std::shared_ptr<MappedBVH8> load(const std::string & path, const HittableList & list, const uint64_t & hash);
+
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t layout;
+        uint64_t scene_hash;
+        uint64_t node_size;
+        uint64_t node_offset;
+        uint64_t node_count;
+        uint64_t sphere_offset;
+        uint64_t sphere_count;
+        uint64_t material_count;
+        double bounds[6];
+    };
+};
+
+
+#endif // BVH_CACHE_HPP
@@ -7,6 +7,7 @@
 
 
 #include <cmath>
+#include <random>
 
 
 class Camera {
@@ -19,12 +20,8 @@ public:
         const double & fov, // vertical field-of-view in degrees
         const double & aspect_ratio,
         const double & aperture,
-        const double & focus_dist,
-        const int & seed = 0
-    ) :
-        gen_(seed),
-        gaussian_(0, 1),
-        uniform_(0, 1)
+        const double & focus_dist
+    )
     {
         double theta = fov / 180.0 * 3.1415926;
         double h = std::tan(theta / 2);
@@ -40,14 +37,31 @@ public:
         vertical_ = focus_dist * viewport_height * v_;
         lower_left_corner_ = origin_ - horizontal_ / 2 - vertical_ / 2 - focus_dist * w_;
         lens_radius_ = aperture / 2;
+        shutter_open_ = 0;
+        shutter_close_ = 0;
     }
 
-    Ray get_ray(double s, double t) const
+    // Rays get times uniformly distributed over [open, close], with 0 and 1 being the
+    // positions of moving objects at the start and the end of the frame
+    void set_shutter(const double & open, const double & close)
     {
-        Vec2 rd = lens_radius_ * random_in_unit_disk();
+        shutter_open_ = open;
+        shutter_close_ = close;
+    }
+
+    // Lens and shutter samples come from the caller's generator, one per thread
+    Ray get_ray(double s, double t, std::minstd_rand & gen) const
+    {
+        std::uniform_real_distribution<double> uniform(0, 1);
+
+        Vec2 rd = lens_radius_ * random_in_unit_disk(gen);
         Vec3 offset = u_ * rd.x + v_ * rd.y;
 
-        return Ray(origin_ + offset, lower_left_corner_ + s * horizontal_ + t * vertical_ - origin_ - offset);
+        double time = shutter_open_;
+        if (shutter_close_ > shutter_open_)
+            time += (shutter_close_ - shutter_open_) * uniform(gen);
+
+        return Ray(origin_ + offset, lower_left_corner_ + s * horizontal_ + t * vertical_ - origin_ - offset, time);
 
     }
 
@@ -60,14 +74,14 @@ private:
     Vec3 vertical_;
     Vec3 u_, v_, w_;
     double lens_radius_;
+    double shutter_open_, shutter_close_;
 
-    mutable std::minstd_rand gen_;
-    mutable std::normal_distribution<double> gaussian_;
-    mutable std::uniform_real_distribution<double> uniform_;
+    static Vec2 random_in_unit_disk(std::minstd_rand & gen) {
+        std::normal_distribution<double> gaussian(0, 1);
+        std::uniform_real_distribution<double> uniform(0, 1);
 
-    Vec2 random_in_unit_disk() const {
-        Vec2 r(gaussian_(gen_), gaussian_(gen_));
-        return r / r.norm() * std::sqrt(uniform_(gen_));
+        Vec2 r(gaussian(gen), gaussian(gen));
+        return r / r.norm() * std::sqrt(uniform(gen));
     }
 };
 
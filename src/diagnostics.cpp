@@ -0,0 +1,34 @@
+#include "diagnostics.hpp"
+
+
+#include <iomanip>
+
+
+namespace {
+
+void print_histogram(std::ostream & out, const std::vector<size_t> & histogram)
+{
+    for (size_t i = 0; i < histogram.size(); ++i)
+        if (histogram[i] > 0)
+            out << "    " << std::setw(6) << i << "  " << histogram[i] << "\n";
+}
+
+} // namespace
+
+
+std::ostream & operator<< (std::ostream & out, const AcceleratorQuality & quality)
+{
+    out << std::fixed << std::setprecision(3)
+        << "SAH cost:      " << quality.sah_cost << "\n"
+        << "Overlap ratio: " << quality.overlap << "\n"
+        << "Nodes:         " << quality.node_count << "\n"
+        << "Leaves:        " << quality.leaf_count << "\n";
+
+    out << "Leaf depths:\n";
+    print_histogram(out, quality.depth_histogram);
+
+    out << "Leaf sizes:\n";
+    print_histogram(out, quality.leaf_size_histogram);
+
+    return out;
+}
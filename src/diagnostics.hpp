@@ -0,0 +1,47 @@
+#ifndef DIAGNOSTICS_HPP
+#define DIAGNOSTICS_HPP
+
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+
+// Work done by a single diagnostic traversal
+struct TraversalStats {
+    uint32_t nodes = 0;        // visited nodes
+    uint32_t primitives = 0;   // primitive intersection tests
+};
+
+
+// Work done by a refit of a BVH after objects moved
+struct RefitStats {
+    size_t subtrees = 0;        // independent subtrees below the top of the tree
+    size_t rebuilt = 0;         // subtrees rebuilt because their cost degraded
+    bool full_rebuild = false;  // the top degraded and the whole tree was built again
+};
+
+
+// Summary of a built acceleration structure, used to tell a poor structure from expensive shading
+struct AcceleratorQuality {
+    // Expected node visits plus primitive tests of a ray that hits the root box, estimated with
+    // the surface area heuristic
+    double sah_cost = 0;
+
+    // Summed surface area of the pairwise intersections of sibling boxes over their summed surface area,
+    // 0 for disjoint siblings
+    double overlap = 0;
+
+    size_t node_count = 0;
+    size_t leaf_count = 0;
+
+    std::vector<size_t> depth_histogram;       // number of leaves at every depth, the root is at depth 0
+    std::vector<size_t> leaf_size_histogram;   // number of leaves with every number of primitives
+};
+
+
+std::ostream & operator<< (std::ostream & out, const AcceleratorQuality & quality);
+
+
+#endif // DIAGNOSTICS_HPP
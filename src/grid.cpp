@@ -0,0 +1,360 @@
+#include "grid.hpp"
+#include "parallel.hpp"
+
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <limits>
+
+
+namespace {
+
+// Objects whose largest extent exceeds the median one this many times are traced outside the grid
+constexpr double large_object_ratio = 64;
+
+inline uint64_t mix(uint64_t key)
+{
+    key *= 0x9e3779b97f4a7c15ull;
+    return key ^ (key >> 32);
+}
+
+} // namespace
+
+
+Grid::Grid(const HittableList & list, const Storage & storage, const double & density) :
+    storage_(storage),
+    resolution_ { 0, 0, 0 }
+{
+    const auto & objects = list.objects();
+
+    std::vector<AABB> boxes(objects.size());
+    parallel_for(objects.size(), [&] (size_t i) { boxes[i] = objects[i] -> bounding_box(); });
+
+    auto largest_extent = [] (const AABB & box) {
+        Vec3 e = box.extent();
+        return std::max(e.x, std::max(e.y, e.z));
+    };
+
+    std::vector<double> extents;
+    extents.reserve(boxes.size());
+    for (const auto & box : boxes)
+        if (!box.empty())
+            extents.push_back(largest_extent(box));
+
+    double max_extent = std::numeric_limits<double>::infinity();
+    if (!extents.empty()) {
+        std::nth_element(extents.begin(), extents.begin() + extents.size() / 2, extents.end());
+        max_extent = large_object_ratio * extents[extents.size() / 2];
+    }
+
+    std::vector<AABB> grid_boxes;
+
+    for (size_t i = 0; i < objects.size(); ++i) {
+        total_box_.extend(boxes[i]);
+
+        if (!boxes[i].empty() && largest_extent(boxes[i]) <= max_extent) {
+            box_.extend(boxes[i]);
+            grid_boxes.push_back(boxes[i]);
+            objects_.push_back(objects[i]);
+        } else {
+            large_objects_.push_back(objects[i]);
+        }
+    }
+
+    if (objects_.empty())
+        return;
+
+    // Cubic cells of the size that gives `density` cells per object over the grid volume
+    Vec3 e = box_.extent();
+    double n_cells = density * objects_.size();
+    double volume = e.x * e.y * e.z;
+    double cell = volume > 0 ? std::cbrt(volume / n_cells) : std::max(e.x, std::max(e.y, e.z)) / std::cbrt(n_cells);
+
+    if (!(cell > 0))
+        cell = 1;
+
+    for (int i = 0; i < 3; ++i)
+        resolution_[i] = std::clamp(int(std::ceil(std::min(e[i] / cell, double(max_hashed_resolution)))), 1, max_hashed_resolution);
+
+    if (storage_ == Storage::Dense) {
+        double total = double(resolution_[0]) * resolution_[1] * resolution_[2];
+
+        if (total > max_dense_cells) {
+            double scale = std::cbrt(max_dense_cells / total);
+            for (int i = 0; i < 3; ++i)
+                resolution_[i] = std::max(1, int(resolution_[i] * scale));
+        }
+    }
+
+    for (int i = 0; i < 3; ++i) {
+        cell_size_[i] = e[i] > 0 ? e[i] / resolution_[i] : 1;
+        inv_cell_size_[i] = 1 / cell_size_[i];
+    }
+
+    // Inclusive cell range overlapped by a box
+    auto cell_bounds = [this] (const AABB & box, int lo[3], int hi[3]) {
+        for (int i = 0; i < 3; ++i) {
+            lo[i] = std::clamp(int(std::floor((box.min()[i] - box_.min()[i]) * inv_cell_size_[i])), 0, resolution_[i] - 1);
+            hi[i] = std::clamp(int(std::floor((box.max()[i] - box_.min()[i]) * inv_cell_size_[i])), 0, resolution_[i] - 1);
+        }
+    };
+
+    if (storage_ == Storage::Dense) {
+        size_t n = size_t(resolution_[0]) * resolution_[1] * resolution_[2];
+        cell_offsets_.assign(n + 1, 0);
+
+        auto for_each_cell = [&] (auto f) {
+            for (uint32_t k = 0; k < grid_boxes.size(); ++k) {
+                int lo[3], hi[3];
+                cell_bounds(grid_boxes[k], lo, hi);
+
+                for (int z = lo[2]; z <= hi[2]; ++z)
+                    for (int y = lo[1]; y <= hi[1]; ++y)
+                        for (int x = lo[0]; x <= hi[0]; ++x)
+                            f(x + size_t(resolution_[0]) * (y + size_t(resolution_[1]) * z), k);
+            }
+        };
+
+        // Count, prefix sum, then fill every cell from its start, which shifts the offsets by one cell
+        for_each_cell([this] (size_t cell, uint32_t) { ++cell_offsets_[cell + 1]; });
+
+        for (size_t i = 0; i < n; ++i)
+            cell_offsets_[i + 1] += cell_offsets_[i];
+
+        cell_objects_.resize(cell_offsets_[n]);
+
+        for_each_cell([this] (size_t cell, uint32_t k) { cell_objects_[cell_offsets_[cell]++] = k; });
+
+        std::copy_backward(cell_offsets_.begin(), cell_offsets_.end() - 1, cell_offsets_.end());
+        cell_offsets_[0] = 0;
+    } else {
+        std::vector<std::pair<uint64_t, uint32_t>> references;
+
+        for (uint32_t k = 0; k < grid_boxes.size(); ++k) {
+            int lo[3], hi[3];
+            cell_bounds(grid_boxes[k], lo, hi);
+
+            for (int z = lo[2]; z <= hi[2]; ++z)
+                for (int y = lo[1]; y <= hi[1]; ++y)
+                    for (int x = lo[0]; x <= hi[0]; ++x) {
+                        int c[3] = { x, y, z };
+                        references.push_back({ hash_key(c), k });
+                    }
+        }
+
+        std::sort(references.begin(), references.end());
+
+        size_t n_occupied = 0;
+        for (size_t i = 0; i < references.size(); ++i)
+            n_occupied += i == 0 || references[i].first != references[i - 1].first;
+
+        // At most half full so that probe sequences stay short
+        cell_table_.assign(std::bit_ceil(2 * n_occupied), { empty_key, 0, 0 });
+        cell_objects_.resize(references.size());
+
+        for (size_t i = 0; i < references.size(); ++i)
+            cell_objects_[i] = references[i].second;
+
+        for (size_t begin = 0, end; begin < references.size(); begin = end) {
+            uint64_t key = references[begin].first;
+
+            for (end = begin; end < references.size() && references[end].first == key; ++end);
+
+            size_t slot = mix(key) & (cell_table_.size() - 1);
+            while (cell_table_[slot].key != empty_key)
+                slot = (slot + 1) & (cell_table_.size() - 1);
+
+            cell_table_[slot] = { key, uint32_t(begin), uint32_t(end - begin) };
+        }
+    }
+}
+
+uint64_t Grid::hash_key(const int cell[3])
+{
+    return uint64_t(cell[0]) | uint64_t(cell[1]) << 21 | uint64_t(cell[2]) << 42;
+}
+
+void Grid::cell_range(const int cell[3], uint32_t & begin, uint32_t & count) const
+{
+    if (storage_ == Storage::Dense) {
+        size_t i = cell[0] + size_t(resolution_[0]) * (cell[1] + size_t(resolution_[1]) * cell[2]);
+        begin = cell_offsets_[i];
+        count = cell_offsets_[i + 1] - begin;
+        return;
+    }
+
+    uint64_t key = hash_key(cell);
+
+    for (size_t slot = mix(key) & (cell_table_.size() - 1);; slot = (slot + 1) & (cell_table_.size() - 1)) {
+        const HashEntry & entry = cell_table_[slot];
+
+        if (entry.key == key) {
+            begin = entry.begin;
+            count = entry.count;
+            return;
+        }
+
+        if (entry.key == empty_key) {
+            begin = count = 0;
+            return;
+        }
+    }
+}
+
+template<typename V>
+void Grid::walk(const Ray & r, double t_min, double t_max, V visit) const
+{
+    Point3 o = r.origin();
+    Vec3 d = r.direction();
+
+    // Clip the ray to the grid bounds
+    double t_enter = t_min;
+    double t_exit = t_max;
+
+    for (int i = 0; i < 3; ++i) {
+        if (d[i] == 0) {
+            if (o[i] < box_.min()[i] || o[i] > box_.max()[i])
+                return;
+            continue;
+        }
+
+        double t_0 = (box_.min()[i] - o[i]) / d[i];
+        double t_1 = (box_.max()[i] - o[i]) / d[i];
+
+        if (d[i] < 0)
+            std::swap(t_0, t_1);
+
+        t_enter = std::max(t_enter, t_0);
+        t_exit = std::min(t_exit, t_1);
+    }
+
+    if (t_enter > t_exit)
+        return;
+
+    // 3D-DDA setup: the current cell, the distance to its next boundary along every axis and
+    // the distance between consecutive boundaries
+    Point3 p = r(t_enter);
+
+    int cell[3], step[3], end[3];
+    double t_next[3], t_delta[3];
+
+    for (int i = 0; i < 3; ++i) {
+        cell[i] = std::clamp(int(std::floor((p[i] - box_.min()[i]) * inv_cell_size_[i])), 0, resolution_[i] - 1);
+
+        if (d[i] > 0) {
+            step[i] = 1;
+            end[i] = resolution_[i];
+            t_next[i] = (box_.min()[i] + (cell[i] + 1) * cell_size_[i] - o[i]) / d[i];
+            t_delta[i] = cell_size_[i] / d[i];
+        } else if (d[i] < 0) {
+            step[i] = -1;
+            end[i] = -1;
+            t_next[i] = (box_.min()[i] + cell[i] * cell_size_[i] - o[i]) / d[i];
+            t_delta[i] = -cell_size_[i] / d[i];
+        } else {
+            step[i] = 0;
+            end[i] = -1;
+            t_next[i] = std::numeric_limits<double>::infinity();
+            t_delta[i] = std::numeric_limits<double>::infinity();
+        }
+    }
+
+    while (true) {
+        int axis = t_next[0] < t_next[1] ?
+            (t_next[0] < t_next[2] ? 0 : 2) :
+            (t_next[1] < t_next[2] ? 1 : 2);
+
+        uint32_t begin, count;
+        cell_range(cell, begin, count);
+
+        if (!visit(begin, count, t_next[axis]) || t_next[axis] >= t_exit)
+            break;
+
+        cell[axis] += step[axis];
+        if (cell[axis] == end[axis])
+            break;
+
+        t_next[axis] += t_delta[axis];
+    }
+}
+
+std::optional<Hit> Grid::trace(const Ray & r, double t_min, double t_max) const
+{
+    std::optional<Hit> hit = std::nullopt;
+
+    for (const auto & object : large_objects_) {
+        if (auto hit_tmp = object -> trace(r, t_min, t_max)) {
+            t_max = hit_tmp -> solution;
+            hit = hit_tmp;
+        }
+    }
+
+    if (objects_.empty())
+        return hit;
+
+    walk(r, t_min, t_max, [&] (uint32_t begin, uint32_t count, double t_exit) {
+        for (uint32_t k = begin; k < begin + count; ++k) {
+            if (auto hit_tmp = objects_[cell_objects_[k]] -> trace(r, t_min, t_max)) {
+                t_max = hit_tmp -> solution;
+                hit = hit_tmp;
+            }
+        }
+
+        // Once the closest hit lies before the next cell no later cell can hold a closer one
+        return t_exit < t_max;
+    });
+
+    return hit;
+}
+
+bool Grid::occluded(const Ray & r, double t_min, double t_max) const
+{
+    for (const auto & object : large_objects_)
+        if (object -> occluded(r, t_min, t_max))
+            return true;
+
+    if (objects_.empty())
+        return false;
+
+    bool occluded = false;
+
+    walk(r, t_min, t_max, [&] (uint32_t begin, uint32_t count, double) {
+        for (uint32_t k = begin; k < begin + count && !occluded; ++k)
+            occluded = objects_[cell_objects_[k]] -> occluded(r, t_min, t_max);
+
+        return !occluded;
+    });
+
+    return occluded;
+}
+
+AABB Grid::bounding_box() const
+{
+    return total_box_;
+}
+
+std::array<int, 3> Grid::resolution() const
+{
+    return { resolution_[0], resolution_[1], resolution_[2] };
+}
+
+size_t Grid::occupied_cells() const
+{
+    if (storage_ == Storage::Hashed)
+        return std::count_if(cell_table_.begin(), cell_table_.end(), [] (const HashEntry & e) { return e.key != empty_key; });
+
+    size_t n = 0;
+    for (size_t i = 0; i + 1 < cell_offsets_.size(); ++i)
+        n += cell_offsets_[i + 1] > cell_offsets_[i];
+
+    return n;
+}
+
+size_t Grid::memory_usage() const
+{
+    return
+        cell_offsets_.size() * sizeof(uint32_t) +
+        cell_table_.size() * sizeof(HashEntry) +
+        cell_objects_.size() * sizeof(uint32_t);
+}
@@ -0,0 +1,86 @@
+#ifndef GRID_HPP
+#define GRID_HPP
+
+
+#include "aabb.hpp"
+#include "ray.hpp"
+#include "hittable.hpp"
+
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <vector>
+#include <memory>
+
+
+// Regular grid over the objects of a HittableList, traversed with a 3D-DDA in front to back order.
+// Suited to dense fields of similarly sized objects, where it needs no tree descent at all.
+// Objects much larger than the typical one (a ground sphere for instance) would make every cell
+// overlap them, they are kept out of the grid and traced separately
+class Grid : public Hittable {
+public:
+
+    enum class Storage {
+        Dense,  // object ranges of all cells, memory grows with the number of cells
+        Hashed  // open addressing table of the non-empty cells only, for large sparse extents
+    };
+
+    // The resolution is chosen so that there are about `density` cells per object
+    Grid(const HittableList & list, const Storage & storage = Storage::Dense, const double & density = 2.0);
+
+    virtual std::optional<Hit> trace(const Ray & r, double t_min, double t_max) const override;
+
+    virtual bool occluded(const Ray & r, double t_min, double t_max) const override;
+
+    virtual AABB bounding_box() const override;
+
+    std::array<int, 3> resolution() const;
+
+    // Number of cells that hold at least one object
+    size_t occupied_cells() const;
+
+    // Size of the cell and object reference arrays in bytes
+    size_t memory_usage() const;
+
+private:
+
+    // Cells are packed into hash keys with 21 bits per axis
+    static constexpr int max_hashed_resolution = (1 << 21) - 1;
+    static constexpr size_t max_dense_cells = size_t(1) << 26;
+
+    struct HashEntry {
+        uint64_t key;   // empty_key for unused slots
+        uint32_t begin;
+        uint32_t count;
+    };
+
+    static constexpr uint64_t empty_key = ~uint64_t(0);
+
+    static uint64_t hash_key(const int cell[3]);
+
+    // Range of cell_objects_ holding the objects of `cell`
+    void cell_range(const int cell[3], uint32_t & begin, uint32_t & count) const;
+
+    // Walks the cells pierced by the ray in front to back order, `visit(begin, count, t_exit)` receives
+    // the object range of a cell and the distance at which the ray leaves it and returns false to stop
+    template<typename V>
+    void walk(const Ray & r, double t_min, double t_max, V visit) const;
+
+    AABB box_;          // bounds of the objects in the grid
+    AABB total_box_;    // bounds including the large objects
+    Storage storage_;
+    int resolution_[3];
+    Vec3 cell_size_;
+    Vec3 inv_cell_size_;
+
+    std::vector<uint32_t> cell_offsets_;   // dense storage: prefix sums of the cell object counts
+    std::vector<HashEntry> cell_table_;    // hashed storage, power of two size
+    std::vector<uint32_t> cell_objects_;
+
+    std::vector<std::shared_ptr<Hittable>> objects_;
+    std::vector<std::shared_ptr<Hittable>> large_objects_;
+};
+
+
+#endif // GRID_HPP
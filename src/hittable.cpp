@@ -1,6 +1,32 @@
 #include "hittable.hpp"
 
 
+#include <algorithm>
+
+
+void Hittable::trace_batch(std::span<const Ray> rays, double t_min, double t_max, std::span<std::optional<Hit>> hits) const
+{
+    for (size_t k = 0; k < rays.size(); ++k)
+        if (auto hit = trace(rays[k], t_min, hits[k] ? hits[k] -> solution : t_max))
+            hits[k] = hit;
+}
+
+bool Hittable::occluded(const Ray & r, double t_min, double t_max) const
+{
+    return trace(r, t_min, t_max).has_value();
+}
+
+bool Hittable::moving() const
+{
+    return false;
+}
+
+AABB Hittable::bounding_box_at(const double &) const
+{
+    return bounding_box();
+}
+
+
 HittableList::HittableList(std::shared_ptr<Hittable> object)
 {
     add(object);
@@ -9,22 +35,28 @@ HittableList::HittableList(std::shared_ptr<Hittable> object)
 
 void HittableList::clear()
 {
-    objects.clear();
+    objects_.clear();
 }
 
 
 void HittableList::add(std::shared_ptr<Hittable> object)
 {
-    objects.push_back(object);
+    objects_.push_back(object);
 }
 
+const std::vector<std::shared_ptr<Hittable>> & HittableList::objects() const
+{
+    return objects_;
+}
+
+
 std::optional<Hit> HittableList::trace(const Ray & r, double t_min, double t_max) const
 {
     std::optional<Hit> hit = std::nullopt;
 
     auto closest_so_far = t_max;
     
-    for (const auto & object : objects) {
+    for (const auto & object : objects_) {
         if (auto hit_tmp = object -> trace(r, t_min, closest_so_far)) {
             closest_so_far = hit_tmp -> solution;
             hit = hit_tmp;
@@ -34,3 +66,47 @@ std::optional<Hit> HittableList::trace(const Ray & r, double t_min, double t_max
     return hit;
 }
 
+
+void HittableList::trace_batch(std::span<const Ray> rays, double t_min, double t_max, std::span<std::optional<Hit>> hits) const
+{
+    for (const auto & object : objects_)
+        object -> trace_batch(rays, t_min, t_max, hits);
+}
+
+
+bool HittableList::occluded(const Ray & r, double t_min, double t_max) const
+{
+    for (const auto & object : objects_)
+        if (object -> occluded(r, t_min, t_max))
+            return true;
+
+    return false;
+}
+
+
+AABB HittableList::bounding_box() const
+{
+    AABB box;
+
+    for (const auto & object : objects_)
+        box.extend(object -> bounding_box());
+
+    return box;
+}
+
+
+bool HittableList::moving() const
+{
+    return std::any_of(objects_.begin(), objects_.end(), [] (const auto & object) { return object -> moving(); });
+}
+
+
+AABB HittableList::bounding_box_at(const double & time) const
+{
+    AABB box;
+
+    for (const auto & object : objects_)
+        box.extend(object -> bounding_box_at(time));
+
+    return box;
+}
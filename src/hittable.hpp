@@ -4,11 +4,13 @@
 
 #include "vec.hpp"
 #include "ray.hpp"
+#include "aabb.hpp"
 #include "material.hpp"
 
 
 #include <tuple>
 #include <optional>
+#include <span>
 #include <vector>
 #include <memory>
 
@@ -31,6 +33,24 @@ public:
 
     virtual std::optional<Hit> trace(const Ray & r, double t_min, double t_max) const = 0;
 
+    // Closest hits of a batch of rays, a tile of primary rays for instance. A hit already present in `hits`
+    // bounds the search of its ray and is only replaced by a closer one, callers start from empty hits.
+    // The default traces the rays one at a time, overrides amortize the virtual dispatch over the batch
+    // or trace the rays together
+    virtual void trace_batch(std::span<const Ray> rays, double t_min, double t_max, std::span<std::optional<Hit>> hits) const;
+
+    // Whether anything is hit within [t_min, t_max], for shadow and visibility rays. Stops at the first
+    // intersection found and computes no hit attributes, the default falls back to trace
+    virtual bool occluded(const Ray & r, double t_min, double t_max) const;
+
+    // Bounds over the whole shutter interval
+    virtual AABB bounding_box() const = 0;
+
+    // Whether the object moves over the shutter interval and its bounds at a time in [0, 1],
+    // bounds of linearly moving objects at intermediate times are the interpolated end bounds
+    virtual bool moving() const;
+    virtual AABB bounding_box_at(const double & time) const;
+
     virtual ~Hittable() = default;
 };
 
@@ -45,10 +65,22 @@ public:
     
     void add(std::shared_ptr<Hittable> object);
 
+    const std::vector<std::shared_ptr<Hittable>> & objects() const;
+
     virtual std::optional<Hit> trace(const Ray & r, double t_min, double t_max) const override;
 
+    // Passes the whole batch to one object after the other
+    virtual void trace_batch(std::span<const Ray> rays, double t_min, double t_max, std::span<std::optional<Hit>> hits) const override;
+
+    virtual bool occluded(const Ray & r, double t_min, double t_max) const override;
+
+    virtual AABB bounding_box() const override;
+
+    virtual bool moving() const override;
+    virtual AABB bounding_box_at(const double & time) const override;
+
 private:
-    std::vector<std::shared_ptr<Hittable>> objects;
+    std::vector<std::shared_ptr<Hittable>> objects_;
 };
 
 
@@ -1,16 +1,9 @@
 #ifndef IMAGE_HPP
 #define IMAGE_HPP
 
-// STBI Configuration
-#define STBIR_DEFAULT_FILTER_UPSAMPLE STBIR_FILTER_TRIANGLE
-
-#define STB_IMAGE_IMPLEMENTATION
+// STBI implementation lives in image.cpp
 #include <stb_image.h>
-
-#define STB_IMAGE_WRITE_IMPLEMENTATION
 #include <stb_image_write.h>
-
-#define STB_IMAGE_RESIZE_IMPLEMENTATION
 #include <stb_image_resize.h>
 
 
@@ -35,7 +28,7 @@ public:
     Color<T, C> & operator() (const int & i, const int & j);
     Color<T, C> operator() (const int & i, const int & j) const;
 
-    std::tuple<int, int> size();
+    std::tuple<int, int> size() const;
 
     void resize(const int & width, const int & height);
     void fill(const Color<T, C> & color);
@@ -99,6 +92,25 @@ void Image<T, C>::flip_horizontally()
 template<typename T, int C>
 Image<T, C>::Image(const std::string & filename)
 {
+    // HDR files keep their linear values in float images, a file that fails to load gives an empty image
+    if constexpr (std::is_same<T, float>::value) {
+        if (stbi_is_hdr(filename.c_str())) {
+            float * raw_data = stbi_loadf(filename.c_str(), &width, &height, &channels, C);
+            channels = C;
+
+            if (raw_data)
+                data.assign(
+                    reinterpret_cast<Color<T, C> *>(raw_data),
+                    reinterpret_cast<Color<T, C> *>(raw_data) + width * height
+                );
+            else
+                width = height = 0;
+
+            stbi_image_free(raw_data);
+            return;
+        }
+    }
+
     uint8_t * raw_data = stbi_load(filename.c_str(), &width, &height, &channels, 0);
 
     if constexpr (std::is_floating_point<T>::value) {
@@ -140,7 +152,7 @@ Color<T, C> Image<T, C>::operator() (const int & i, const int & j) const
 }
 
 template<typename T, int C>
-std::tuple<int, int> Image<T, C>::size()
+std::tuple<int, int> Image<T, C>::size() const
 {
     return { width, height };
 }
@@ -0,0 +1,64 @@
+#include "instance.hpp"
+
+
+Instance::Instance(std::shared_ptr<Hittable> object, const Transform & transform) :
+    object_(object),
+    to_world_(transform),
+    to_object_(transform.inverse())
+{}
+
+std::optional<Hit> Instance::trace(const Ray & r, double t_min, double t_max) const
+{
+    // The direction is not renormalized so that ray parameters agree in both spaces
+    Ray r_object(to_object_.transform_point(r.origin()), to_object_.transform_vector(r.direction()), r.time());
+
+    auto hit = object_ -> trace(r_object, t_min, t_max);
+
+    if (hit) {
+        hit -> point = to_world_.transform_point(hit -> point);
+        hit -> normal = unit(to_object_.transform_transposed(hit -> normal));
+    }
+
+    return hit;
+}
+
+bool Instance::occluded(const Ray & r, double t_min, double t_max) const
+{
+    Ray r_object(to_object_.transform_point(r.origin()), to_object_.transform_vector(r.direction()), r.time());
+
+    return object_ -> occluded(r_object, t_min, t_max);
+}
+
+AABB Instance::bounding_box() const
+{
+    return to_world(object_ -> bounding_box());
+}
+
+bool Instance::moving() const
+{
+    return object_ -> moving();
+}
+
+AABB Instance::bounding_box_at(const double & time) const
+{
+    return to_world(object_ -> bounding_box_at(time));
+}
+
+AABB Instance::to_world(const AABB & object_box) const
+{
+    AABB box;
+
+    if (object_box.empty())
+        return box;
+
+    for (int i = 0; i < 8; ++i) {
+        Point3 corner(
+            i & 1 ? object_box.max().x : object_box.min().x,
+            i & 2 ? object_box.max().y : object_box.min().y,
+            i & 4 ? object_box.max().z : object_box.min().z);
+
+        box.extend(to_world_.transform_point(corner));
+    }
+
+    return box;
+}
@@ -0,0 +1,42 @@
+#ifndef INSTANCE_HPP
+#define INSTANCE_HPP
+
+
+#include "vec.hpp"
+#include "mat.hpp"
+#include "ray.hpp"
+#include "hittable.hpp"
+
+
+#include <optional>
+#include <memory>
+
+
+// Shared object placed in the scene through an affine transform. Typically the object is a
+// bottom-level BVH referenced by many instances, and instances are collected into a top-level BVH
+class Instance : public Hittable {
+public:
+
+    Instance(std::shared_ptr<Hittable> object, const Transform & transform);
+
+    virtual std::optional<Hit> trace(const Ray & r, double t_min, double t_max) const override;
+
+    virtual bool occluded(const Ray & r, double t_min, double t_max) const override;
+
+    virtual AABB bounding_box() const override;
+
+    virtual bool moving() const override;
+    virtual AABB bounding_box_at(const double & time) const override;
+
+private:
+
+    // World space bounds of an object space box
+    AABB to_world(const AABB & object_box) const;
+
+    std::shared_ptr<Hittable> object_;
+    Transform to_world_;
+    Transform to_object_;
+};
+
+
+#endif // INSTANCE_HPP
@@ -0,0 +1,299 @@
+#include "light.hpp"
+#include "sphere.hpp"
+#include "material.hpp"
+
+
+#include "parallel.hpp"
+
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numbers>
+
+
+SphereLight::SphereLight(const Point3 & center, const double & radius, const ColorRGB & radiance) :
+    center_(center),
+    radius_(radius),
+    radiance_(radiance)
+{}
+
+std::optional<LightSample> SphereLight::sample(const Point3 & p, const double & u_1, const double & u_2) const
+{
+    Vec3 to_center = center_ - p;
+    double d_squared = to_center.norm_squared();
+    double r_squared = radius_ * radius_;
+
+    if (d_squared <= r_squared)
+        return std::nullopt;
+
+    // 1 - cos(theta_max) without the cancellation for small and distant lights
+    double sin_squared = r_squared / d_squared;
+    double cos_max = std::sqrt(1 - sin_squared);
+    double cone = sin_squared / (1 + cos_max);
+
+    double cos_theta = 1 - u_1 * cone;
+    double sin_theta = std::sqrt(std::max(0.0, 1 - cos_theta * cos_theta));
+    double phi = 2 * std::numbers::pi * u_2;
+
+    Vec3 w = to_center / std::sqrt(d_squared);
+    Vec3 u = unit(cross(std::abs(w.x) > 0.9 ? Vec3(0, 1, 0) : Vec3(1, 0, 0), w));
+    Vec3 v = cross(w, u);
+
+    Vec3 direction = sin_theta * std::cos(phi) * u + sin_theta * std::sin(phi) * v + cos_theta * w;
+
+    // Nearest intersection, the discriminant is clamped for directions that graze the sphere
+    Vec3 oc = p - center_;
+    double b = dot(oc, direction);
+    double distance = -b - std::sqrt(std::max(0.0, b * b - d_squared + r_squared));
+
+    return LightSample { direction, distance, radiance_, 1 / (2 * std::numbers::pi * cone) };
+}
+
+double SphereLight::pdf(const Point3 & p, const Vec3 &) const
+{
+    double d_squared = (center_ - p).norm_squared();
+    double r_squared = radius_ * radius_;
+
+    if (d_squared <= r_squared)
+        return 0;
+
+    double sin_squared = r_squared / d_squared;
+    double cone = sin_squared / (1 + std::sqrt(1 - sin_squared));
+
+    return 1 / (2 * std::numbers::pi * cone);
+}
+
+LightBounds SphereLight::bounds() const
+{
+    Vec3 r(radius_, radius_, radius_);
+    double area = 4 * std::numbers::pi * radius_ * radius_;
+    double radiance = (radiance_.r + radiance_.g + radiance_.b) / 3;
+
+    // Points of the sphere emit over the hemisphere around their normal, normals cover all directions
+    return { AABB(center_ - r, center_ + r), std::numbers::pi * area * radiance, DirectionCone::entire_sphere(), 0 };
+}
+
+
+EnvironmentLight::EnvironmentLight(const Image<float, 3> & map, const float & scale)
+{
+    std::tie(width_, height_) = map.size();
+
+    radiance_.resize(width_ * height_);
+    columns_.resize(height_);
+
+    std::vector<double> row_weights(height_);
+
+    // Rows are independent, each one builds its table and sums its weights on its own
+    parallel_for(height_, [&] (size_t i) {
+        double sin_theta = std::sin(std::numbers::pi * (i + 0.5) / height_);
+        std::vector<double> weights(width_);
+
+        for (int j = 0; j < width_; ++j) {
+            ColorRGB c = scale * map(i, j);
+            radiance_[i * width_ + j] = c;
+            weights[j] = std::max(0.0, 0.2126 * c.r + 0.7152 * c.g + 0.0722 * c.b) * sin_theta;
+        }
+
+        columns_[i] = AliasTable(weights);
+        row_weights[i] = columns_[i].total();
+    }, 16);
+
+    rows_ = AliasTable(row_weights);
+}
+
+std::tuple<int, int> EnvironmentLight::pixel(const Vec3 & direction) const
+{
+    double theta = std::acos(std::clamp(direction.y, -1.0, 1.0));
+    double phi = std::atan2(direction.z, direction.x) + std::numbers::pi;
+
+    int i = std::min(height_ - 1, static_cast<int>(theta / std::numbers::pi * height_));
+    int j = std::min(width_ - 1, static_cast<int>(phi / (2 * std::numbers::pi) * width_));
+
+    return { i, j };
+}
+
+ColorRGB EnvironmentLight::radiance(const Vec3 & direction) const
+{
+    if (radiance_.empty())
+        return { 0, 0, 0 };
+
+    auto [i, j] = pixel(direction);
+    return radiance_[i * width_ + j];
+}
+
+std::optional<LightSample> EnvironmentLight::sample(const Point3 &, const double & u_1, const double & u_2) const
+{
+    auto row = rows_.sample(u_1);
+    if (!row)
+        return std::nullopt;
+
+    auto column = columns_[row -> index].sample(u_2);
+    if (!column)
+        return std::nullopt;
+
+    // Uniform position inside the pixel from the remapped numbers
+    double theta = std::numbers::pi * (row -> index + row -> u) / height_;
+    double phi = 2 * std::numbers::pi * (column -> index + column -> u) / width_ - std::numbers::pi;
+    double sin_theta = std::sin(theta);
+
+    if (sin_theta <= 0)
+        return std::nullopt;
+
+    Vec3 direction(sin_theta * std::cos(phi), std::cos(theta), sin_theta * std::sin(phi));
+
+    // The map covers 2 pi^2 sin(theta) steradians per unit area of the (phi, theta) rectangle
+    double pdf = row -> pmf * column -> pmf * width_ * height_ / (2 * std::numbers::pi * std::numbers::pi * sin_theta);
+
+    return LightSample {
+        direction,
+        std::numeric_limits<double>::infinity(),
+        radiance_[row -> index * width_ + column -> index],
+        pdf
+    };
+}
+
+double EnvironmentLight::pdf(const Point3 &, const Vec3 & direction) const
+{
+    if (radiance_.empty())
+        return 0;
+
+    double sin_theta = std::sqrt(std::max(0.0, 1 - direction.y * direction.y));
+    if (sin_theta <= 0)
+        return 0;
+
+    auto [i, j] = pixel(direction);
+
+    return rows_.pmf(i) * columns_[i].pmf(j) * width_ * height_ / (2 * std::numbers::pi * std::numbers::pi * sin_theta);
+}
+
+LightBounds EnvironmentLight::bounds() const
+{
+    return {};
+}
+
+
+LightList::LightList(
+    const HittableList & objects,
+    const Selection & selection,
+    std::shared_ptr<EnvironmentLight> environment) :
+
+    environment_(environment),
+    selection_(selection)
+{
+    for (const auto & object : objects.objects())
+        if (auto sphere = std::dynamic_pointer_cast<Sphere>(object))
+            if (auto light = std::dynamic_pointer_cast<DiffuseLight>(sphere -> material())) {
+                by_material_[light.get()].push_back(lights_.size());
+                lights_.push_back(std::make_shared<SphereLight>(sphere -> center(), sphere -> radius(), light -> emission()));
+            }
+
+    if (selection_ == Selection::BVH) {
+        std::vector<LightBounds> bounds;
+        for (const auto & light : lights_)
+            bounds.push_back(light -> bounds());
+
+        bvh_ = LightBVH(bounds);
+    }
+}
+
+size_t LightList::size() const
+{
+    return lights_.size() + (environment_ ? 1 : 0);
+}
+
+double LightList::environment_probability() const
+{
+    if (!environment_)
+        return 0;
+
+    return lights_.empty() ? 1 : 0.5;
+}
+
+std::optional<LightSample> LightList::sample(const Point3 & p, const Vec3 & n, const double & u, const double & u_1, const double & u_2) const
+{
+    double p_environment = environment_probability();
+
+    if (u < p_environment) {
+        auto s = environment_ -> sample(p, u_1, u_2);
+        if (s)
+            s -> pdf *= p_environment;
+
+        return s;
+    }
+
+    if (lights_.empty())
+        return std::nullopt;
+
+    // Remaining range of u rescaled to [0, 1)
+    double v = std::min((u - p_environment) / (1 - p_environment), std::nextafter(1.0, 0.0));
+
+    if (selection_ == Selection::BVH) {
+        auto choice = bvh_.sample(p, n, v);
+        if (!choice)
+            return std::nullopt;
+
+        auto s = lights_[choice -> light] -> sample(p, u_1, u_2);
+        if (s)
+            s -> pdf *= choice -> pmf * (1 - p_environment);
+
+        return s;
+    }
+
+    size_t i = std::min(lights_.size() - 1, static_cast<size_t>(v * lights_.size()));
+
+    auto s = lights_[i] -> sample(p, u_1, u_2);
+    if (s)
+        s -> pdf *= (1 - p_environment) / lights_.size();
+
+    return s;
+}
+
+double LightList::pdf(const Point3 & p, const Vec3 & n, const Hit & hit) const
+{
+    auto light = light_at(hit);
+    if (!light)
+        return 0;
+
+    uint32_t i = *light;
+
+    Vec3 direction = unit(hit.point - p);
+    double pmf = selection_ == Selection::BVH ? bvh_.pmf(p, n, i) : 1.0 / lights_.size();
+
+    return pmf > 0 ? (1 - environment_probability()) * pmf * lights_[i] -> pdf(p, direction) : 0;
+}
+
+double LightList::pdf(const Vec3 & direction) const
+{
+    return environment_ ? environment_probability() * environment_ -> pdf(Point3(0, 0, 0), direction) : 0;
+}
+
+const EnvironmentLight * LightList::environment() const
+{
+    return environment_.get();
+}
+
+bool LightList::contains(const Hit & hit) const
+{
+    return light_at(hit).has_value();
+}
+
+std::optional<uint32_t> LightList::light_at(const Hit & hit) const
+{
+    auto candidates = by_material_.find(hit.material.get());
+    if (candidates == by_material_.end())
+        return std::nullopt;
+
+    // Other emitters may share the material of a light, the hit must also lie within its bounds
+    for (uint32_t j : candidates -> second) {
+        AABB box = lights_[j] -> bounds().box;
+        Vec3 margin = 1e-4 * (box.extent() + Vec3(1, 1, 1));
+        Point3 lo = box.min() - margin, hi = box.max() + margin;
+        const Point3 & q = hit.point;
+
+        if (lo.x <= q.x && q.x <= hi.x && lo.y <= q.y && q.y <= hi.y && lo.z <= q.z && q.z <= hi.z)
+            return j;
+    }
+
+    return std::nullopt;
+}
@@ -0,0 +1,150 @@
+#ifndef LIGHT_HPP
+#define LIGHT_HPP
+
+
+#include "vec.hpp"
+#include "hittable.hpp"
+#include "light_bvh.hpp"
+#include "alias_table.hpp"
+#include "image.hpp"
+
+
+#include <memory>
+#include <optional>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+
+// Direction towards a point on a light, as seen from a shaded point
+struct LightSample {
+    Vec3 direction;     // unit direction from the shaded point
+    double distance;    // distance to the sampled point along the direction
+    ColorRGB radiance;  // radiance emitted towards the shaded point
+    double pdf;         // solid angle density of the direction
+};
+
+
+class Light {
+public:
+
+    // Direction towards the light from `p` for two uniform numbers in [0, 1),
+    // empty when the light cannot be seen from p
+    virtual std::optional<LightSample> sample(const Point3 & p, const double & u_1, const double & u_2) const = 0;
+
+    // Solid angle density with which sample picks `direction` from `p`, for a direction that hits the light
+    virtual double pdf(const Point3 & p, const Vec3 & direction) const = 0;
+
+    // Extent, emitted power and emission directions, used to select among many lights
+    virtual LightBounds bounds() const = 0;
+
+    virtual ~Light() = default;
+};
+
+
+// Sphere with a constant radiance, directions are sampled uniformly within the cone
+// the sphere subtends, so every sample hits it
+class SphereLight : public Light {
+public:
+
+    SphereLight(const Point3 & center, const double & radius, const ColorRGB & radiance);
+
+    virtual std::optional<LightSample> sample(const Point3 & p, const double & u_1, const double & u_2) const override;
+    virtual double pdf(const Point3 & p, const Vec3 & direction) const override;
+    virtual LightBounds bounds() const override;
+
+private:
+
+    Point3 center_;
+    double radius_;
+    ColorRGB radiance_;
+};
+
+
+// Radiance arriving from infinitely far away in every direction, given by an equirectangular map with
+// the +y axis at the top row. Directions are sampled by a row alias table over the map rows and one
+// alias table per row over its pixels, with pixel weights luminance times sin(theta), in O(1)
+class EnvironmentLight : public Light {
+public:
+
+    // Tables are built in parallel over the rows, `scale` multiplies the radiance of the map
+    EnvironmentLight(const Image<float, 3> & map, const float & scale = 1);
+
+    // Radiance arriving along the unit `direction`, towards the origin of the direction
+    ColorRGB radiance(const Vec3 & direction) const;
+
+    virtual std::optional<LightSample> sample(const Point3 & p, const double & u_1, const double & u_2) const override;
+    virtual double pdf(const Point3 & p, const Vec3 & direction) const override;
+
+    // Without bounds, the environment is sampled apart from the light BVH
+    virtual LightBounds bounds() const override;
+
+private:
+
+    // Pixel containing the unit direction
+    std::tuple<int, int> pixel(const Vec3 & direction) const;
+
+    int width_;
+    int height_;
+    std::vector<ColorRGB> radiance_;
+    AliasTable rows_;
+    std::vector<AliasTable> columns_;
+};
+
+
+// Emitters of a scene, spheres with a DiffuseLight material and an optional environment. Each sample
+// picks the environment or one of the lights with equal probability, one light is then picked either
+// uniformly or through a light BVH in proportion to the estimated contribution at the shaded point
+class LightList {
+public:
+
+    enum class Selection {
+        Uniform,
+        BVH
+    };
+
+    LightList() = default;
+    LightList(
+        const HittableList & objects,
+        const Selection & selection = Selection::BVH,
+        std::shared_ptr<EnvironmentLight> environment = nullptr);
+
+    size_t size() const;
+
+    // Sample of the light selected by `u` for the point `p` with normal `n`,
+    // the pdf includes the probability of the selection
+    std::optional<LightSample> sample(const Point3 & p, const Vec3 & n, const double & u, const double & u_1, const double & u_2) const;
+
+    // Density with which sample picks the direction from `p` with normal `n` towards `hit` on a light,
+    // including the probability of the selection. Zero when the hit is not on one of the lights
+    double pdf(const Point3 & p, const Vec3 & n, const Hit & hit) const;
+
+    // Density with which sample picks the environment along the unit `direction`
+    double pdf(const Vec3 & direction) const;
+
+    // Whether the hit is on one of the lights. Emitters that are not on the list are never sampled
+    bool contains(const Hit & hit) const;
+
+    // Environment that lights the scene in place of the sky, null when there is none
+    const EnvironmentLight * environment() const;
+
+private:
+
+    // Probability that a sample picks the environment
+    double environment_probability() const;
+
+    // Index of the light the hit is on, lights sharing a material are told apart by their bounds
+    std::optional<uint32_t> light_at(const Hit & hit) const;
+
+    std::vector<std::shared_ptr<Light>> lights_;
+    std::shared_ptr<EnvironmentLight> environment_;
+
+    // Lights by their material, which identifies the light at a hit
+    std::unordered_map<const Material *, std::vector<uint32_t>> by_material_;
+
+    Selection selection_ = Selection::BVH;
+    LightBVH bvh_;
+};
+
+
+#endif // LIGHT_HPP
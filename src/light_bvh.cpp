@@ -0,0 +1,310 @@
+#include "light_bvh.hpp"
+
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <numbers>
+#include <numeric>
+
+
+namespace {
+
+constexpr int n_buckets = 12;
+
+inline double safe_sqrt(double x)
+{
+    return std::sqrt(std::max(0.0, x));
+}
+
+inline double safe_acos(double x)
+{
+    return std::acos(std::clamp(x, -1.0, 1.0));
+}
+
+// cos(max(0, a - b)) and sin(max(0, a - b)) from the sines and cosines of a and b
+inline double cos_sub_clamped(double sin_a, double cos_a, double sin_b, double cos_b)
+{
+    return cos_a > cos_b ? 1 : cos_a * cos_b + sin_a * sin_b;
+}
+
+inline double sin_sub_clamped(double sin_a, double cos_a, double sin_b, double cos_b)
+{
+    return cos_a > cos_b ? 0 : sin_a * cos_b - cos_a * sin_b;
+}
+
+// Rotation of v by `theta` around the unit axis k
+inline Vec3 rotate(const Vec3 & v, const Vec3 & k, double theta)
+{
+    double c = std::cos(theta), s = std::sin(theta);
+    return c * v + s * cross(k, v) + (1 - c) * dot(k, v) * k;
+}
+
+// Surface area orientation heuristic (Conty Estevez and Kulla 2018) of a group of lights, `axis`
+// penalizes groups that are thin along the split axis
+double cost(const LightBounds & b, const AABB & parent, int axis)
+{
+    double theta_o = safe_acos(b.normals.cos_theta);
+    double theta_e = safe_acos(b.cos_theta_e);
+    double theta_w = std::min(theta_o + theta_e, std::numbers::pi);
+    double sin_o = safe_sqrt(1 - b.normals.cos_theta * b.normals.cos_theta);
+
+    double m_omega = 2 * std::numbers::pi * (1 - b.normals.cos_theta) +
+        std::numbers::pi / 2 * (2 * theta_w * sin_o - std::cos(theta_o - 2 * theta_w) - 2 * theta_o * sin_o + b.normals.cos_theta);
+
+    Vec3 e = parent.extent();
+    double k_r = std::max(e.x, std::max(e.y, e.z)) / e[axis];
+
+    return b.power * m_omega * k_r * b.box.surface_area();
+}
+
+} // namespace
+
+
+DirectionCone DirectionCone::entire_sphere()
+{
+    return { Vec3(0, 0, 1), -1, false };
+}
+
+DirectionCone DirectionCone::merge(const DirectionCone & a, const DirectionCone & b)
+{
+    if (a.empty)
+        return b;
+    if (b.empty)
+        return a;
+    if (a.cos_theta == -1 || b.cos_theta == -1)
+        return entire_sphere();
+
+    double theta_a = safe_acos(a.cos_theta);
+    double theta_b = safe_acos(b.cos_theta);
+    double theta_d = safe_acos(dot(a.w, b.w));
+
+    // One cone contains the other
+    if (std::min(theta_d + theta_b, std::numbers::pi) <= theta_a)
+        return a;
+    if (std::min(theta_d + theta_a, std::numbers::pi) <= theta_b)
+        return b;
+
+    double theta_o = (theta_a + theta_d + theta_b) / 2;
+    if (theta_o >= std::numbers::pi)
+        return entire_sphere();
+
+    // Rotate the axis of a towards b until the cone reaches the far side of b
+    Vec3 axis = cross(a.w, b.w);
+    if (axis.norm_squared() == 0)
+        return entire_sphere();
+
+    return { rotate(a.w, unit(axis), theta_o - theta_a), std::cos(theta_o), false };
+}
+
+
+LightBounds LightBounds::merge(const LightBounds & a, const LightBounds & b)
+{
+    if (a.power == 0)
+        return b;
+    if (b.power == 0)
+        return a;
+
+    LightBounds m;
+    m.box = a.box;
+    m.box.extend(b.box);
+    m.power = a.power + b.power;
+    m.normals = DirectionCone::merge(a.normals, b.normals);
+    m.cos_theta_e = std::min(a.cos_theta_e, b.cos_theta_e);
+
+    return m;
+}
+
+double LightBounds::importance(const Point3 & p, const Vec3 & n) const
+{
+    Point3 center = box.center();
+    Vec3 to_point = p - center;
+
+    // Points inside or close to the bounds are treated as being at half the box diagonal
+    double d_squared = std::max(to_point.norm_squared(), box.extent().norm() / 2);
+    Vec3 w_i = unit(to_point);
+
+    double cos_w = dot(normals.w, w_i);
+    double sin_w = safe_sqrt(1 - cos_w * cos_w);
+
+    // Half angle of the cone that the sphere around the box subtends from p
+    double r_squared = (box.max() - center).norm_squared();
+    double cos_b = to_point.norm_squared() < r_squared ? -1 : safe_sqrt(1 - r_squared / to_point.norm_squared());
+    double sin_b = safe_sqrt(1 - cos_b * cos_b);
+
+    // Smallest angle between p and a normal in the cone, over the points of the box
+    double cos_o = normals.cos_theta;
+    double sin_o = safe_sqrt(1 - cos_o * cos_o);
+    double cos_x = cos_sub_clamped(sin_w, cos_w, sin_o, cos_o);
+    double sin_x = sin_sub_clamped(sin_w, cos_w, sin_o, cos_o);
+    double cos_p = cos_sub_clamped(sin_x, cos_x, sin_b, cos_b);
+
+    if (cos_p <= cos_theta_e)
+        return 0;
+
+    // Largest cosine between n and a direction towards the box, the shaded surface is one-sided
+    double cos_i = dot(n, -w_i);
+    double sin_i = safe_sqrt(1 - cos_i * cos_i);
+    double cos_i_p = cos_sub_clamped(sin_i, cos_i, sin_b, cos_b);
+
+    return std::max(0.0, power * cos_p * cos_i_p / d_squared);
+}
+
+
+LightBVH::LightBVH(const std::vector<LightBounds> & lights)
+{
+    std::vector<Entry> entries;
+    for (uint32_t i = 0; i < lights.size(); ++i)
+        if (lights[i].power > 0)
+            entries.emplace_back(lights[i], i);
+
+    if (entries.empty())
+        return;
+
+    nodes_.reserve(2 * entries.size() - 1);
+    leaves_.assign(lights.size(), no_leaf);
+    build(entries.data(), entries.size(), 0);
+}
+
+uint32_t LightBVH::build(Entry * lights, uint32_t n, uint32_t parent)
+{
+    uint32_t node_id = nodes_.size();
+    nodes_.push_back({});
+
+    if (n == 1) {
+        nodes_[node_id] = { lights[0].first, lights[0].second, parent, true };
+        leaves_[lights[0].second] = node_id;
+        return node_id;
+    }
+
+    LightBounds bounds;
+    AABB centroid_box;
+    for (uint32_t i = 0; i < n; ++i) {
+        bounds = LightBounds::merge(bounds, lights[i].first);
+        centroid_box.extend(lights[i].first.box.center());
+    }
+
+    // Cheapest bucketed split over all three axes
+    double best_cost = std::numeric_limits<double>::infinity();
+    int best_axis = -1, best_bucket = 0;
+
+    Point3 c_min = centroid_box.min();
+    Vec3 scale = Vec3(n_buckets, n_buckets, n_buckets) / centroid_box.extent();
+
+    auto bucket = [&] (const LightBounds & b, int axis) {
+        int i = static_cast<int>(((b.box.min()[axis] + b.box.max()[axis]) / 2 - c_min[axis]) * scale[axis]);
+        return std::clamp(i, 0, n_buckets - 1);
+    };
+
+    for (int axis = 0; axis < 3; ++axis) {
+        if (centroid_box.max()[axis] == centroid_box.min()[axis])
+            continue;
+
+        std::array<LightBounds, n_buckets> buckets;
+        for (uint32_t i = 0; i < n; ++i) {
+            auto & b = buckets[bucket(lights[i].first, axis)];
+            b = LightBounds::merge(b, lights[i].first);
+        }
+
+        std::array<double, n_buckets - 1> costs {};
+
+        LightBounds below;
+        for (int i = 0; i < n_buckets - 1; ++i) {
+            below = LightBounds::merge(below, buckets[i]);
+            costs[i] += cost(below, bounds.box, axis);
+        }
+
+        LightBounds above;
+        for (int i = n_buckets - 1; i > 0; --i) {
+            above = LightBounds::merge(above, buckets[i]);
+            costs[i - 1] += cost(above, bounds.box, axis);
+        }
+
+        for (int i = 0; i < n_buckets - 1; ++i)
+            if (costs[i] > 0 && costs[i] < best_cost) {
+                best_cost = costs[i];
+                best_axis = axis;
+                best_bucket = i;
+            }
+    }
+
+    uint32_t mid = n / 2;
+
+    if (best_axis >= 0) {
+        Entry * m = std::partition(lights, lights + n, [&] (const Entry & e) { return bucket(e.first, best_axis) <= best_bucket; });
+        if (m != lights && m != lights + n)
+            mid = m - lights;
+    }
+
+    // Coincident centroids or a degenerate split fall back to halving the range
+    build(lights, mid, node_id);
+    uint32_t second = build(lights + mid, n - mid, node_id);
+
+    nodes_[node_id] = { bounds, second, parent, false };
+
+    return node_id;
+}
+
+std::optional<LightBVH::Sample> LightBVH::sample(const Point3 & p, const Vec3 & n, double u) const
+{
+    if (nodes_.empty() || nodes_[0].bounds.importance(p, n) == 0)
+        return std::nullopt;
+
+    uint32_t node_id = 0;
+    double pmf = 1;
+
+    while (!nodes_[node_id].leaf) {
+        uint32_t first = node_id + 1, second = nodes_[node_id].index;
+
+        double i_first = nodes_[first].bounds.importance(p, n);
+        double i_second = nodes_[second].bounds.importance(p, n);
+
+        if (i_first == 0 && i_second == 0)
+            return std::nullopt;
+
+        // Reuse u for the next choice after rescaling it to [0, 1)
+        double p_first = i_first / (i_first + i_second);
+
+        if (u < p_first) {
+            u = std::min(u / p_first, std::nextafter(1.0, 0.0));
+            pmf *= p_first;
+            node_id = first;
+        } else {
+            u = std::min((u - p_first) / (1 - p_first), std::nextafter(1.0, 0.0));
+            pmf *= 1 - p_first;
+            node_id = second;
+        }
+    }
+
+    return Sample { nodes_[node_id].index, pmf };
+}
+
+double LightBVH::pmf(const Point3 & p, const Vec3 & n, const uint32_t & light) const
+{
+    if (light >= leaves_.size() || leaves_[light] == no_leaf || nodes_[0].bounds.importance(p, n) == 0)
+        return 0;
+
+    // Product of the choices along the path from the leaf up to the root
+    double pmf = 1;
+
+    for (uint32_t node_id = leaves_[light]; node_id != 0; node_id = nodes_[node_id].parent) {
+        uint32_t parent = nodes_[node_id].parent;
+        uint32_t sibling = node_id == parent + 1 ? nodes_[parent].index : parent + 1;
+
+        double i_node = nodes_[node_id].bounds.importance(p, n);
+        double i_sibling = nodes_[sibling].bounds.importance(p, n);
+
+        if (i_node == 0)
+            return 0;
+
+        pmf *= i_node / (i_node + i_sibling);
+    }
+
+    return pmf;
+}
+
+size_t LightBVH::node_count() const
+{
+    return nodes_.size();
+}
@@ -0,0 +1,89 @@
+#ifndef LIGHT_BVH_HPP
+#define LIGHT_BVH_HPP
+
+
+#include "vec.hpp"
+#include "aabb.hpp"
+
+
+#include <cstdint>
+#include <optional>
+#include <utility>
+#include <vector>
+
+
+// Directions within `theta` = acos(cos_theta) of the axis `w`
+struct DirectionCone {
+    Vec3 w = Vec3(0, 0, 1);
+    double cos_theta = 1;
+    bool empty = true;
+
+    static DirectionCone entire_sphere();
+
+    // Smallest cone around both, approximately
+    static DirectionCone merge(const DirectionCone & a, const DirectionCone & b);
+};
+
+
+// Spatial and directional bounds of the emission of one light or a group of lights. Surface normals
+// lie in `normals`, and emission leaves a surface within acos(cos_theta_e) of its normal
+struct LightBounds {
+    AABB box;
+    double power = 0;
+    DirectionCone normals;
+    double cos_theta_e = 1;
+
+    static LightBounds merge(const LightBounds & a, const LightBounds & b);
+
+    // Conservative estimate of the light reaching a point with normal `n` from within the bounds,
+    // zero only when nothing in the bounds can reach it
+    double importance(const Point3 & p, const Vec3 & n) const;
+};
+
+
+// Binary hierarchy over light bounds (Conty Estevez and Kulla 2018). Sampling walks from the root to
+// a leaf choosing each child in proportion to its importance at the shading point, so lights are picked
+// roughly by their contribution at O(log n) cost regardless of the number of lights
+class LightBVH {
+public:
+
+    struct Sample {
+        uint32_t light;  // index into the bounds the hierarchy was built from
+        double pmf;      // probability of the choice
+    };
+
+    LightBVH() = default;
+    LightBVH(const std::vector<LightBounds> & lights);
+
+    // Light chosen with the uniform number `u` for the point `p` with normal `n`,
+    // empty when no light can reach the point
+    std::optional<Sample> sample(const Point3 & p, const Vec3 & n, double u) const;
+
+    // Probability that sample picks `light` for the point `p` with normal `n`
+    double pmf(const Point3 & p, const Vec3 & n, const uint32_t & light) const;
+
+    size_t node_count() const;
+
+private:
+
+    struct Node {
+        LightBounds bounds;
+        uint32_t index;  // interior: second child, the first one follows the node; leaf: light index
+        uint32_t parent;
+        bool leaf;
+    };
+
+    // Bounds of a light and its index, partitioned in place during the build
+    using Entry = std::pair<LightBounds, uint32_t>;
+
+    // Emits the subtree over `n` lights depth-first and returns the index of its root
+    uint32_t build(Entry * lights, uint32_t n, uint32_t parent);
+
+    std::vector<Node> nodes_;
+    std::vector<uint32_t> leaves_;  // leaf of every light, `no_leaf` for lights without power
+
+    static constexpr uint32_t no_leaf = ~uint32_t(0);
+};
+
+
+#endif // LIGHT_BVH_HPP
@@ -0,0 +1,167 @@
+#ifndef MAT_HPP
+#define MAT_HPP
+
+
+#include "vec.hpp"
+
+
+#include <cmath>
+
+
+// Affine transform stored as the upper 3x4 part of a 4x4 matrix: x' = A x + b,
+// where A is the left 3x3 block and b is the last column
+
+template<typename T>
+struct Mat3x4
+{
+    T m[3][4];
+
+    static Mat3x4<T> identity();
+    static Mat3x4<T> translation(const Vec<T, 3> & t);
+    static Mat3x4<T> scaling(const Vec<T, 3> & s);
+    static Mat3x4<T> rotation(const Vec<T, 3> & axis, const T & angle); // angle in radians
+
+    // Composition, (A * B) applies B first
+    Mat3x4<T> operator* (const Mat3x4<T> & a) const;
+
+    Vec<T, 3> transform_point(const Vec<T, 3> & p) const;
+    Vec<T, 3> transform_vector(const Vec<T, 3> & v) const;
+
+    // Multiplies by the transposed linear part, with the inverse transform this maps normals
+    Vec<T, 3> transform_transposed(const Vec<T, 3> & v) const;
+
+    Mat3x4<T> inverse() const;
+};
+
+
+using Transform = Mat3x4<double>;
+
+
+// Definition
+
+template<typename T>
+inline Mat3x4<T> Mat3x4<T>::identity()
+{
+    return {{
+        { 1, 0, 0, 0 },
+        { 0, 1, 0, 0 },
+        { 0, 0, 1, 0 }
+    }};
+}
+
+template<typename T>
+inline Mat3x4<T> Mat3x4<T>::translation(const Vec<T, 3> & t)
+{
+    return {{
+        { 1, 0, 0, t.x },
+        { 0, 1, 0, t.y },
+        { 0, 0, 1, t.z }
+    }};
+}
+
+template<typename T>
+inline Mat3x4<T> Mat3x4<T>::scaling(const Vec<T, 3> & s)
+{
+    return {{
+        { s.x, 0, 0, 0 },
+        { 0, s.y, 0, 0 },
+        { 0, 0, s.z, 0 }
+    }};
+}
+
+template<typename T>
+inline Mat3x4<T> Mat3x4<T>::rotation(const Vec<T, 3> & axis, const T & angle)
+{
+    // Rodrigues' rotation formula
+    Vec<T, 3> a = unit(axis);
+    T c = std::cos(angle);
+    T s = std::sin(angle);
+    T t = 1 - c;
+
+    return {{
+        { t * a.x * a.x + c,       t * a.x * a.y - s * a.z, t * a.x * a.z + s * a.y, 0 },
+        { t * a.x * a.y + s * a.z, t * a.y * a.y + c,       t * a.y * a.z - s * a.x, 0 },
+        { t * a.x * a.z - s * a.y, t * a.y * a.z + s * a.x, t * a.z * a.z + c,       0 }
+    }};
+}
+
+template<typename T>
+inline Mat3x4<T> Mat3x4<T>::operator* (const Mat3x4<T> & a) const
+{
+    Mat3x4<T> r;
+
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 4; ++j) {
+            r.m[i][j] = m[i][0] * a.m[0][j] + m[i][1] * a.m[1][j] + m[i][2] * a.m[2][j];
+
+            if (j == 3)
+                r.m[i][j] += m[i][3];
+        }
+    }
+
+    return r;
+}
+
+template<typename T>
+inline Vec<T, 3> Mat3x4<T>::transform_point(const Vec<T, 3> & p) const
+{
+    return {
+        m[0][0] * p.x + m[0][1] * p.y + m[0][2] * p.z + m[0][3],
+        m[1][0] * p.x + m[1][1] * p.y + m[1][2] * p.z + m[1][3],
+        m[2][0] * p.x + m[2][1] * p.y + m[2][2] * p.z + m[2][3]
+    };
+}
+
+template<typename T>
+inline Vec<T, 3> Mat3x4<T>::transform_vector(const Vec<T, 3> & v) const
+{
+    return {
+        m[0][0] * v.x + m[0][1] * v.y + m[0][2] * v.z,
+        m[1][0] * v.x + m[1][1] * v.y + m[1][2] * v.z,
+        m[2][0] * v.x + m[2][1] * v.y + m[2][2] * v.z
+    };
+}
+
+template<typename T>
+inline Vec<T, 3> Mat3x4<T>::transform_transposed(const Vec<T, 3> & v) const
+{
+    return {
+        m[0][0] * v.x + m[1][0] * v.y + m[2][0] * v.z,
+        m[0][1] * v.x + m[1][1] * v.y + m[2][1] * v.z,
+        m[0][2] * v.x + m[1][2] * v.y + m[2][2] * v.z
+    };
+}
+
+template<typename T>
+inline Mat3x4<T> Mat3x4<T>::inverse() const
+{
+    // Inverse of the linear part by cofactors, the translation is then -A^{-1} b
+    T c00 = m[1][1] * m[2][2] - m[1][2] * m[2][1];
+    T c01 = m[1][2] * m[2][0] - m[1][0] * m[2][2];
+    T c02 = m[1][0] * m[2][1] - m[1][1] * m[2][0];
+
+    T det = m[0][0] * c00 + m[0][1] * c01 + m[0][2] * c02;
+    T inv_det = 1 / det;
+
+    Mat3x4<T> r;
+
+    r.m[0][0] = c00 * inv_det;
+    r.m[0][1] = (m[0][2] * m[2][1] - m[0][1] * m[2][2]) * inv_det;
+    r.m[0][2] = (m[0][1] * m[1][2] - m[0][2] * m[1][1]) * inv_det;
+
+    r.m[1][0] = c01 * inv_det;
+    r.m[1][1] = (m[0][0] * m[2][2] - m[0][2] * m[2][0]) * inv_det;
+    r.m[1][2] = (m[0][2] * m[1][0] - m[0][0] * m[1][2]) * inv_det;
+
+    r.m[2][0] = c02 * inv_det;
+    r.m[2][1] = (m[0][1] * m[2][0] - m[0][0] * m[2][1]) * inv_det;
+    r.m[2][2] = (m[0][0] * m[1][1] - m[0][1] * m[1][0]) * inv_det;
+
+    for (int i = 0; i < 3; ++i)
+        r.m[i][3] = -(r.m[i][0] * m[0][3] + r.m[i][1] * m[1][3] + r.m[i][2] * m[2][3]);
+
+    return r;
+}
+
+
+#endif // MAT_HPP
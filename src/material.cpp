@@ -1,6 +1,35 @@
 #include "material.hpp"
 
 
+#include <numbers>
+
+
+ColorRGB Material::emitted(const Hit &) const
+{
+    return { 0, 0, 0 };
+}
+
+bool Material::specular() const
+{
+    return true;
+}
+
+bool Material::diffuse() const
+{
+    return false;
+}
+
+ColorRGB Material::evaluate(const Ray &, const Hit &, const Vec3 &) const
+{
+    return { 0, 0, 0 };
+}
+
+double Material::pdf(const Ray &, const Hit &, const Vec3 &) const
+{
+    return 0;
+}
+
+
 Lambertian::Lambertian(const ColorRGB & albedo, const unsigned int & seed) :
     albedo_(albedo),
     gen_(seed),
@@ -14,7 +43,28 @@ std::optional<std::tuple<ColorRGB, Ray>> Lambertian::scatter(const Ray & r, cons
     if (scatter_direction.near_zero())
         scatter_direction = hit.normal;
 
-    return std::tuple { albedo_, Ray(hit.point, scatter_direction) };
+    return std::tuple { albedo_, Ray(hit.point, scatter_direction, r.time()) };
+}
+
+bool Lambertian::specular() const
+{
+    return false;
+}
+
+bool Lambertian::diffuse() const
+{
+    return true;
+}
+
+ColorRGB Lambertian::evaluate(const Ray & r, const Hit & hit, const Vec3 & direction) const
+{
+    return albedo_ * float(pdf(r, hit, direction));
+}
+
+double Lambertian::pdf(const Ray &, const Hit & hit, const Vec3 & direction) const
+{
+    // The normal plus a uniform unit vector is cosine distributed
+    return std::max(0.0, dot(hit.normal, direction)) / std::numbers::pi;
 }
 
 
@@ -28,7 +78,7 @@ Metal::Metal(const ColorRGB & albedo, const double & fuzz, const unsigned int &
 std::optional<std::tuple<ColorRGB, Ray>> Metal::scatter(const Ray & r, const Hit & hit) const 
 {
     Vec3 reflected = unit(r.direction()).reflect(hit.normal);
-    Ray scattered = Ray(hit.point, reflected + fuzz_ * random_unit());
+    Ray scattered = Ray(hit.point, reflected + fuzz_ * random_unit(), r.time());
     ColorRGB attenuation = albedo_;
 
     if (dot(scattered.direction(), hit.normal) > 0)
@@ -37,6 +87,36 @@ std::optional<std::tuple<ColorRGB, Ray>> Metal::scatter(const Ray & r, const Hit
         return std::nullopt;
 }
 
+bool Metal::specular() const
+{
+    return fuzz_ == 0;
+}
+
+ColorRGB Metal::evaluate(const Ray & r, const Hit & hit, const Vec3 & direction) const
+{
+    return albedo_ * float(pdf(r, hit, direction));
+}
+
+double Metal::pdf(const Ray & r, const Hit & hit, const Vec3 & direction) const
+{
+    if (fuzz_ == 0 || dot(direction, hit.normal) <= 0)
+        return 0;
+
+    // Scattered directions point at a uniform point on the sphere of radius fuzz around the mirror
+    // direction. A direction crosses that sphere at distances t = b -+ s, each crossing contributes
+    // the area density 1 / (4 pi fuzz^2) times t^2 / cos, where cos = s / fuzz
+    Vec3 reflected = unit(r.direction()).reflect(hit.normal);
+    double b = dot(direction, reflected);
+    double s_squared = b * b - 1 + fuzz_ * fuzz_;
+
+    if (b <= 0 || s_squared <= 0)
+        return 0;
+
+    double s = std::sqrt(s_squared);
+
+    return (b * b + s_squared) / (2 * std::numbers::pi * fuzz_ * s);
+}
+
 
 Dielectric::Dielectric(const double & ir, const unsigned int & seed) :
     ir_(ir),
@@ -60,7 +140,7 @@ std::optional<std::tuple<ColorRGB, Ray>> Dielectric::scatter(const Ray & r, cons
     else
         direction = refract(unit_direction, hit.normal, refraction_ratio);
 
-    Ray scattered(hit.point, direction);
+    Ray scattered(hit.point, direction, r.time());
     
     return std::tuple { attenuation, scattered };
 }
@@ -82,3 +162,23 @@ double Dielectric::reflectance(const double & cosine, const double & ref_idx)
     r0 = r0 * r0;
     return r0 + (1 - r0) * std::pow((1 - cosine), 5);
 }
+
+
+DiffuseLight::DiffuseLight(const ColorRGB & emission) :
+    emission_(emission)
+{}
+
+std::optional<std::tuple<ColorRGB, Ray>> DiffuseLight::scatter(const Ray &, const Hit &) const
+{
+    return std::nullopt;
+}
+
+ColorRGB DiffuseLight::emitted(const Hit & hit) const
+{
+    return hit.front_face ? emission_ : ColorRGB(0, 0, 0);
+}
+
+ColorRGB DiffuseLight::emission() const
+{
+    return emission_;
+}
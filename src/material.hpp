@@ -19,6 +19,24 @@ public:
     // Returns attenuation color and scattered ray
     virtual std::optional<std::tuple<ColorRGB, Ray>> scatter(const Ray & r, const Hit & hit) const = 0;
 
+    // Radiance emitted from the hit point back along the ray, none by default
+    virtual ColorRGB emitted(const Hit & hit) const;
+
+    // Whether scattering is concentrated in single directions that evaluate and pdf do not describe,
+    // lights are sampled explicitly only at hits on other materials. True by default
+    virtual bool specular() const;
+
+    // Whether the surface reflects light equally in all directions, so that what it reflects depends
+    // on the position only and can be cached (see RenderSettings::radiance_cache). False by default
+    virtual bool diffuse() const;
+
+    // BRDF times the cosine between the normal and `direction`, the unit direction towards the light
+    virtual ColorRGB evaluate(const Ray & r, const Hit & hit, const Vec3 & direction) const;
+
+    // Solid angle density with which scatter picks the unit `direction`, so that evaluate / pdf is the
+    // attenuation scatter returns
+    virtual double pdf(const Ray & r, const Hit & hit, const Vec3 & direction) const;
+
     virtual ~Material() = default;
 };
 
@@ -29,6 +47,11 @@ public:
 
     virtual std::optional<std::tuple<ColorRGB, Ray>> scatter(const Ray & r, const Hit & hit) const override;
 
+    virtual bool specular() const override;
+    virtual bool diffuse() const override;
+    virtual ColorRGB evaluate(const Ray & r, const Hit & hit, const Vec3 & direction) const override;
+    virtual double pdf(const Ray & r, const Hit & hit, const Vec3 & direction) const override;
+
 private:
 
     ColorRGB albedo_;
@@ -49,6 +72,11 @@ public:
 
     virtual std::optional<std::tuple<ColorRGB, Ray>> scatter(const Ray & r, const Hit & hit) const override;
 
+    // Only a mirror without fuzz is specular
+    virtual bool specular() const override;
+    virtual ColorRGB evaluate(const Ray & r, const Hit & hit, const Vec3 & direction) const override;
+    virtual double pdf(const Ray & r, const Hit & hit, const Vec3 & direction) const override;
+
 private:
 
     ColorRGB albedo_;
@@ -83,4 +111,22 @@ private:
 };
 
 
+// Emitter, front faces emit `emission` and nothing is scattered
+class DiffuseLight : public Material {
+public:
+
+    DiffuseLight(const ColorRGB & emission);
+
+    virtual std::optional<std::tuple<ColorRGB, Ray>> scatter(const Ray & r, const Hit & hit) const override;
+
+    virtual ColorRGB emitted(const Hit & hit) const override;
+
+    ColorRGB emission() const;
+
+private:
+
+    ColorRGB emission_;
+};
+
+
 #endif // MATERIAL_HPP
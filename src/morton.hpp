@@ -0,0 +1,120 @@
+#ifndef MORTON_HPP
+#define MORTON_HPP
+
+
+#include "aabb.hpp"
+#include "parallel.hpp"
+#include "vec.hpp"
+
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <vector>
+
+
+// Spreads the lower 21 bits of v so that there are two zero bits between each of them
+inline uint64_t expand_bits(uint64_t v)
+{
+    v &= 0x1fffff;
+    v = (v | v << 32) & 0x1f00000000ffff;
+    v = (v | v << 16) & 0x1f0000ff0000ff;
+    v = (v | v << 8) & 0x100f00f00f00f00f;
+    v = (v | v << 4) & 0x10c30c30c30c30c3;
+    v = (v | v << 2) & 0x1249249249249249;
+    return v;
+}
+
+// 63-bit Morton code of a point within `box`
+inline uint64_t morton_code(const Point3 & p, const AABB & box)
+{
+    uint64_t code = 0;
+
+    for (int i = 0; i < 3; ++i) {
+        double extent = box.max()[i] - box.min()[i];
+        double x = extent > 0 ? (p[i] - box.min()[i]) / extent : 0;
+        uint64_t q = std::min<uint64_t>((1 << 21) - 1, static_cast<uint64_t>(x * (1 << 21)));
+        code |= expand_bits(q) << (2 - i);
+    }
+
+    return code;
+}
+
+// Cube with the minimum corner of `box` that contains it, so that Morton codes within it quantize
+// every axis with cells of the same size even when the box is flat
+inline AABB cube(const AABB & box)
+{
+    Vec3 extent = box.max() - box.min();
+    double size = std::max(extent.x, std::max(extent.y, extent.z));
+
+    AABB c = box;
+    c.extend(box.min() + Vec3(size, size, size));
+    return c;
+}
+
+// 33-bit sort key of a ray, the octant of its direction above a 30-bit Morton code of its origin within `box`
+inline uint64_t ray_key(const Point3 & origin, const Vec3 & direction, const AABB & box)
+{
+    uint64_t octant = (direction.x < 0) | (direction.y < 0) << 1 | (direction.z < 0) << 2;
+    return octant << 30 | morton_code(origin, box) >> 33;
+}
+
+// Parallel least significant digit radix sort of (key, value) pairs
+inline void radix_sort(std::vector<uint64_t> & keys, std::vector<uint32_t> & values)
+{
+    constexpr size_t grain = 1 << 14;
+
+    size_t n = keys.size();
+    unsigned int n_chunks = thread_count();
+
+    std::vector<uint64_t> keys_tmp(n);
+    std::vector<uint32_t> values_tmp(n);
+    std::vector<std::array<size_t, 256>> histograms(n_chunks);
+
+    for (int shift = 0; shift < 64; shift += 8) {
+        for (auto & h : histograms)
+            h.fill(0);
+
+        parallel_chunks(n, [&] (unsigned int c, size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i)
+                histograms[c][(keys[i] >> shift) & 0xff] += 1;
+        }, grain, n_chunks);
+
+        // Skip the digit if all keys share it
+        bool constant = false;
+        for (int d = 0; d < 256 && !constant; ++d) {
+            size_t total = 0;
+            for (auto & h : histograms)
+                total += h[d];
+            constant = total == n;
+        }
+
+        if (constant)
+            continue;
+
+        // Output offsets are ordered by digit first and by chunk second to keep the sort stable
+        size_t offset = 0;
+        for (int d = 0; d < 256; ++d) {
+            for (auto & h : histograms) {
+                size_t count = h[d];
+                h[d] = offset;
+                offset += count;
+            }
+        }
+
+        parallel_chunks(n, [&] (unsigned int c, size_t begin, size_t end) {
+            auto & h = histograms[c];
+            for (size_t i = begin; i < end; ++i) {
+                size_t p = h[(keys[i] >> shift) & 0xff]++;
+                keys_tmp[p] = keys[i];
+                values_tmp[p] = values[i];
+            }
+        }, grain, n_chunks);
+
+        keys.swap(keys_tmp);
+        values.swap(values_tmp);
+    }
+}
+
+
+#endif // MORTON_HPP
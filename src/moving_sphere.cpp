@@ -0,0 +1,61 @@
+#include "moving_sphere.hpp"
+#include "sphere.hpp"
+
+
+#include <algorithm>
+
+
+MovingSphere::MovingSphere(
+    const Point3 & center_open,
+    const Point3 & center_close,
+    const double & radius,
+    std::shared_ptr<Material> material) :
+
+    center_open_(center_open),
+    center_close_(center_close),
+    radius_(radius),
+    material_(material)
+{}
+
+Point3 MovingSphere::center(const double & time) const
+{
+    return center_open_ + std::clamp(time, 0.0, 1.0) * (center_close_ - center_open_);
+}
+
+double MovingSphere::radius() const
+{
+    return radius_;
+}
+
+std::shared_ptr<Material> MovingSphere::material() const
+{
+    return material_;
+}
+
+std::optional<Hit> MovingSphere::trace(const Ray & r, double t_min, double t_max) const
+{
+    return Sphere::intersect(center(r.time()), radius_, material_, r, t_min, t_max);
+}
+
+bool MovingSphere::occluded(const Ray & r, double t_min, double t_max) const
+{
+    return Sphere::intersects(center(r.time()), radius_, r, t_min, t_max);
+}
+
+AABB MovingSphere::bounding_box() const
+{
+    return merge(bounding_box_at(0), bounding_box_at(1));
+}
+
+bool MovingSphere::moving() const
+{
+    return (center_close_ - center_open_).norm_squared() > 0;
+}
+
+AABB MovingSphere::bounding_box_at(const double & time) const
+{
+    Vec3 r(radius_, radius_, radius_);
+    Point3 c = center(time);
+
+    return AABB(c - r, c + r);
+}
@@ -0,0 +1,46 @@
+#ifndef MOVING_SPHERE_HPP
+#define MOVING_SPHERE_HPP
+
+
+#include "vec.hpp"
+#include "ray.hpp"
+#include "hittable.hpp"
+#include "material.hpp"
+
+
+#include <optional>
+
+
+// Sphere moving linearly from `center_open` at shutter open (time 0) to `center_close` at shutter close (time 1)
+class MovingSphere : public Hittable {
+public:
+
+    MovingSphere(
+        const Point3 & center_open,
+        const Point3 & center_close,
+        const double & radius,
+        std::shared_ptr<Material> material);
+
+    Point3 center(const double & time) const;
+    double radius() const;
+    std::shared_ptr<Material> material() const;
+
+    virtual std::optional<Hit> trace(const Ray & r, double t_min, double t_max) const override;
+
+    virtual bool occluded(const Ray & r, double t_min, double t_max) const override;
+
+    virtual AABB bounding_box() const override;
+
+    virtual bool moving() const override;
+    virtual AABB bounding_box_at(const double & time) const override;
+
+private:
+
+    Point3 center_open_;
+    Point3 center_close_;
+    double radius_;
+    std::shared_ptr<Material> material_;
+};
+
+
+#endif // MOVING_SPHERE_HPP
@@ -0,0 +1,65 @@
+#ifndef PARALLEL_HPP
+#define PARALLEL_HPP
+
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+
+// Thread count set with set_thread_count, 0 for all hardware threads
+inline unsigned int thread_count_limit = 0;
+
+inline unsigned int thread_count()
+{
+    if (thread_count_limit > 0)
+        return thread_count_limit;
+
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+// Runs the parallel loops on `n` threads from now on, 0 restores all hardware threads.
+// Not synchronized, to be called while no parallel loop runs
+inline void set_thread_count(const unsigned int & n)
+{
+    thread_count_limit = n;
+}
+
+
+// Splits [0, n) into contiguous chunks and calls f(chunk_id, begin, end) for each of them
+// on its own thread, chunk 0 runs on the calling thread
+template<typename F>
+void parallel_chunks(size_t n, F f, size_t grain = 1024, unsigned int n_chunks = thread_count())
+{
+    n_chunks = std::max<size_t>(1, std::min<size_t>(n_chunks, (n + grain - 1) / grain));
+
+    if (n_chunks == 1) {
+        f(0u, size_t(0), n);
+        return;
+    }
+
+    std::vector<std::thread> threads;
+    threads.reserve(n_chunks - 1);
+
+    for (unsigned int c = 1; c < n_chunks; ++c)
+        threads.emplace_back([&f, c, n, n_chunks] () { f(c, n * c / n_chunks, n * (c + 1) / n_chunks); });
+
+    f(0u, size_t(0), n / n_chunks);
+
+    for (auto & t : threads)
+        t.join();
+}
+
+
+// Calls f(i) for every i in [0, n) using all hardware threads
+template<typename F>
+void parallel_for(size_t n, F f, size_t grain = 1024)
+{
+    parallel_chunks(n, [&f] (unsigned int, size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i)
+            f(i);
+    }, grain);
+}
+
+
+#endif // PARALLEL_HPP
@@ -0,0 +1,300 @@
+#include "path_guide.hpp"
+
+
+#include <algorithm>
+#include <cmath>
+#include <numbers>
+
+
+namespace {
+
+// Energy fraction above which a quadrant is subdivided, the records it needs for that, and the depth
+// limit of direction trees. Subdividing quadrants hit by few records leaves holes in small lights
+constexpr float subdivision_threshold = 0.01f;
+constexpr uint32_t subdivision_records = 16;
+constexpr int max_direction_depth = 20;
+
+// Records a spatial leaf may receive in the first pass before it splits, the limit grows with the
+// square root of the number of samples per pass
+constexpr double spatial_threshold = 4000;
+
+// Position of a unit direction on the unit square of (cos(theta), phi)
+inline std::pair<double, double> to_square(const Vec3 & d)
+{
+    double phi = std::atan2(d.y, d.x);
+    if (phi < 0)
+        phi += 2 * std::numbers::pi;
+
+    return {
+        std::clamp((d.z + 1) / 2, 0.0, std::nextafter(1.0, 0.0)),
+        std::clamp(phi / (2 * std::numbers::pi), 0.0, std::nextafter(1.0, 0.0))
+    };
+}
+
+inline Vec3 from_square(double x, double y)
+{
+    double cos_theta = 2 * x - 1;
+    double sin_theta = std::sqrt(std::max(0.0, 1 - cos_theta * cos_theta));
+    double phi = 2 * std::numbers::pi * y;
+
+    return { sin_theta * std::cos(phi), sin_theta * std::sin(phi), cos_theta };
+}
+
+inline int quadrant(double & x, double & y)
+{
+    int q = (x >= 0.5 ? 1 : 0) + (y >= 0.5 ? 2 : 0);
+
+    // Coordinates within the quadrant
+    x = 2 * x - (q & 1);
+    y = 2 * y - (q >> 1);
+
+    return q;
+}
+
+} // namespace
+
+
+DirectionTree::DirectionTree() :
+    nodes_(1)
+{}
+
+Vec3 DirectionTree::sample(double u_1, double u_2) const
+{
+    if (total() <= 0)
+        return from_square(u_1, u_2);
+
+    double x_0 = 0, y_0 = 0, size = 1;
+
+    for (uint32_t node_id = 0;;) {
+        const Node & node = nodes_[node_id];
+        double sum = node.energy[0] + node.energy[1] + node.energy[2] + node.energy[3];
+
+        // u_1 picks the quadrant and is rescaled for the next choice
+        int q = 0;
+        double below = 0;
+        while (q < 3 && u_1 * sum >= below + node.energy[q])
+            below += node.energy[q++];
+
+        u_1 = node.energy[q] > 0 ? std::clamp((u_1 * sum - below) / node.energy[q], 0.0, std::nextafter(1.0, 0.0)) : 0.5;
+
+        size /= 2;
+        x_0 += size * (q & 1);
+        y_0 += size * (q >> 1);
+
+        if (!node.child[q])
+            return from_square(x_0 + size * u_1, y_0 + size * u_2);
+
+        node_id = node.child[q];
+    }
+}
+
+double DirectionTree::pdf(const Vec3 & direction) const
+{
+    double density = 1 / (4 * std::numbers::pi);
+
+    if (total() <= 0)
+        return density;
+
+    auto [x, y] = to_square(direction);
+
+    for (uint32_t node_id = 0;;) {
+        const Node & node = nodes_[node_id];
+        double sum = node.energy[0] + node.energy[1] + node.energy[2] + node.energy[3];
+        int q = quadrant(x, y);
+
+        if (node.energy[q] <= 0)
+            return 0;
+
+        density *= 4 * node.energy[q] / sum;
+
+        if (!node.child[q])
+            return density;
+
+        node_id = node.child[q];
+    }
+}
+
+void DirectionTree::record(const Vec3 & direction, const float & energy, const double & u_1, const double & u_2)
+{
+    auto [x_0, y_0] = to_square(direction);
+
+    // Size of the leaf quadrant containing the direction
+    double x = x_0, y = y_0, size = 0.5;
+    for (uint32_t node_id = 0; (node_id = nodes_[node_id].child[quadrant(x, y)]); )
+        size /= 2;
+
+    // Phi wraps around, cos(theta) stops at the poles
+    x = std::clamp(x_0 + (u_1 - 0.5) * size, 0.0, std::nextafter(1.0, 0.0));
+    y = y_0 + (u_2 - 0.5) * size;
+    y -= std::floor(y);
+
+    for (uint32_t node_id = 0;;) {
+        int q = quadrant(x, y);
+        nodes_[node_id].energy[q] += energy;
+        ++nodes_[node_id].records[q];
+
+        if (!nodes_[node_id].child[q])
+            return;
+
+        node_id = nodes_[node_id].child[q];
+    }
+}
+
+float DirectionTree::total() const
+{
+    const Node & root = nodes_[0];
+    return root.energy[0] + root.energy[1] + root.energy[2] + root.energy[3];
+}
+
+DirectionTree DirectionTree::refined(const float & threshold, const uint32_t & min_records, const int & max_depth) const
+{
+    DirectionTree tree;
+
+    const float limit = threshold * total();
+    if (limit <= 0)
+        return tree;
+
+    // Quadrants without a node in this tree split their energy and records evenly in the refined one
+    struct Entry {
+        int old_id;
+        uint32_t new_id;
+        int depth;
+        float energy;
+        float records;
+    };
+
+    const Node & root = nodes_[0];
+    std::vector<Entry> stack = { { 0, 0, 1, total(), float(root.records[0] + root.records[1] + root.records[2] + root.records[3]) } };
+
+    while (!stack.empty()) {
+        Entry e = stack.back();
+        stack.pop_back();
+
+        for (int q = 0; q < 4; ++q) {
+            float energy = e.old_id >= 0 ? nodes_[e.old_id].energy[q] : e.energy / 4;
+            float records = e.old_id >= 0 ? nodes_[e.old_id].records[q] : e.records / 4;
+
+            if (energy <= limit || records < min_records || e.depth >= max_depth)
+                continue;
+
+            uint32_t child = tree.nodes_.size();
+            tree.nodes_.emplace_back();
+            tree.nodes_[e.new_id].child[q] = child;
+
+            int old_child = e.old_id >= 0 && nodes_[e.old_id].child[q] ? nodes_[e.old_id].child[q] : -1;
+            stack.push_back({ old_child, child, e.depth + 1, energy, records });
+        }
+    }
+
+    return tree;
+}
+
+
+PathGuide::PathGuide(const AABB & bounds) :
+    box_(bounds)
+{
+    if (box_.bounded()) {
+        nodes_.push_back({ -1, 0, 0 });
+        leaves_.emplace_back();
+    }
+}
+
+const DirectionTree * PathGuide::distribution(const Point3 & p) const
+{
+    if (nodes_.empty())
+        return nullptr;
+
+    const DirectionTree & tree = leaves_[find(p)].sampling;
+    return tree.total() > 0 ? &tree : nullptr;
+}
+
+void PathGuide::record(std::vector<Record> & records)
+{
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+
+    if (!nodes_.empty())
+        for (const auto & r : records)
+            if (std::isfinite(r.energy) && r.energy > 0) {
+                AABB box;
+                find(r.point, &box);
+
+                Vec3 shift = box.max() - box.min();
+                Point3 p = r.point + Vec3(
+                    (uniform(gen_) - 0.5) * shift.x, (uniform(gen_) - 0.5) * shift.y, (uniform(gen_) - 0.5) * shift.z);
+
+                Leaf & leaf = leaves_[find(p)];
+                leaf.building.record(r.direction, r.energy, uniform(gen_), uniform(gen_));
+                ++leaf.records;
+            }
+
+    records.clear();
+}
+
+void PathGuide::update(const unsigned int & pass)
+{
+    if (nodes_.empty())
+        return;
+
+    split(0, box_, static_cast<uint32_t>(spatial_threshold * std::sqrt(std::pow(2.0, pass))));
+
+    for (auto & leaf : leaves_) {
+        leaf.sampling = leaf.building;
+        leaf.building = leaf.sampling.refined(subdivision_threshold, subdivision_records, max_direction_depth);
+        leaf.records = 0;
+    }
+}
+
+uint32_t PathGuide::find(const Point3 & p, AABB * box) const
+{
+    Point3 lower = box_.min(), upper = box_.max();
+    uint32_t node_id = 0;
+
+    while (nodes_[node_id].axis >= 0) {
+        const Node & node = nodes_[node_id];
+
+        if (p[node.axis] < node.split) {
+            upper[node.axis] = node.split;
+            node_id = node.child;
+        } else {
+            lower[node.axis] = node.split;
+            node_id = node.child + 1;
+        }
+    }
+
+    if (box)
+        *box = AABB(lower, upper);
+
+    return nodes_[node_id].child;
+}
+
+void PathGuide::split(const uint32_t & node_id, const AABB & box, const uint32_t & threshold)
+{
+    Node node = nodes_[node_id];
+
+    // Leaves over the threshold halve along their longest axis, both halves start from the parent's
+    // distribution and are assumed to have received half of its records
+    if (node.axis < 0) {
+        if (leaves_[node.child].records <= threshold)
+            return;
+
+        int axis = box.longest_axis();
+        double position = box.center()[axis];
+
+        Leaf half = leaves_[node.child];
+        half.records /= 2;
+        leaves_[node.child] = half;
+        leaves_.push_back(half);
+
+        node = { axis, position, static_cast<uint32_t>(nodes_.size()) };
+        nodes_.push_back({ -1, 0, nodes_[node_id].child });
+        nodes_.push_back({ -1, 0, static_cast<uint32_t>(leaves_.size() - 1) });
+        nodes_[node_id] = node;
+    }
+
+    Point3 upper = box.max(), lower = box.min();
+    upper[node.axis] = node.split;
+    lower[node.axis] = node.split;
+
+    split(node.child, AABB(box.min(), upper), threshold);
+    split(node.child + 1, AABB(lower, box.max()), threshold);
+}
@@ -0,0 +1,107 @@
+#ifndef PATH_GUIDE_HPP
+#define PATH_GUIDE_HPP
+
+
+#include "vec.hpp"
+#include "aabb.hpp"
+
+
+#include <cstdint>
+#include <random>
+#include <vector>
+
+
+// Quadtree over the unit square of cylindrical coordinates (cos(theta), phi) of directions, equal areas
+// of the square are equal solid angles. Every node keeps the energy of its four quadrants and the
+// number of records that added to it
+class DirectionTree {
+public:
+
+    DirectionTree();
+
+    // Direction in proportion to the recorded energy for two uniform numbers in [0, 1)
+    Vec3 sample(double u_1, double u_2) const;
+
+    // Solid angle density of sample
+    double pdf(const Vec3 & direction) const;
+
+    // Adds `energy` to every quadrant containing the direction after shifting it by up to half the size
+    // of its leaf, by `u_1` and `u_2` in [0, 1). The shift spreads records over neighbouring leaves
+    // so that parts of a small light missed by the samples of a pass are not left without density
+    void record(const Vec3 & direction, const float & energy, const double & u_1, const double & u_2);
+
+    float total() const;
+
+    // Empty tree whose leaves split the energy of this one into parts of at most `threshold` of the total,
+    // quadrants that received fewer than `min_records` records are not split
+    DirectionTree refined(const float & threshold, const uint32_t & min_records, const int & max_depth) const;
+
+private:
+
+    struct Node {
+        float energy[4] = { 0, 0, 0, 0 };
+        uint32_t records[4] = { 0, 0, 0, 0 };
+        uint32_t child[4] = { 0, 0, 0, 0 };  // 0 for leaf quadrants, the root is never a child
+    };
+
+    std::vector<Node> nodes_;
+};
+
+
+// Spatial binary tree over the scene bounds with a DirectionTree in every leaf (Mueller et al. 2017,
+// practical path guiding). Every leaf samples from the distribution learned in the previous pass while
+// it collects the current one, so sampling only reads and needs no locks. Threads buffer their records
+// and merge them now and then, after a pass leaves that received many records split and every leaf
+// replaces its distribution with the one just learned
+class PathGuide {
+public:
+
+    // Light scattered at `point` from `direction`, divided by the density the direction was sampled with
+    struct Record {
+        Point3 point;
+        Vec3 direction;
+        float energy;
+    };
+
+    // Bounds without finite extent give a guide that never learns anything
+    PathGuide() = default;
+    PathGuide(const AABB & bounds);
+
+    // Learned distribution of incident radiance at p, null when nothing was learned there yet
+    const DirectionTree * distribution(const Point3 & p) const;
+
+    // Merges and clears records of the current pass. Every record is moved by up to half the size of
+    // its spatial leaf first, which shares it with the neighbouring leaves. Calls must not overlap
+    // each other or update, sampling may go on meanwhile
+    void record(std::vector<Record> & records);
+
+    // Ends a pass, `pass` counts the passes from 0
+    void update(const unsigned int & pass);
+
+private:
+
+    struct Leaf {
+        DirectionTree sampling;  // learned in the previous pass
+        DirectionTree building;  // collects the current pass
+        uint32_t records = 0;
+    };
+
+    struct Node {
+        int axis;        // -1 for leaves
+        double split;
+        uint32_t child;  // interior: first child, the second one follows it; leaf: index into leaves_
+    };
+
+    // Leaf containing p, `box` receives its bounds unless it is null
+    uint32_t find(const Point3 & p, AABB * box = nullptr) const;
+
+    void split(const uint32_t & node_id, const AABB & box, const uint32_t & threshold);
+
+    AABB box_;
+    std::vector<Node> nodes_;
+    std::vector<Leaf> leaves_;
+    std::minstd_rand gen_;
+};
+
+
+#endif // PATH_GUIDE_HPP
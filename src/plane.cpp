@@ -0,0 +1,56 @@
+#include "plane.hpp"
+
+
+#include <limits>
+
+
+Plane::Plane(const Point3 & point, const Vec3 & normal, std::shared_ptr<Material> material) :
+    point_(point),
+    normal_(unit(normal)),
+    material_(material)
+{}
+
+Point3 Plane::point() const
+{
+    return point_;
+}
+
+Vec3 Plane::normal() const
+{
+    return normal_;
+}
+
+std::shared_ptr<Material> Plane::material() const
+{
+    return material_;
+}
+
+std::optional<Hit> Plane::trace(const Ray & r, double t_min, double t_max) const
+{
+    double t = solution(r);
+
+    // Negated comparisons also reject NaN
+    if (!(t >= t_min && t <= t_max))
+        return std::nullopt;
+
+    return hit(r, t);
+}
+
+Hit Plane::hit(const Ray & r, const double & t) const
+{
+    bool front_face = dot(r.direction(), normal_) < 0;
+
+    return Hit { r(t), front_face ? normal_ : -normal_, t, front_face, material_ };
+}
+
+bool Plane::occluded(const Ray & r, double t_min, double t_max) const
+{
+    double t = solution(r);
+    return t >= t_min && t <= t_max;
+}
+
+AABB Plane::bounding_box() const
+{
+    constexpr double inf = std::numeric_limits<double>::infinity();
+    return AABB(Point3(-inf, -inf, -inf), Point3(inf, inf, inf));
+}
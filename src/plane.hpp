@@ -0,0 +1,53 @@
+#ifndef PLANE_HPP
+#define PLANE_HPP
+
+
+#include "vec.hpp"
+#include "ray.hpp"
+#include "hittable.hpp"
+#include "material.hpp"
+
+
+#include <memory>
+#include <optional>
+
+
+// Infinite plane through `point` facing `normal`. Its bounding box is unbounded, so accelerators keep
+// it out of their hierarchies and test it on every ray, which costs one dot product
+class Plane : public Hittable {
+public:
+
+    Plane(const Point3 & point, const Vec3 & normal, std::shared_ptr<Material> material);
+
+    Point3 point() const;
+    Vec3 normal() const;
+    std::shared_ptr<Material> material() const;
+
+    virtual std::optional<Hit> trace(const Ray & r, double t_min, double t_max) const override;
+
+    virtual bool occluded(const Ray & r, double t_min, double t_max) const override;
+
+    virtual AABB bounding_box() const override;
+
+    // Ray parameter of the intersection, NaN or infinite for rays parallel to the plane.
+    // Accelerators test planes with it and build the hit only for the closest one
+    double solution(const Ray & r) const;
+
+    // Hit record at ray parameter `t`
+    Hit hit(const Ray & r, const double & t) const;
+
+private:
+
+    Point3 point_;
+    Vec3 normal_;   // unit length
+    std::shared_ptr<Material> material_;
+};
+
+
+inline double Plane::solution(const Ray & r) const
+{
+    return dot(point_ - r.origin(), normal_) / dot(r.direction(), normal_);
+}
+
+
+#endif // PLANE_HPP
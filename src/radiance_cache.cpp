@@ -0,0 +1,120 @@
+#include "radiance_cache.hpp"
+
+
+#include <algorithm>
+#include <cmath>
+
+
+namespace {
+
+// Slots following the hashed one that a key may take
+constexpr int max_probes = 8;
+
+inline uint64_t hash(uint64_t key)
+{
+    // Finalizer of MurmurHash3
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdull;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ull;
+    key ^= key >> 33;
+
+    return key;
+}
+
+} // namespace
+
+
+RadianceCache::RadianceCache(const double & cell_size, const int & size_log2) :
+    inverse_cell_size_(1 / cell_size),
+    mask_((uint64_t(1) << size_log2) - 1),
+    cells_(new Cell[uint64_t(1) << size_log2])
+{
+    for (uint64_t i = 0; i <= mask_; ++i) {
+        cells_[i].key.store(0, std::memory_order_relaxed);
+        cells_[i].count.store(0, std::memory_order_relaxed);
+
+        for (auto & s : cells_[i].sum)
+            s.store(0, std::memory_order_relaxed);
+    }
+}
+
+void RadianceCache::add(const Point3 & p, const Vec3 & normal, const ColorRGB & radiance)
+{
+    const uint64_t k = key(p, normal);
+    const uint64_t h = hash(k);
+
+    for (int i = 0; i < max_probes; ++i) {
+        Cell & cell = cells_[(h + i) & mask_];
+
+        uint64_t current = cell.key.load(std::memory_order_relaxed);
+        if (current == 0 && cell.key.compare_exchange_strong(current, k, std::memory_order_relaxed))
+            current = k;
+
+        if (current != k)
+            continue;
+
+        for (int c = 0; c < 3; ++c)
+            cell.sum[c].fetch_add(radiance[c], std::memory_order_relaxed);
+
+        cell.count.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+}
+
+std::optional<ColorRGB> RadianceCache::lookup(const Point3 & p, const Vec3 & normal, const uint32_t & min_samples) const
+{
+    const uint64_t k = key(p, normal);
+    const uint64_t h = hash(k);
+
+    for (int i = 0; i < max_probes; ++i) {
+        const Cell & cell = cells_[(h + i) & mask_];
+        uint64_t current = cell.key.load(std::memory_order_relaxed);
+
+        if (current == 0)
+            return std::nullopt;
+
+        if (current != k)
+            continue;
+
+        // Sums and count are read separately, a sample added in between shifts the mean slightly
+        uint32_t count = cell.count.load(std::memory_order_relaxed);
+        if (count < std::max(min_samples, 1u))
+            return std::nullopt;
+
+        return ColorRGB(
+            cell.sum[0].load(std::memory_order_relaxed),
+            cell.sum[1].load(std::memory_order_relaxed),
+            cell.sum[2].load(std::memory_order_relaxed)) / float(count);
+    }
+
+    return std::nullopt;
+}
+
+size_t RadianceCache::size() const
+{
+    size_t n = 0;
+
+    for (uint64_t i = 0; i <= mask_; ++i)
+        n += cells_[i].key.load(std::memory_order_relaxed) != 0;
+
+    return n;
+}
+
+uint64_t RadianceCache::key(const Point3 & p, const Vec3 & normal) const
+{
+    // 20 bits per grid coordinate, positions further out wrap around
+    uint64_t k = 0;
+    for (int i = 0; i < 3; ++i)
+        k = (k << 20) | (uint64_t(int64_t(std::floor(p[i] * inverse_cell_size_))) & 0xfffff);
+
+    int axis = 0;
+    for (int i = 1; i < 3; ++i)
+        if (std::abs(normal[i]) > std::abs(normal[axis]))
+            axis = i;
+
+    uint64_t face = 2 * axis + (normal[axis] < 0 ? 1 : 0);
+
+    // The top bit keeps every key apart from the free cells
+    return (uint64_t(1) << 63) | (face << 60) | k;
+}
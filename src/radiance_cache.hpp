@@ -0,0 +1,49 @@
+#ifndef RADIANCE_CACHE_HPP
+#define RADIANCE_CACHE_HPP
+
+
+#include "vec.hpp"
+
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <optional>
+
+
+// World-space cache of the radiance diffuse surfaces reflect, averaged over cells of a hashed grid.
+// A cell is keyed by the grid position and by the axis and sign of the largest normal component,
+// so that the two sides of a thin wall and the faces of a corner stay apart. Threads add and read
+// samples concurrently, cells are claimed with a compare-and-swap and sums grow with atomic adds.
+// Cells that find their table slots taken by other keys drop their samples
+class RadianceCache {
+public:
+
+    // Table of 2^size_log2 cells for a grid of `cell_size` world units
+    RadianceCache(const double & cell_size, const int & size_log2 = 20);
+
+    void add(const Point3 & p, const Vec3 & normal, const ColorRGB & radiance);
+
+    // Mean radiance of the cell, empty until it holds `min_samples` samples
+    std::optional<ColorRGB> lookup(const Point3 & p, const Vec3 & normal, const uint32_t & min_samples) const;
+
+    // Number of cells holding samples
+    size_t size() const;
+
+private:
+
+    struct Cell {
+        std::atomic<uint64_t> key;  // 0 for free cells
+        std::atomic<uint32_t> count;
+        std::atomic<float> sum[3];
+    };
+
+    uint64_t key(const Point3 & p, const Vec3 & normal) const;
+
+    double inverse_cell_size_;
+    uint64_t mask_;
+    std::unique_ptr<Cell[]> cells_;
+};
+
+
+#endif // RADIANCE_CACHE_HPP
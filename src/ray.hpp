@@ -3,15 +3,18 @@
 
 #include "vec.hpp"
 
+// Ray at a point in time, moving objects are placed at time 0 at shutter open and at time 1 at shutter close
 class Ray {
 public:
-    Ray(const Point3 & origin, const Vec3 & direction) :
+    Ray(const Point3 & origin, const Vec3 & direction, const double & time = 0) :
         origin_(origin),
-        direction_(direction)
+        direction_(direction),
+        time_(time)
     {}
 
     Point3 origin() const { return origin_; }
     Vec3 direction() const { return direction_; }
+    double time() const { return time_; }
 
     Point3 operator() (double t) const {
         return origin_ + t * direction_;
@@ -20,6 +23,7 @@ public:
 private:
     Point3 origin_;
     Vec3 direction_;
+    double time_;
 };
 
 #endif // RAY_HPP
\ No newline at end of file
@@ -0,0 +1,473 @@
+#include "render.hpp"
+#include "bvh_cache.hpp"
+#include "wavefront.hpp"
+
+
+#include <algorithm>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <ranges>
+#include <thread>
+#include <vector>
+
+
+ColorRGB sky(const Vec3 & direction, const RenderSettings & settings)
+{
+    Vec3 unit_direction = unit(direction);
+    float t = 0.5 * (unit_direction.y + 1.0);
+
+    return settings.sky_intensity * ((1.0 - t) * ColorRGB(1.0, 1.0, 1.0) + t * ColorRGB(0.5, 0.7, 1.0));
+}
+
+float survival(const ColorRGB & throughput, const unsigned int & depth, const RenderSettings & settings)
+{
+    if (depth < settings.roulette_depth)
+        return 1;
+
+    return std::min(1.0f, std::max(throughput.r, std::max(throughput.g, throughput.b)) / settings.roulette_threshold);
+}
+
+double power_heuristic(const double & pdf, const double & other)
+{
+    if (pdf == 0)
+        return 0;
+
+    return pdf * pdf / (pdf * pdf + other * other);
+}
+
+ColorRGB background(
+    const Vec3 & direction,
+    const LightList & lights,
+    const bool & light_sampled,
+    const double & scatter_pdf,
+    const RenderSettings & settings)
+{
+    if (!lights.environment())
+        return sky(direction, settings);
+
+    Vec3 unit_direction = unit(direction);
+    ColorRGB radiance = lights.environment() -> radiance(unit_direction);
+
+    if (!light_sampled)
+        return radiance;
+
+    if (!settings.multiple_importance_sampling)
+        return { 0, 0, 0 };
+
+    return radiance * float(power_heuristic(scatter_pdf, lights.pdf(unit_direction)));
+}
+
+Render::Render(Camera & camera, HittableList & objects, const RenderSettings & settings) :
+    camera_(camera),
+    objects_(objects),
+    settings_(settings),
+    frame_(0)
+{
+    if (!settings_.bvh_cache.empty()) {
+        accelerator_ = BVHCache::load_or_build(settings_.bvh_cache, objects_);
+        scene_hash_ = BVHCache::scene_hash(objects_);
+    }
+
+    if (!accelerator_) {
+        bvh_ = std::make_shared<BVH8>(objects_);
+        accelerator_ = bvh_;
+    }
+
+    if (!settings_.environment_map.empty()) {
+        Image<float, 3> map(settings_.environment_map);
+
+        if (std::get<0>(map.size()) > 0)
+            environment_ = std::make_shared<EnvironmentLight>(map, settings_.sky_intensity);
+        else
+            std::cerr << "Cannot load environment map " << settings_.environment_map << std::endl;
+    }
+}
+
+Image<float, 3> Render::render()
+{
+    if (frame_++ > 0) {
+        if (bvh_) {
+            bvh_ -> refit(settings_.rebuild_threshold);
+        } else if (BVHCache::scene_hash(objects_) != scene_hash_) {
+            bvh_ = std::make_shared<BVH8>(objects_);
+            accelerator_ = bvh_;
+        }
+    }
+
+    lights_ = LightList(objects_, settings_.light_selection, environment_);
+
+    if (settings_.integrator == RenderSettings::Integrator::Wavefront)
+        return Wavefront(settings_).render(camera_, *accelerator_, lights_);
+
+    const unsigned int n_samples = settings_.n_samples;
+
+    if (settings_.radiance_cache)
+        cache_ = std::make_shared<RadianceCache>(settings_.radiance_cache_cell);
+    else
+        cache_ = nullptr;
+
+    Image<float, 3> sums(settings_.width, settings_.height, { 0, 0, 0 });
+
+    if (settings_.path_guiding) {
+        // Every training pass takes twice the samples of the previous one, at least half of all samples
+        // are left for the last pass
+        // Unbounded objects such as planes are left out, their far hits fall into the border leaves
+        AABB bounds;
+        for (const auto & object : objects_.objects())
+            if (object -> bounding_box().bounded())
+                bounds.extend(object -> bounding_box());
+
+        guide_ = PathGuide(bounds);
+
+        unsigned int used = 0, pass = 0;
+
+        for (unsigned int s = 1; 2 * (used + s) <= n_samples; used += s, s *= 2) {
+            trace_samples(s, sums, true);
+            guide_.update(pass++);
+        }
+
+        trace_samples(n_samples - used, sums, false);
+    } else {
+        trace_samples(n_samples, sums, false);
+    }
+
+    Image<float, 3> img(settings_.width, settings_.height);
+
+    for (int i = 0; i < settings_.height; ++i)
+        for (int j = 0; j < settings_.width; ++j)
+            img(i, j) = sqrt(sums(i, j) / n_samples);
+
+    return img;
+}
+
+void Render::trace_samples(const unsigned int & n_samples, Image<float, 3> & sums, const bool & learn)
+{
+    const int image_w = settings_.width;
+    const int image_h = settings_.height;
+    const unsigned int n_threads = settings_.n_threads;
+
+    // Pixels are processed in square tiles, one packet of primary rays per tile and sample
+    constexpr int tile_size = 4;
+    static_assert(tile_size * tile_size <= BVH8::max_packet_size);
+
+    // Records are merged into the guide whenever a thread buffered this many
+    constexpr size_t record_batch = 1 << 16;
+
+    const int tiles_w = (image_w + tile_size - 1) / tile_size;
+    const int tiles_h = (image_h + tile_size - 1) / tile_size;
+
+    std::mutex guide_mutex;
+
+    std::vector<std::thread> threads;
+    threads.reserve(n_threads);
+
+    for (unsigned int thread_id = 0; thread_id < n_threads; ++thread_id)
+        threads.push_back(
+            std::thread([&, thread_id] () {
+
+                std::random_device rd;
+                std::minstd_rand gen(rd());
+                std::uniform_real_distribution<float> uniform(0.0, 1.0);
+
+                std::vector<PathGuide::Record> records;
+                std::vector<PathGuide::Record> * recording = learn ? &records : nullptr;
+
+                auto work_group =
+                    std::views::iota(0, tiles_h * tiles_w) |
+                    std::views::filter([n_threads, thread_id] (int i) { return i % n_threads == thread_id; });
+
+                for (int tile_id : work_group) {
+                    int i_0 = tile_id / tiles_w * tile_size;
+                    int j_0 = tile_id % tiles_w * tile_size;
+                    int i_1 = std::min(i_0 + tile_size, image_h);
+                    int j_1 = std::min(j_0 + tile_size, image_w);
+
+                    std::vector<Ray> rays;
+                    rays.reserve(tile_size * tile_size);
+
+                    std::optional<Hit> hits[tile_size * tile_size];
+                    ColorRGB c[tile_size * tile_size] = {};
+
+                    for (unsigned int s = 0; s < n_samples; ++s) {
+                        rays.clear();
+
+                        for (int i = i_0; i < i_1; ++i)
+                            for (int j = j_0; j < j_1; ++j) {
+                                float u = (float(j) + uniform(gen)) / (image_w - 1);
+                                float v = (image_h - 1 - float(i) + uniform(gen)) / (image_h - 1);
+
+                                rays.push_back(camera_.get_ray(u, v, gen));
+                            }
+
+                        const int n = rays.size();
+                        const double t_max = std::numeric_limits<float>::infinity();
+
+                        if (settings_.packets) {
+                            std::fill(hits, hits + n, std::nullopt);
+                            accelerator_ -> trace_batch(rays, 0.0001, t_max, std::span(hits, n));
+                        } else {
+                            for (int k = 0; k < n; ++k)
+                                hits[k] = accelerator_ -> trace(rays[k], 0.0001, t_max);
+                        }
+
+                        // Color calculation
+                        for (int k = 0; k < n; ++k)
+                            c[k] += ray_color(rays[k], hits[k], gen, recording);
+                    }
+
+                    // Tiles are disjoint, no other thread writes these pixels
+                    for (int i = i_0, k = 0; i < i_1; ++i)
+                        for (int j = j_0; j < j_1; ++j, ++k)
+                            sums(i, j) += c[k];
+
+                    if (records.size() >= record_batch) {
+                        std::lock_guard lock(guide_mutex);
+                        guide_.record(records);
+                    }
+                }
+
+                std::lock_guard lock(guide_mutex);
+                guide_.record(records);
+            })
+        );
+
+    for (auto & t : threads)
+        t.join();
+}
+
+AcceleratorQuality Render::quality()
+{
+    return in_memory_bvh().quality();
+}
+
+Image<float, 3> Render::heatmap()
+{
+    const BVH8 & bvh = in_memory_bvh();
+
+    const int image_w = settings_.width;
+    const int image_h = settings_.height;
+
+    std::vector<TraversalStats> stats(image_w * image_h);
+
+    parallel_for(stats.size(), [&] (size_t pixel_id) {
+        int i = pixel_id / image_w;
+        int j = pixel_id % image_w;
+
+        float u = (j + 0.5f) / (image_w - 1);
+        float v = (image_h - 1 - i + 0.5f) / (image_h - 1);
+
+        std::minstd_rand gen(pixel_id);
+        bvh.trace(camera_.get_ray(u, v, gen), 0.0001, std::numeric_limits<float>::infinity(), stats[pixel_id]);
+    }, 256);
+
+    uint32_t max_nodes = 1, max_primitives = 1;
+    for (const auto & s : stats) {
+        max_nodes = std::max(max_nodes, s.nodes);
+        max_primitives = std::max(max_primitives, s.primitives);
+    }
+
+    Image<float, 3> img(image_w, image_h, { 0, 0, 0 });
+
+    for (int i = 0; i < image_h; ++i)
+        for (int j = 0; j < image_w; ++j) {
+            const auto & s = stats[i * image_w + j];
+            img(i, j) = { float(s.nodes) / max_nodes, float(s.primitives) / max_primitives, 0 };
+        }
+
+    return img;
+}
+
+BVH8 & Render::in_memory_bvh()
+{
+    if (!bvh_) {
+        bvh_ = std::make_shared<BVH8>(objects_);
+        accelerator_ = bvh_;
+    }
+
+    return *bvh_;
+}
+
+ColorRGB Render::ray_color(
+    Ray r,
+    std::optional<Hit> hit,
+    std::minstd_rand & gen,
+    std::vector<PathGuide::Record> * records) const
+{
+    std::uniform_real_distribution<float> uniform(0.0, 1.0);
+
+    ColorRGB radiance(0, 0, 0);
+    ColorRGB throughput(1, 1, 1);
+
+    // Whether the previous hit sampled the lights, then the density of the scattered direction
+    // and the normal at its origin weight emission found by the ray
+    bool light_sampled = false;
+    double scatter_pdf = 0;
+    Vec3 normal;
+
+    // Non-specular hits of the path. The radiance found after leaving one divided by the throughput
+    // of the path reaching it is the arriving radiance times the material over the density of the
+    // scattered direction, the guide learns the product of both
+    struct Vertex {
+        Point3 point;
+        Vec3 direction;
+        ColorRGB throughput;
+        ColorRGB radiance;
+    };
+
+    std::vector<Vertex> vertices;
+
+    // Whether the last vertex is the origin of the current ray
+    bool at_vertex = false;
+
+    // Diffuse hits of the path, the light found after one divided by the throughput reaching it
+    // is what the surface reflects
+    struct CacheVertex {
+        Point3 point;
+        Vec3 normal;
+        ColorRGB throughput;
+        ColorRGB radiance;
+    };
+
+    std::vector<CacheVertex> cache_vertices;
+
+    // If we've exceeded the ray bounce limit, no more light is gathered.
+    for (unsigned int depth = 0; depth < settings_.bounces; ++depth) {
+        if (depth > 0)
+            hit = accelerator_ -> trace(r, 0.0001, std::numeric_limits<float>::infinity());
+
+        if (!hit) {
+            radiance += throughput * background(r.direction(), lights_, light_sampled, scatter_pdf, settings_);
+
+            if (at_vertex && light_sampled && lights_.environment())
+                vertices.back().radiance = radiance;
+
+            break;
+        }
+
+        const Material & material = *hit -> material;
+        ColorRGB emitted = material.emitted(*hit);
+        bool emits = emitted.r + emitted.g + emitted.b > 0;
+
+        // Light samples only reach the emitters on the light list, others are found by scattering alone
+        if (!light_sampled || (emits && !lights_.contains(*hit)))
+            radiance += throughput * emitted;
+        else if (settings_.multiple_importance_sampling && emits)
+            radiance += throughput * emitted * float(power_heuristic(scatter_pdf, lights_.pdf(r.origin(), normal, *hit)));
+
+        // Lights sampled at the last vertex reach it through its light samples already, the guide
+        // learns the light arriving there indirectly
+        if (at_vertex && light_sampled)
+            vertices.back().radiance = radiance;
+
+        if (cache_ && material.diffuse()) {
+            if (depth >= settings_.radiance_cache_depth) {
+                auto cached = cache_ -> lookup(hit -> point, hit -> normal, settings_.radiance_cache_samples);
+
+                if (cached) {
+                    radiance += throughput * *cached;
+                    break;
+                }
+            }
+
+            cache_vertices.push_back({ hit -> point, hit -> normal, throughput, radiance });
+        }
+
+        // Guided hits scatter by the mixture of the learned distribution and the material
+        const DirectionTree * guide = material.specular() ? nullptr : guide_.distribution(hit -> point);
+        const float alpha = settings_.guiding_fraction;
+
+        auto mixture_pdf = [&] (const Vec3 & direction) {
+            double p = material.pdf(r, *hit, direction);
+            return guide ? alpha * guide -> pdf(direction) + (1 - alpha) * p : p;
+        };
+
+        light_sampled = settings_.next_event_estimation && lights_.size() > 0 && !material.specular();
+
+        if (light_sampled) {
+            if (auto light = lights_.sample(hit -> point, hit -> normal, uniform(gen), uniform(gen), uniform(gen))) {
+                ColorRGB f = material.evaluate(r, *hit, light -> direction);
+                Ray shadow(hit -> point, light -> direction, r.time());
+
+                float weight = settings_.multiple_importance_sampling ?
+                    power_heuristic(light -> pdf, mixture_pdf(light -> direction)) : 1;
+
+                // The shadow ray stops short of the sampled point on the light
+                if (f.r + f.g + f.b > 0 && !accelerator_ -> occluded(shadow, 0.0001, light -> distance * (1 - 1e-6)))
+                    radiance += throughput * f * light -> radiance * (weight / light -> pdf);
+            }
+        }
+
+        ColorRGB incoming = throughput;
+        Vec3 direction;
+
+        if (guide) {
+            if (uniform(gen) < alpha) {
+                direction = guide -> sample(uniform(gen), uniform(gen));
+            } else {
+                auto scattered = material.scatter(r, *hit);
+                if (!scattered)
+                    break;
+
+                direction = unit(std::get<1>(*scattered).direction());
+            }
+
+            // Directions below the surface carry nothing
+            double p = mixture_pdf(direction);
+            ColorRGB f = material.evaluate(r, *hit, direction);
+
+            if (p <= 0 || f.r + f.g + f.b <= 0)
+                break;
+
+            throughput *= f / float(p);
+            scatter_pdf = p;
+            r = Ray(hit -> point, direction, r.time());
+        } else {
+            auto scattered = material.scatter(r, *hit);
+            if (!scattered)
+                break;
+
+            auto [attenuation, scattered_ray] = *scattered;
+            throughput *= attenuation;
+
+            if (light_sampled)
+                scatter_pdf = material.pdf(r, *hit, unit(scattered_ray.direction()));
+
+            r = scattered_ray;
+        }
+
+        normal = hit -> normal;
+
+        // Survivors of dark paths carry the energy of the stopped ones
+        float p = survival(throughput, depth + 1, settings_);
+
+        if (p < 1) {
+            if (uniform(gen) >= p)
+                break;
+
+            throughput /= p;
+        }
+
+        at_vertex = records && !material.specular();
+
+        if (at_vertex)
+            vertices.push_back({ hit -> point, unit(r.direction()), incoming, radiance });
+    }
+
+    if (records)
+        for (const auto & v : vertices) {
+            float energy = 0;
+
+            for (int k = 0; k < 3; ++k)
+                if (v.throughput[k] > 0)
+                    energy += (radiance[k] - v.radiance[k]) / v.throughput[k] / 3;
+
+            records -> push_back({ v.point, v.direction, energy });
+        }
+
+    for (const auto & v : cache_vertices)
+        if (v.throughput.r > 0 && v.throughput.g > 0 && v.throughput.b > 0)
+            cache_ -> add(v.point, v.normal, (radiance - v.radiance) / v.throughput);
+
+    return radiance;
+}
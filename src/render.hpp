@@ -4,8 +4,124 @@
 
 #include "image.hpp"
 #include "hittable.hpp"
+#include "bvh8.hpp"
 #include "camera.hpp"
 #include "ray.hpp"
+#include "parallel.hpp"
+#include "light.hpp"
+#include "path_guide.hpp"
+#include "radiance_cache.hpp"
+
+
+#include <memory>
+#include <random>
+#include <string>
+
+
+struct RenderSettings {
+
+    enum class Integrator {
+        PathTracer,  // depth-first, every thread follows one path to its end before starting the next
+        Wavefront    // breadth-first, batches of paths advance one bounce at a time through separate stages
+    };
+
+    int width = 1280;
+    int height = 720;
+    unsigned int n_samples = 16;
+    unsigned int bounces = 16;
+
+    // Scale of the sky gradient or of the environment map, the only light besides emissive objects
+    float sky_intensity = 1;
+
+    // Equirectangular HDR image lighting the scene from all directions in place of the sky gradient,
+    // sampled explicitly like the lights. Empty keeps the gradient
+    std::string environment_map;
+
+    // At every hit on a non-specular material one light of the scene is sampled with a shadow ray
+    bool next_event_estimation = true;
+
+    // Light samples and scattered rays that reach a light are both kept and weighted by the power heuristic,
+    // each strategy counts most where it is the less noisy one: light samples for large lights and rough
+    // surfaces, scattering for glossy surfaces. Without it emission reached by scattering off a surface
+    // where a light was sampled is skipped
+    bool multiple_importance_sampling = true;
+
+    // How the light of a next event estimation sample is picked, the light BVH keeps noise nearly
+    // independent of the number of lights where a uniform choice degrades in proportion to it
+    LightList::Selection light_selection = LightList::Selection::BVH;
+
+    // Russian roulette: after `roulette_depth` bounces a path whose largest throughput component t is
+    // below `roulette_threshold` continues with probability t / roulette_threshold and is reweighted by
+    // its inverse, which keeps the estimate unbiased. Only dark paths are cut, bright ones still reach
+    // the sky at little cost. Setting roulette_depth to `bounces` traces every path to full depth
+    unsigned int roulette_depth = 1;
+    float roulette_threshold = 0.25;
+
+    // Path guiding: the samples of a frame are traced in passes of 1, 2, 4, ... samples per pixel
+    // while the radiance reaching every hit is learned (see PathGuide), the last pass takes the rest.
+    // Each pass scatters off non-specular surfaces by the distribution learned in the one before with
+    // probability `guiding_fraction` and by the material otherwise, the image averages all passes.
+    // Pays off for light that arrives indirectly from a few directions, such as small lights seen through
+    // glass, and once the image has enough samples to learn from; under smooth lighting like the sky
+    // the material alone samples better. Only the path tracer guides, the wavefront integrator ignores it
+    bool path_guiding = false;
+    float guiding_fraction = 0.5;
+
+    // Radiance cache: a path that hits a diffuse surface after `radiance_cache_depth` bounces ends there
+    // with the light the surface reflects, read from a hashed grid of `radiance_cache_cell` world units
+    // once the cell holds `radiance_cache_samples` samples. Every path adds what it finds at its diffuse
+    // hits, the cache fills while the frame renders and starts anew with the next one. Biased: light is
+    // blurred over a cell and early samples carry more noise, a larger depth and more samples per cell
+    // bring it closer to full paths. Only the path tracer reads it, the wavefront integrator ignores it
+    bool radiance_cache = false;
+    unsigned int radiance_cache_depth = 2;
+    float radiance_cache_cell = 0.25;
+    unsigned int radiance_cache_samples = 32;
+
+    unsigned int n_threads = thread_count();
+
+    // Primary rays of 4x4 pixel tiles are submitted to Hittable::trace_batch at once, which a BVH8
+    // traces as one packet. Bounces are incoherent and always traced one ray at a time
+    bool packets = true;
+
+    Integrator integrator = Integrator::PathTracer;
+
+    // Number of paths the wavefront integrator keeps in flight, capped at one path per pixel
+    unsigned int wave_size = 1 << 16;
+
+    // The wavefront integrator traces secondary rays in order of direction octant first and origin
+    // along a Morton curve second, so that consecutive rays visit the same nodes and primitives.
+    // Pays off once the accelerator is far larger than the caches, the sort costs about as much
+    // as tracing the rays of scenes that fit (see `render bench ray_sorting`)
+    bool sort_rays = false;
+
+    // Relative growth of the SAH cost of a subtree after which it is rebuilt instead of refitted
+    double rebuild_threshold = 1.5;
+
+    // Directory of memory mapped BVH files keyed by the scene hash (see BVHCache), empty disables the cache
+    std::string bvh_cache;
+};
+
+
+// Radiance of the background along a direction
+ColorRGB sky(const Vec3 & direction, const RenderSettings & settings);
+
+// Probability for a path to continue after a bounce (see RenderSettings::roulette_depth),
+// `depth` counts the bounces taken so far including the current one
+float survival(const ColorRGB & throughput, const unsigned int & depth, const RenderSettings & settings);
+
+// Weight of a sample drawn with density `pdf` when another strategy could have drawn it with density `other`
+double power_heuristic(const double & pdf, const double & other);
+
+// Radiance reaching a path that escapes along `direction`. The environment of the lights replaces the sky
+// and is weighted like emission when the origin of the ray sampled the lights, where `scatter_pdf`
+// is the density of the ray direction (see RenderSettings::multiple_importance_sampling)
+ColorRGB background(
+    const Vec3 & direction,
+    const LightList & lights,
+    const bool & light_sampled,
+    const double & scatter_pdf,
+    const RenderSettings & settings);
 
 
 class Render {
@@ -21,23 +137,59 @@ public:
         img = renderer.render();
         img.save(...)
 
-        cam.update(...)
-        objects.update(...)
+        cam = Camera(...)
+        sphere -> set_center(...)
     }
     */
 
-    Render(Camera & camera, HittableList & objects) : 
-        camera_(camera),
-        objects_(objects)
-    {}
+    Render(Camera & camera, HittableList & objects, const RenderSettings & settings = RenderSettings());
 
+    // Renders with the integrator selected in the settings.
+    // Every frame after the first one refits the acceleration structure to the current objects.
+    // A structure loaded from the BVH cache is read-only, it is kept while the scene hash is unchanged
+    // and replaced by an in-memory BVH8 once the objects move
     Image<float, 3> render();
 
+    // Quality report of the acceleration structure
+    AcceleratorQuality quality();
+
+    // Traversal work of one primary ray per pixel, node visits in red and primitive tests in green,
+    // both scaled by their maximum over the image. Diagnostics need an in-memory BVH8, a structure
+    // loaded from the cache is replaced by one
+    Image<float, 3> heatmap();
+
 private:
 
+    BVH8 & in_memory_bvh();
+
+    // Adds `n_samples` samples of every pixel to the linear sums, recording what the path guide
+    // learns from them when `learn` is set
+    void trace_samples(const unsigned int & n_samples, Image<float, 3> & sums, const bool & learn);
+
+    // Iterative path tracer carrying the product of the attenuations along the path,
+    // `hit` is the already traced closest hit of the primary ray r. Light reaches the path when it
+    // escapes to the sky, when it hits an emitter and through the light samples at non-specular hits.
+    // The radiance found past every non-specular hit is appended to `records` unless it is null,
+    // what diffuse hits reflect goes to the radiance cache
+    ColorRGB ray_color(
+        Ray r,
+        std::optional<Hit> hit,
+        std::minstd_rand & gen,
+        std::vector<PathGuide::Record> * records) const;
+
     Camera & camera_;
     HittableList & objects_;
+    RenderSettings settings_;
+
+    std::shared_ptr<BVH8> bvh_;            // refittable structure, null while a cached one is used
+    std::shared_ptr<Hittable> accelerator_;
+    std::shared_ptr<EnvironmentLight> environment_;
+    LightList lights_;                     // emitters of the current frame
+    PathGuide guide_;                      // learned during the current frame
+    std::shared_ptr<RadianceCache> cache_; // filled during the current frame, null when disabled
+    std::optional<uint64_t> scene_hash_;   // hash of the scene the cached structure was built for
+    unsigned int frame_;
 };
 
 
-#endif // RENDER_HPP
\ No newline at end of file
+#endif // RENDER_HPP
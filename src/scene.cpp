@@ -0,0 +1,209 @@
+#include "scene.hpp"
+#include "sphere.hpp"
+#include "moving_sphere.hpp"
+#include "plane.hpp"
+#include "material.hpp"
+
+
+#include <random>
+#include <cmath>
+#include <algorithm>
+
+
+HittableList random_scene(const unsigned int & seed, const double & bounce, const int & lights, const double & glass)
+{
+    HittableList world;
+
+    auto ground_material = std::make_shared<Lambertian>(ColorRGB(18, 255, 219) / 255);
+    world.add(std::make_shared<Plane>(Point3(0, 0, 0), Vec3(0, 1, 0), ground_material));
+
+    std::minstd_rand gen(seed);
+    std::uniform_real_distribution<float> uniform(0.0, 1.0);
+
+    // The default fraction of glass gives the thresholds 0.8 and 0.95
+    const double diffuse = (1 - glass) * 0.8 / 0.95;
+    const double metal = 1 - glass;
+
+    for (int a = -10; a <= 10; ++a) {
+        for (int b = -10; b <= 10; ++b) {
+
+            if (
+                std::pow(a, 2) + std::pow(b, 2) < 2 ||
+                std::pow(a - 3, 2) + std::pow(b, 2) < 2 ||
+                std::pow(a, 2) + std::pow(b - 3, 2) < 2)
+                continue;
+
+            float random_value = uniform(gen);
+            float radius = 0.125 + random_value * 0.25;
+
+            Point3 center(a + 0.5 * uniform(gen), radius, b + 0.5 * uniform(gen));
+
+            if ((center - Point3(4, 0.2, 0)).norm() > 0.9) {
+                std::shared_ptr<Material> sphere_material;
+
+                if (random_value < diffuse) {
+                    // diffuse
+                    auto albedo = 
+                        ColorRGB(uniform(gen), uniform(gen), uniform(gen)) *
+                        ColorRGB(uniform(gen), uniform(gen), uniform(gen));
+
+                    sphere_material = std::make_shared<Lambertian>(albedo);
+
+                    if (bounce > 0) {
+                        Point3 center_close = center + Vec3(0, bounce * uniform(gen), 0);
+                        world.add(std::make_shared<MovingSphere>(center, center_close, radius, sphere_material));
+                    } else {
+                        world.add(std::make_shared<Sphere>(center, radius, sphere_material));
+                    }
+                } else if (random_value < metal) {
+                    // metal
+                    auto albedo = ColorRGB(
+                        0.5 + 0.5 * uniform(gen), 0.5 + 0.5 * uniform(gen), 0.5 + 0.5 * uniform(gen));
+
+                    auto fuzz = 0.5 + 0.5 * uniform(gen);
+                    sphere_material = std::make_shared<Metal>(albedo, fuzz);
+                    world.add(std::make_shared<Sphere>(center, radius, sphere_material));
+                } else {
+                    // glass
+                    sphere_material = std::make_shared<Dielectric>(1.5);
+                    world.add(std::make_shared<Sphere>(center, radius, sphere_material));
+                }
+            }
+        }
+    }
+
+    // Lights have their own generator so that the rest of the scene does not depend on their number
+    std::minstd_rand light_gen(seed + 1);
+
+    // Total emitted power does not depend on the number of lights, 24 lights have a radius of 0.15
+    double light_radius = 0.15 * std::sqrt(24.0 / std::max(lights, 1));
+
+    for (int i = 0; i < lights; ++i) {
+        Point3 center(20 * uniform(light_gen) - 10, 2.2 + 0.8 * uniform(light_gen), 20 * uniform(light_gen) - 10);
+        ColorRGB emission = 40 * ColorRGB(1, 0.6 + 0.3 * uniform(light_gen), 0.3 + 0.4 * uniform(light_gen));
+
+        world.add(std::make_shared<Sphere>(center, light_radius, std::make_shared<DiffuseLight>(emission)));
+    }
+
+    auto material1 = std::make_shared<Dielectric>(1.5);
+    world.add(std::make_shared<Sphere>(Point3(3, 1, 0), 1, material1));
+
+    auto material2 = std::make_shared<Lambertian>(ColorRGB(248, 15, 17) / 255);
+    world.add(std::make_shared<Sphere>(Point3(0, 1, 3), 1, material2));
+
+    auto material3 = std::make_shared<Metal>(ColorRGB(0.7, 0.6, 0.5), 0.0);
+    world.add(std::make_shared<Sphere>(Point3(0, 1, 0), 1, material3));
+
+    return world;
+}
+
+
+Camera random_scene_camera(const double & aspect_ratio)
+{
+    Point3 look_from(10, 2, 6);
+    Point3 look_at(0, 0, 0);
+    Vec3 up(0, 1, 0);
+    auto dist_to_focus = (look_from - look_at).norm();
+    auto aperture = 1 / 5.6;
+
+    return Camera(look_from, look_at, up, 20, aspect_ratio, aperture, dist_to_focus);
+}
+
+
+HittableList sphere_field(const size_t & n, const unsigned int & seed)
+{
+    HittableList world;
+
+    std::minstd_rand gen(seed);
+    std::uniform_real_distribution<float> uniform(0.0, 1.0);
+
+    std::vector<std::shared_ptr<Material>> materials;
+    for (int i = 0; i < 16; ++i)
+        materials.push_back(std::make_shared<Lambertian>(ColorRGB(uniform(gen), uniform(gen), uniform(gen))));
+
+    // Keep the density of the random scene, about one sphere per unit square
+    double half_extent = std::sqrt(double(n)) / 2;
+
+    for (size_t i = 0; i < n; ++i) {
+        float radius = 0.125 + uniform(gen) * 0.25;
+        Point3 center(
+            (2 * uniform(gen) - 1) * half_extent,
+            radius,
+            (2 * uniform(gen) - 1) * half_extent);
+
+        world.add(std::make_shared<Sphere>(center, radius, materials[i % materials.size()]));
+    }
+
+    return world;
+}
+
+Camera sphere_field_camera(const size_t & n, const double & aspect_ratio)
+{
+    double half_extent = std::sqrt(double(n)) / 2;
+
+    Point3 look_from(0, 0.1 * half_extent + 1, -1.2 * half_extent - 2);
+    Point3 look_at(0, 0, 0);
+
+    return Camera(look_from, look_at, Vec3(0, 1, 0), 40, aspect_ratio, 0, (look_from - look_at).norm());
+}
+
+
+HittableList glossy_scene()
+{
+    HittableList world;
+
+    world.add(std::make_shared<Plane>(Point3(0, 0, 0), Vec3(0, 1, 0), std::make_shared<Metal>(ColorRGB(0.8, 0.8, 0.8), 0.1)));
+
+    world.add(std::make_shared<Sphere>(Point3(-2.5, 0.8, 1), 0.8, std::make_shared<Lambertian>(ColorRGB(0.7, 0.3, 0.2))));
+    world.add(std::make_shared<Sphere>(Point3(0, 0.8, 2), 0.8, std::make_shared<Metal>(ColorRGB(0.9, 0.9, 0.9), 0.3)));
+    world.add(std::make_shared<Sphere>(Point3(2.5, 0.8, 1), 0.8, std::make_shared<Lambertian>(ColorRGB(0.2, 0.4, 0.7))));
+
+    // Radiance falls with the area so every light emits the same power
+    const double radius[] = { 0.05, 0.2, 0.5, 1 };
+    for (int i = 0; i < 4; ++i) {
+        ColorRGB emission = float(1 / (radius[i] * radius[i])) * ColorRGB(1, 0.9, 0.8);
+        world.add(std::make_shared<Sphere>(Point3(3.2 * i - 4.8, 2.5, -6), radius[i], std::make_shared<DiffuseLight>(emission)));
+    }
+
+    return world;
+}
+
+Camera glossy_scene_camera(const double & aspect_ratio)
+{
+    Point3 look_from(0, 2, 10);
+    Point3 look_at(0, 0.5, 0);
+
+    return Camera(look_from, look_at, Vec3(0, 1, 0), 40, aspect_ratio, 0, (look_from - look_at).norm());
+}
+
+HittableList room_scene()
+{
+    HittableList world;
+
+    auto white = std::make_shared<Lambertian>(ColorRGB(0.73, 0.73, 0.73));
+    auto red = std::make_shared<Lambertian>(ColorRGB(0.65, 0.05, 0.05));
+    auto green = std::make_shared<Lambertian>(ColorRGB(0.12, 0.45, 0.15));
+
+    // Six walls enclosing [-3, 3] x [0, 5] x [-3, 3]
+    world.add(std::make_shared<Plane>(Point3(0, 0, 0), Vec3(0, 1, 0), white));
+    world.add(std::make_shared<Plane>(Point3(0, 5, 0), Vec3(0, -1, 0), white));
+    world.add(std::make_shared<Plane>(Point3(0, 0, -3), Vec3(0, 0, 1), white));
+    world.add(std::make_shared<Plane>(Point3(0, 0, 3), Vec3(0, 0, -1), white));
+    world.add(std::make_shared<Plane>(Point3(-3, 0, 0), Vec3(1, 0, 0), red));
+    world.add(std::make_shared<Plane>(Point3(3, 0, 0), Vec3(-1, 0, 0), green));
+
+    world.add(std::make_shared<Sphere>(Point3(-1.2, 1, -0.8), 1, white));
+    world.add(std::make_shared<Sphere>(Point3(1.4, 0.7, 0.4), 0.7, std::make_shared<Lambertian>(ColorRGB(0.3, 0.4, 0.7))));
+
+    world.add(std::make_shared<Sphere>(Point3(0, 4.4, 0), 0.4, std::make_shared<DiffuseLight>(ColorRGB(30, 28, 25))));
+
+    return world;
+}
+
+Camera room_scene_camera(const double & aspect_ratio)
+{
+    Point3 look_from(0, 2.5, 2.9);
+    Point3 look_at(0, 2, -3);
+
+    return Camera(look_from, look_at, Vec3(0, 1, 0), 75, aspect_ratio, 0, (look_from - look_at).norm());
+}
@@ -0,0 +1,42 @@
+#ifndef SCENE_HPP
+#define SCENE_HPP
+
+
+#include "hittable.hpp"
+#include "camera.hpp"
+
+
+// Ground plane with small spheres on a lattice and three large ones in the middle. The same seed
+// gives the same scene, which lets cached acceleration structures be reused between runs.
+// With a positive `bounce` the small diffuse spheres rise by up to that height over the shutter interval,
+// `lights` small emissive spheres of the same total power float above the lattice. A fraction `glass`
+// of the small spheres is glass, the rest keeps diffuse and metal spheres at a ratio of 16 to 3
+HittableList random_scene(
+    const unsigned int & seed = 0,
+    const double & bounce = 0,
+    const int & lights = 0,
+    const double & glass = 0.05);
+
+Camera random_scene_camera(const double & aspect_ratio);
+
+// `n` small diffuse spheres scattered over a square around the origin, without ground
+HittableList sphere_field(const size_t & n, const unsigned int & seed = 0);
+
+// Camera at a shallow angle over the field so that rays cross many spheres
+Camera sphere_field_camera(const size_t & n, const double & aspect_ratio);
+
+// Glossy metal floor with three spheres in front of four lights of equal power and growing size,
+// the floor reflects every light as a highlight
+HittableList glossy_scene();
+
+Camera glossy_scene_camera(const double & aspect_ratio);
+
+// Closed diffuse room with a red and a green wall, two spheres on the floor and a light under the ceiling.
+// No path escapes, most of the light reaching the walls has bounced several times
+HittableList room_scene();
+
+// Camera inside the room close to the front wall
+Camera room_scene_camera(const double & aspect_ratio);
+
+
+#endif // SCENE_HPP
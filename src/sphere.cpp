@@ -19,14 +19,42 @@ double Sphere::radius() const
 {
     return radius_;
 }
+
+std::shared_ptr<Material> Sphere::material() const
+{
+    return material_;
+}
+
+void Sphere::set_center(const Point3 & center)
+{
+    center_ = center;
+}
     
 std::optional<Hit> Sphere::trace(const Ray & r, double t_min, double t_max) const
 {
-    Vec3 oc = r.origin() - center_;
+    return intersect(center_, radius_, material_, r, t_min, t_max);
+}
+
+void Sphere::trace_batch(std::span<const Ray> rays, double t_min, double t_max, std::span<std::optional<Hit>> hits) const
+{
+    for (size_t k = 0; k < rays.size(); ++k)
+        if (auto hit = intersect(center_, radius_, material_, rays[k], t_min, hits[k] ? hits[k] -> solution : t_max))
+            hits[k] = hit;
+}
+
+std::optional<Hit> Sphere::intersect(
+    const Point3 & center,
+    const double & radius,
+    const std::shared_ptr<Material> & material,
+    const Ray & r,
+    double t_min,
+    double t_max)
+{
+    Vec3 oc = r.origin() - center;
 
     double a = r.direction().norm_squared();
     double b = dot(oc, r.direction());
-    double c = oc.norm_squared() - radius_ * radius_;
+    double c = oc.norm_squared() - radius * radius;
     double d = b * b - a * c;
 
     if (d < 0)
@@ -43,8 +71,38 @@ std::optional<Hit> Sphere::trace(const Ray & r, double t_min, double t_max) cons
     }
 
     Point3 p = r(t);
-    Vec3 n_out = (p - center_) / radius_;
+    Vec3 n_out = (p - center) / radius;
     bool front_face = dot(r.direction(), n_out) < 0;
 
-    return Hit { p, front_face ? n_out : -n_out, t, front_face, material_ };
+    return Hit { p, front_face ? n_out : -n_out, t, front_face, material };
+}
+
+bool Sphere::occluded(const Ray & r, double t_min, double t_max) const
+{
+    return intersects(center_, radius_, r, t_min, t_max);
+}
+
+bool Sphere::intersects(const Point3 & center, const double & radius, const Ray & r, double t_min, double t_max)
+{
+    Vec3 oc = r.origin() - center;
+
+    double a = r.direction().norm_squared();
+    double b = dot(oc, r.direction());
+    double c = oc.norm_squared() - radius * radius;
+    double d = b * b - a * c;
+
+    if (d < 0)
+        return false;
+
+    double d_sqrt = std::sqrt(d);
+    double t_near = (-b - d_sqrt) / a;
+    double t_far = (-b + d_sqrt) / a;
+
+    return (t_min <= t_near && t_near <= t_max) || (t_min <= t_far && t_far <= t_max);
+}
+
+AABB Sphere::bounding_box() const
+{
+    Vec3 r(radius_, radius_, radius_);
+    return AABB(center_ - r, center_ + r);
 }
@@ -6,17 +6,45 @@
 #include "hittable.hpp"
 #include "material.hpp"
 
+#include <cstdint>
 #include <optional>
 
 
+// Plain sphere for flat primitive arrays, the material is an index into a separate table
+struct SphereRecord {
+    Point3 center;
+    double radius;
+    uint32_t material;
+};
+
+
 class Sphere : public Hittable {
 public:
     Sphere(const Point3 & center, const double & radius, std::shared_ptr<Material> material);
     Point3 center() const;
     double radius() const;
+    std::shared_ptr<Material> material() const;
+
+    void set_center(const Point3 & center);
     
     virtual std::optional<Hit> trace(const Ray & r, double t_min, double t_max) const override;
 
+    virtual void trace_batch(std::span<const Ray> rays, double t_min, double t_max, std::span<std::optional<Hit>> hits) const override;
+
+    virtual bool occluded(const Ray & r, double t_min, double t_max) const override;
+
+    virtual AABB bounding_box() const override;
+
+    static std::optional<Hit> intersect(
+        const Point3 & center,
+        const double & radius,
+        const std::shared_ptr<Material> & material,
+        const Ray & r,
+        double t_min,
+        double t_max);
+
+    static bool intersects(const Point3 & center, const double & radius, const Ray & r, double t_min, double t_max);
+
 private:
 
     Point3 center_;
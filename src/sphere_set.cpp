@@ -0,0 +1,345 @@
+#include "sphere_set.hpp"
+#include "sphere.hpp"
+
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <limits>
+
+#if defined(__AVX512F__) && defined(__GNUC__) && !defined(__clang__)
+// GCC 12 flags the undefined vector placeholders inside its own AVX-512 intrinsic headers
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+
+
+namespace {
+
+// Single precision tests accept spheres within these relative tolerances, every candidate is
+// confirmed in double precision, so a loose test only costs an extra confirmation
+constexpr float discriminant_slack = 1e-4f;
+constexpr float distance_slack = 1e-3f;
+
+// Bound of the rounding error of the center to line distance per unit of |o| + |oc| (both as 1-norms),
+// coordinates far from the origin lose absolute precision in single precision
+constexpr float position_error = 8 * std::numeric_limits<float>::epsilon();
+
+} // namespace
+
+
+SphereSet::SphereSet(const std::vector<std::shared_ptr<Hittable>> & objects)
+{
+    for (const auto & object : objects)
+        if (auto sphere = dynamic_cast<const Sphere *>(object.get()))
+            add(sphere -> center(), sphere -> radius(), sphere -> material());
+}
+
+SphereSet::SphereSet(const HittableList & list) :
+    SphereSet(list.objects())
+{}
+
+void SphereSet::add(const Point3 & center, const double & radius, std::shared_ptr<Material> material)
+{
+    auto [it, inserted] = material_index_.emplace(material.get(), materials_.size());
+    if (inserted)
+        materials_.push_back(material);
+
+    center_x_.resize(size_);
+    center_y_.resize(size_);
+    center_z_.resize(size_);
+    radius_.resize(size_);
+    material_.resize(size_);
+
+    center_x_.push_back(center.x);
+    center_y_.push_back(center.y);
+    center_z_.push_back(center.z);
+    radius_.push_back(radius);
+    material_.push_back(it -> second);
+
+    exact_center_.push_back(center);
+    exact_radius_.push_back(radius);
+
+    ++size_;
+    pad();
+}
+
+void SphereSet::pad()
+{
+    center_x_.resize(size_ + width, 0);
+    center_y_.resize(size_ + width, 0);
+    center_z_.resize(size_ + width, 0);
+    radius_.resize(size_ + width, 0);
+    material_.resize(size_ + width, 0);
+}
+
+size_t SphereSet::size() const
+{
+    return size_;
+}
+
+int SphereSet::candidates(
+    uint32_t first,
+    uint32_t count,
+    const Ray & r,
+    float t_min,
+    float t_max,
+    float distances[]) const
+{
+    // With oc = o - c, b = <oc, d> and a = <d, d>, the distance of the center to the line is |oc - (b / a) d|.
+    // Subtracting its square from r^2 gives the discriminant divided by a without the cancellation of
+    // b^2 - a c, and the roots are -b / a -+ sqrt(disc / a)
+    // The discriminant is widened by the rounding error e of |l| for lines grazing the sphere,
+    // e (2 r + 3 e) covers (r + e)^2 - r^2 and the rounding of the squares
+    Point3 o = r.origin();
+    Vec3 d = r.direction();
+    float inv_a = float(1 / d.norm_squared());
+    float o_norm = float(std::abs(o.x) + std::abs(o.y) + std::abs(o.z));
+
+#if defined(__AVX512F__)
+    __mmask16 mask = count >= 16 ? 0xffff : (1u << count) - 1;
+
+    __m512 o_x = _mm512_set1_ps(o.x), o_y = _mm512_set1_ps(o.y), o_z = _mm512_set1_ps(o.z);
+    __m512 d_x = _mm512_set1_ps(d.x), d_y = _mm512_set1_ps(d.y), d_z = _mm512_set1_ps(d.z);
+
+    __m512 oc_x = _mm512_sub_ps(o_x, _mm512_loadu_ps(center_x_.data() + first));
+    __m512 oc_y = _mm512_sub_ps(o_y, _mm512_loadu_ps(center_y_.data() + first));
+    __m512 oc_z = _mm512_sub_ps(o_z, _mm512_loadu_ps(center_z_.data() + first));
+    __m512 radius = _mm512_loadu_ps(radius_.data() + first);
+
+    __m512 b = _mm512_fmadd_ps(oc_x, d_x, _mm512_fmadd_ps(oc_y, d_y, _mm512_mul_ps(oc_z, d_z)));
+    __m512 s = _mm512_mul_ps(b, _mm512_set1_ps(inv_a));
+
+    __m512 l_x = _mm512_fnmadd_ps(s, d_x, oc_x);
+    __m512 l_y = _mm512_fnmadd_ps(s, d_y, oc_y);
+    __m512 l_z = _mm512_fnmadd_ps(s, d_z, oc_z);
+
+    __m512 r2 = _mm512_mul_ps(radius, radius);
+    __m512 disc = _mm512_sub_ps(r2, _mm512_fmadd_ps(l_x, l_x, _mm512_fmadd_ps(l_y, l_y, _mm512_mul_ps(l_z, l_z))));
+
+    __m512 oc_norm = _mm512_add_ps(_mm512_add_ps(_mm512_abs_ps(oc_x), _mm512_abs_ps(oc_y)), _mm512_abs_ps(oc_z));
+    __m512 e = _mm512_mul_ps(_mm512_add_ps(oc_norm, _mm512_set1_ps(o_norm)), _mm512_set1_ps(position_error));
+    __m512 widening = _mm512_fmadd_ps(
+        e, _mm512_fmadd_ps(_mm512_set1_ps(3), e, _mm512_add_ps(radius, radius)),
+        _mm512_mul_ps(r2, _mm512_set1_ps(discriminant_slack)));
+
+    disc = _mm512_add_ps(disc, widening);
+
+    mask = _mm512_mask_cmp_ps_mask(mask, disc, _mm512_setzero_ps(), _CMP_GE_OQ);
+
+    __m512 q = _mm512_sqrt_ps(_mm512_mul_ps(_mm512_max_ps(disc, _mm512_setzero_ps()), _mm512_set1_ps(inv_a)));
+    __m512 near = _mm512_sub_ps(_mm512_sub_ps(_mm512_setzero_ps(), s), q);
+    __m512 far = _mm512_sub_ps(q, s);
+
+    __m512 slack = _mm512_fmadd_ps(_mm512_abs_ps(s), _mm512_set1_ps(distance_slack), _mm512_set1_ps(distance_slack));
+
+    mask = _mm512_mask_cmp_ps_mask(mask, _mm512_add_ps(far, slack), _mm512_set1_ps(t_min), _CMP_GE_OQ);
+    mask = _mm512_mask_cmp_ps_mask(mask, _mm512_sub_ps(near, slack), _mm512_set1_ps(t_max), _CMP_LE_OQ);
+
+    _mm512_storeu_ps(distances, _mm512_max_ps(_mm512_sub_ps(near, slack), _mm512_set1_ps(t_min)));
+
+    return mask;
+#elif defined(__AVX2__)
+    __m256 lanes = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+    __m256 mask = _mm256_cmp_ps(lanes, _mm256_set1_ps(float(count)), _CMP_LT_OQ);
+
+    __m256 o_x = _mm256_set1_ps(o.x), o_y = _mm256_set1_ps(o.y), o_z = _mm256_set1_ps(o.z);
+    __m256 d_x = _mm256_set1_ps(d.x), d_y = _mm256_set1_ps(d.y), d_z = _mm256_set1_ps(d.z);
+
+    __m256 oc_x = _mm256_sub_ps(o_x, _mm256_loadu_ps(center_x_.data() + first));
+    __m256 oc_y = _mm256_sub_ps(o_y, _mm256_loadu_ps(center_y_.data() + first));
+    __m256 oc_z = _mm256_sub_ps(o_z, _mm256_loadu_ps(center_z_.data() + first));
+    __m256 radius = _mm256_loadu_ps(radius_.data() + first);
+
+    __m256 b = _mm256_fmadd_ps(oc_x, d_x, _mm256_fmadd_ps(oc_y, d_y, _mm256_mul_ps(oc_z, d_z)));
+    __m256 s = _mm256_mul_ps(b, _mm256_set1_ps(inv_a));
+
+    __m256 l_x = _mm256_fnmadd_ps(s, d_x, oc_x);
+    __m256 l_y = _mm256_fnmadd_ps(s, d_y, oc_y);
+    __m256 l_z = _mm256_fnmadd_ps(s, d_z, oc_z);
+
+    __m256 r2 = _mm256_mul_ps(radius, radius);
+    __m256 disc = _mm256_sub_ps(r2, _mm256_fmadd_ps(l_x, l_x, _mm256_fmadd_ps(l_y, l_y, _mm256_mul_ps(l_z, l_z))));
+
+    __m256 sign = _mm256_set1_ps(-0.0f);
+    __m256 oc_norm = _mm256_add_ps(
+        _mm256_add_ps(_mm256_andnot_ps(sign, oc_x), _mm256_andnot_ps(sign, oc_y)),
+        _mm256_andnot_ps(sign, oc_z));
+    __m256 e = _mm256_mul_ps(_mm256_add_ps(oc_norm, _mm256_set1_ps(o_norm)), _mm256_set1_ps(position_error));
+    __m256 widening = _mm256_fmadd_ps(
+        e, _mm256_fmadd_ps(_mm256_set1_ps(3), e, _mm256_add_ps(radius, radius)),
+        _mm256_mul_ps(r2, _mm256_set1_ps(discriminant_slack)));
+
+    disc = _mm256_add_ps(disc, widening);
+
+    mask = _mm256_and_ps(mask, _mm256_cmp_ps(disc, _mm256_setzero_ps(), _CMP_GE_OQ));
+
+    __m256 q = _mm256_sqrt_ps(_mm256_mul_ps(_mm256_max_ps(disc, _mm256_setzero_ps()), _mm256_set1_ps(inv_a)));
+    __m256 near = _mm256_sub_ps(_mm256_sub_ps(_mm256_setzero_ps(), s), q);
+    __m256 far = _mm256_sub_ps(q, s);
+
+    __m256 abs_s = _mm256_andnot_ps(sign, s);
+    __m256 slack = _mm256_fmadd_ps(abs_s, _mm256_set1_ps(distance_slack), _mm256_set1_ps(distance_slack));
+
+    mask = _mm256_and_ps(mask, _mm256_cmp_ps(_mm256_add_ps(far, slack), _mm256_set1_ps(t_min), _CMP_GE_OQ));
+    mask = _mm256_and_ps(mask, _mm256_cmp_ps(_mm256_sub_ps(near, slack), _mm256_set1_ps(t_max), _CMP_LE_OQ));
+
+    _mm256_storeu_ps(distances, _mm256_max_ps(_mm256_sub_ps(near, slack), _mm256_set1_ps(t_min)));
+
+    return _mm256_movemask_ps(mask);
+#else
+    int mask = 0;
+
+    for (uint32_t i = 0; i < count; ++i) {
+        float oc_x = float(o.x) - center_x_[first + i];
+        float oc_y = float(o.y) - center_y_[first + i];
+        float oc_z = float(o.z) - center_z_[first + i];
+
+        float s = (oc_x * float(d.x) + oc_y * float(d.y) + oc_z * float(d.z)) * inv_a;
+
+        float l_x = oc_x - s * float(d.x);
+        float l_y = oc_y - s * float(d.y);
+        float l_z = oc_z - s * float(d.z);
+
+        float r2 = radius_[first + i] * radius_[first + i];
+        float disc = r2 - (l_x * l_x + l_y * l_y + l_z * l_z);
+
+        float e = (std::abs(oc_x) + std::abs(oc_y) + std::abs(oc_z) + o_norm) * position_error;
+        disc += e * (2 * radius_[first + i] + 3 * e) + discriminant_slack * r2;
+
+        float q = std::sqrt(std::max(disc, 0.0f) * inv_a);
+        float slack = std::abs(s) * distance_slack + distance_slack;
+
+        distances[i] = std::max(-s - q - slack, t_min);
+
+        mask |= (disc >= 0 && q - s + slack >= t_min && -s - q - slack <= t_max) << i;
+    }
+
+    return mask;
+#endif
+}
+
+int SphereSet::closest(const float distances[], int mask)
+{
+#if defined(__AVX512F__)
+    __m512 v = _mm512_loadu_ps(distances);
+    float lowest = _mm512_mask_reduce_min_ps(mask, v);
+
+    return std::countr_zero(static_cast<unsigned int>(_mm512_mask_cmp_ps_mask(mask, v, _mm512_set1_ps(lowest), _CMP_EQ_OQ)));
+#elif defined(__AVX2__)
+    __m256 v = _mm256_blendv_ps(
+        _mm256_set1_ps(std::numeric_limits<float>::infinity()),
+        _mm256_loadu_ps(distances),
+        _mm256_castsi256_ps(_mm256_cmpgt_epi32(
+            _mm256_and_si256(_mm256_set1_epi32(mask), _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128)),
+            _mm256_setzero_si256())));
+
+    // Pairwise minima across the lanes leave the minimum in every lane
+    __m256 m = _mm256_min_ps(v, _mm256_permute2f128_ps(v, v, 1));
+    m = _mm256_min_ps(m, _mm256_permute_ps(m, _MM_SHUFFLE(1, 0, 3, 2)));
+    m = _mm256_min_ps(m, _mm256_permute_ps(m, _MM_SHUFFLE(2, 3, 0, 1)));
+
+    return std::countr_zero(static_cast<unsigned int>(_mm256_movemask_ps(_mm256_cmp_ps(v, m, _CMP_EQ_OQ)) & mask));
+#else
+    int best = std::countr_zero(static_cast<unsigned int>(mask));
+
+    for (int rest = mask & (mask - 1); rest; rest &= rest - 1) {
+        int i = std::countr_zero(static_cast<unsigned int>(rest));
+        if (distances[i] < distances[best])
+            best = i;
+    }
+
+    return best;
+#endif
+}
+
+std::optional<Hit> SphereSet::confirm(uint32_t i, const Ray & r, double t_min, double t_max) const
+{
+    return Sphere::intersect(exact_center_[i], exact_radius_[i], materials_[material_[i]], r, t_min, t_max);
+}
+
+void SphereSet::intersect(
+    uint32_t first,
+    uint32_t count,
+    const Ray & r,
+    double t_min,
+    double & t_max,
+    std::optional<Hit> & hit) const
+{
+    float distances[width];
+
+    for (uint32_t begin = first; begin < first + count; begin += width) {
+        uint32_t n = std::min<uint32_t>(width, first + count - begin);
+
+        // Candidates are confirmed nearest first until the next one starts behind the closest hit
+        for (int mask = candidates(begin, n, r, t_min, t_max, distances); mask;) {
+            int i = closest(distances, mask);
+
+            if (distances[i] > t_max)
+                break;
+
+            if (auto hit_tmp = confirm(begin + i, r, t_min, t_max)) {
+                t_max = hit_tmp -> solution;
+                hit = hit_tmp;
+            }
+
+            mask &= ~(1 << i);
+        }
+    }
+}
+
+bool SphereSet::intersects(uint32_t first, uint32_t count, const Ray & r, double t_min, double t_max) const
+{
+    float distances[width];
+
+    for (uint32_t begin = first; begin < first + count; begin += width) {
+        uint32_t n = std::min<uint32_t>(width, first + count - begin);
+
+        for (int mask = candidates(begin, n, r, t_min, t_max, distances); mask; mask &= mask - 1) {
+            uint32_t i = begin + std::countr_zero(static_cast<unsigned int>(mask));
+
+            if (Sphere::intersects(exact_center_[i], exact_radius_[i], r, t_min, t_max))
+                return true;
+        }
+    }
+
+    return false;
+}
+
+std::optional<Hit> SphereSet::trace(const Ray & r, double t_min, double t_max) const
+{
+    std::optional<Hit> hit = std::nullopt;
+    intersect(0, size_, r, t_min, t_max, hit);
+
+    return hit;
+}
+
+bool SphereSet::occluded(const Ray & r, double t_min, double t_max) const
+{
+    return intersects(0, size_, r, t_min, t_max);
+}
+
+AABB SphereSet::bounding_box() const
+{
+    AABB box;
+
+    for (size_t i = 0; i < size_; ++i) {
+        Vec3 e(exact_radius_[i], exact_radius_[i], exact_radius_[i]);
+        box.extend(AABB(exact_center_[i] - e, exact_center_[i] + e));
+    }
+
+    return box;
+}
+
+size_t SphereSet::memory_usage() const
+{
+    return
+        (center_x_.size() + center_y_.size() + center_z_.size() + radius_.size()) * sizeof(float) +
+        material_.size() * sizeof(uint32_t) +
+        exact_center_.size() * sizeof(Point3) +
+        exact_radius_.size() * sizeof(double);
+}
@@ -8,6 +8,7 @@
 #include <algorithm>
 #include <ostream>
 #include <format>
+#include <type_traits>
 
 
 template<typename T, int D>
@@ -68,6 +69,9 @@ struct Vec : public VecBase<T, D>
     Vec(const T & e_1, const T & e_2, const T & e_3) : VecBase<T, D>(e_1, e_2, e_3) {}
     Vec(const T & e_1, const T & e_2, const T & e_3, const T & e_4) : VecBase<T, D>(e_1, e_2, e_3, e_4) {}
 
+    T & operator[] (const int & i);
+    T operator[] (const int & i) const;
+
     void operator*= (const T & c);
     void operator/= (const T & c);
     void operator+= (const T & c);
@@ -165,6 +169,12 @@ using Point3 = Vec<double, 3>;
 
 // Defintion
 
+template<typename T, int D>
+inline T & Vec<T, D>::operator[] (const int & i) { return reinterpret_cast<T *>(this)[i]; }
+
+template<typename T, int D>
+inline T Vec<T, D>::operator[] (const int & i) const { return reinterpret_cast<const T *>(this)[i]; }
+
 template<typename T, int D>
 inline void Vec<T, D>::operator*= (const T & v) { for (int i = 0; i < D; ++i) reinterpret_cast<T *>(this)[i] *= v; }
 
@@ -191,16 +201,16 @@ template <typename T, int D>
 inline Vec<T, D> Vec<T, D>::operator- (const T & v) const { Vec<T, D> u(*this); u -= v; return u; }
 
 
-template <typename T, typename U, int D>
+template <typename T, typename U, int D> requires std::is_arithmetic_v<U>
 inline Vec<T, D> operator* (const U & c, Vec<T, D> v) { Vec<T, D> u(v); u *= c; return u; }
 
-template <typename T, typename U, int D>
+template <typename T, typename U, int D> requires std::is_arithmetic_v<U>
 inline Vec<T, D> operator/ (const U & c, Vec<T, D> v) { Vec<T, D> u(v); u /= c; return u; }
 
-template <typename T, typename U, int D>
+template <typename T, typename U, int D> requires std::is_arithmetic_v<U>
 inline Vec<T, D> operator+ (const U & c, Vec<T, D> v) { Vec<T, D> u(v); u += c; return u; }
 
-template <typename T, typename U, int D>
+template <typename T, typename U, int D> requires std::is_arithmetic_v<U>
 inline Vec<T, D> operator- (const U & c, Vec<T, D> v) { Vec<T, D> u(v); u -= c; return u; }
 
 
@@ -0,0 +1,340 @@
+#include "wavefront.hpp"
+#include "parallel.hpp"
+#include "morton.hpp"
+
+
+#include <algorithm>
+#include <random>
+#include <typeindex>
+#include <typeinfo>
+#include <utility>
+
+
+namespace {
+
+constexpr int tile_size = 4;
+
+// Paths per task of the parallel stages
+constexpr size_t grain = 1024;
+
+std::minstd_rand seeded()
+{
+    std::random_device rd;
+    return std::minstd_rand(rd());
+}
+
+} // namespace
+
+
+Wavefront::Wavefront(const RenderSettings & settings) :
+    settings_(settings)
+{
+    const int image_w = settings_.width;
+    const int image_h = settings_.height;
+
+    order_.reserve(image_w * image_h);
+
+    for (int i_0 = 0; i_0 < image_h; i_0 += tile_size)
+        for (int j_0 = 0; j_0 < image_w; j_0 += tile_size)
+            for (int i = i_0; i < std::min(i_0 + tile_size, image_h); ++i)
+                for (int j = j_0; j < std::min(j_0 + tile_size, image_w); ++j)
+                    order_.push_back(i * image_w + j);
+
+    // Distinct pixels within a wave let the accumulation run without synchronization
+    size_t wave_size = std::clamp<size_t>(settings_.wave_size, 1, order_.size());
+
+    for (auto * v : { &o_x_, &o_y_, &o_z_, &d_x_, &d_y_, &d_z_, &time_, &scatter_pdf_, &n_x_, &n_y_, &n_z_, &shadow_x_, &shadow_y_, &shadow_z_, &shadow_distance_ })
+        v -> resize(wave_size);
+
+    throughput_.resize(wave_size);
+    radiance_.resize(wave_size);
+    pixel_.resize(wave_size);
+    hits_.resize(wave_size);
+    alive_.resize(wave_size);
+    light_sampled_.resize(wave_size);
+    shadow_radiance_.resize(wave_size);
+    active_.reserve(wave_size);
+    shadows_.reserve(wave_size);
+}
+
+Image<float, 3> Wavefront::render(const Camera & camera, const Hittable & accelerator, const LightList & lights)
+{
+    const size_t n_pixels = order_.size();
+    const size_t n_paths = n_pixels * settings_.n_samples;
+    const size_t wave_size = pixel_.size();
+
+    sums_.assign(n_pixels, { 0, 0, 0 });
+
+    for (size_t first = 0; first < n_paths; first += wave_size) {
+        size_t count = std::min(wave_size, n_paths - first);
+
+        generate(camera, first, count);
+
+        for (unsigned int depth = 0; depth < settings_.bounces && !active_.empty(); ++depth) {
+            if (depth > 0 && settings_.sort_rays)
+                sort();
+
+            extend(accelerator, depth == 0);
+            shade(depth, lights);
+            connect(accelerator);
+        }
+
+        accumulate(count);
+    }
+
+    Image<float, 3> img(settings_.width, settings_.height, { 0, 0, 0 });
+
+    for (int i = 0; i < settings_.height; ++i)
+        for (int j = 0; j < settings_.width; ++j)
+            img(i, j) = sqrt(sums_[i * settings_.width + j] / settings_.n_samples);
+
+    return img;
+}
+
+void Wavefront::generate(const Camera & camera, size_t first, size_t count)
+{
+    const int image_w = settings_.width;
+    const int image_h = settings_.height;
+
+    parallel_chunks(count, [&] (unsigned int, size_t begin, size_t end) {
+        std::minstd_rand gen = seeded();
+        std::uniform_real_distribution<float> uniform(0.0, 1.0);
+
+        for (size_t k = begin; k < end; ++k) {
+            uint32_t pixel = order_[(first + k) % order_.size()];
+            int i = pixel / image_w;
+            int j = pixel % image_w;
+
+            float u = (float(j) + uniform(gen)) / (image_w - 1);
+            float v = (image_h - 1 - float(i) + uniform(gen)) / (image_h - 1);
+
+            Ray r = camera.get_ray(u, v, gen);
+
+            o_x_[k] = r.origin().x;
+            o_y_[k] = r.origin().y;
+            o_z_[k] = r.origin().z;
+            d_x_[k] = r.direction().x;
+            d_y_[k] = r.direction().y;
+            d_z_[k] = r.direction().z;
+            time_[k] = r.time();
+
+            throughput_[k] = { 1, 1, 1 };
+            radiance_[k] = { 0, 0, 0 };
+            pixel_[k] = pixel;
+            light_sampled_[k] = 0;
+            shadow_distance_[k] = 0;
+        }
+    }, grain);
+
+    active_.resize(count);
+    for (size_t k = 0; k < count; ++k)
+        active_[k] = k;
+}
+
+void Wavefront::sort()
+{
+    const size_t n = active_.size();
+
+    std::vector<AABB> chunk_boxes(thread_count());
+
+    parallel_chunks(n, [&] (unsigned int c, size_t begin, size_t end) {
+        for (size_t k = begin; k < end; ++k) {
+            uint32_t path = active_[k];
+            chunk_boxes[c].extend(Point3(o_x_[path], o_y_[path], o_z_[path]));
+        }
+    }, grain);
+
+    AABB box;
+    for (const auto & b : chunk_boxes)
+        box.extend(b);
+
+    box = cube(box);
+
+    keys_.resize(n);
+
+    parallel_chunks(n, [&] (unsigned int, size_t begin, size_t end) {
+        for (size_t k = begin; k < end; ++k) {
+            uint32_t path = active_[k];
+            keys_[k] = ray_key(Point3(o_x_[path], o_y_[path], o_z_[path]), Vec3(d_x_[path], d_y_[path], d_z_[path]), box);
+        }
+    }, grain);
+
+    radix_sort(keys_, active_);
+}
+
+void Wavefront::extend(const Hittable & accelerator, bool primary)
+{
+    const double t_max = std::numeric_limits<float>::infinity();
+
+    // Primary rays of a wave come in whole tiles, batches are aligned to them
+    const size_t packet_size = tile_size * tile_size;
+
+    if (primary && settings_.packets) {
+        size_t n_packets = (active_.size() + packet_size - 1) / packet_size;
+
+        parallel_chunks(n_packets, [&] (unsigned int, size_t begin, size_t end) {
+            std::vector<Ray> rays;
+            rays.reserve(packet_size);
+
+            for (size_t p = begin; p < end; ++p) {
+                size_t first = p * packet_size;
+                size_t last = std::min(first + packet_size, active_.size());
+
+                rays.clear();
+                for (size_t k = first; k < last; ++k)
+                    rays.push_back(ray(active_[k]));
+
+                // Paths of a fresh wave are stored in generation order, active_[k] == k
+                std::fill(&hits_[first], &hits_[first] + rays.size(), std::nullopt);
+                accelerator.trace_batch(rays, 0.0001, t_max, std::span(&hits_[first], rays.size()));
+            }
+        }, grain / packet_size);
+
+        return;
+    }
+
+    parallel_chunks(active_.size(), [&] (unsigned int, size_t begin, size_t end) {
+        for (size_t k = begin; k < end; ++k) {
+            uint32_t path = active_[k];
+            hits_[path] = accelerator.trace(ray(path), 0.0001, t_max);
+        }
+    }, grain);
+}
+
+void Wavefront::shade(unsigned int depth, const LightList & lights)
+{
+    const bool sample_lights = settings_.next_event_estimation && lights.size() > 0;
+
+    // Misses terminate, hits are queued by the dynamic type of their material so that every
+    // queue runs a single scatter implementation
+    std::vector<std::pair<std::type_index, std::vector<uint32_t>>> queues;
+
+    for (uint32_t path : active_) {
+        alive_[path] = 0;
+
+        if (!hits_[path]) {
+            Vec3 direction(d_x_[path], d_y_[path], d_z_[path]);
+            radiance_[path] += throughput_[path] * background(direction, lights, light_sampled_[path], scatter_pdf_[path], settings_);
+            continue;
+        }
+
+        std::type_index type = typeid(*hits_[path] -> material);
+
+        auto queue = std::find_if(queues.begin(), queues.end(), [&] (const auto & q) { return q.first == type; });
+        if (queue == queues.end())
+            queue = queues.insert(queues.end(), { type, {} });
+
+        queue -> second.push_back(path);
+    }
+
+    for (const auto & [type, queue] : queues)
+        parallel_chunks(queue.size(), [&] (unsigned int, size_t begin, size_t end) {
+            std::minstd_rand gen = seeded();
+            std::uniform_real_distribution<float> uniform(0.0, 1.0);
+
+            for (size_t k = begin; k < end; ++k) {
+                uint32_t path = queue[k];
+                const Hit & hit = *hits_[path];
+                const Material & material = *hit.material;
+                Ray r = ray(path);
+
+                ColorRGB emitted = material.emitted(hit);
+                bool emits = emitted.r + emitted.g + emitted.b > 0;
+
+                // Light samples only reach the emitters on the light list, others are found by scattering alone
+                if (!light_sampled_[path] || (emits && !lights.contains(hit)))
+                    radiance_[path] += throughput_[path] * emitted;
+                else if (settings_.multiple_importance_sampling && emits)
+                    radiance_[path] += throughput_[path] * emitted *
+                        float(power_heuristic(scatter_pdf_[path], lights.pdf(r.origin(), Vec3(n_x_[path], n_y_[path], n_z_[path]), hit)));
+
+                light_sampled_[path] = sample_lights && !material.specular();
+
+                if (light_sampled_[path]) {
+                    if (auto light = lights.sample(hit.point, hit.normal, uniform(gen), uniform(gen), uniform(gen))) {
+                        ColorRGB f = material.evaluate(r, hit, light -> direction);
+
+                        float weight = settings_.multiple_importance_sampling ?
+                            power_heuristic(light -> pdf, material.pdf(r, hit, light -> direction)) : 1;
+
+                        if (f.r + f.g + f.b > 0) {
+                            shadow_x_[path] = light -> direction.x;
+                            shadow_y_[path] = light -> direction.y;
+                            shadow_z_[path] = light -> direction.z;
+                            shadow_distance_[path] = light -> distance * (1 - 1e-6);
+                            shadow_radiance_[path] = throughput_[path] * f * light -> radiance * (weight / light -> pdf);
+                        }
+                    }
+                }
+
+                auto scattered = material.scatter(r, hit);
+                if (!scattered)
+                    continue;
+
+                auto [attenuation, scattered_ray] = *scattered;
+                ColorRGB throughput = throughput_[path] * attenuation;
+
+                // Survivors of dark paths carry the energy of the stopped ones
+                float p = survival(throughput, depth + 1, settings_);
+
+                if (p < 1) {
+                    if (uniform(gen) >= p)
+                        continue;
+
+                    throughput /= p;
+                }
+
+                if (light_sampled_[path]) {
+                    scatter_pdf_[path] = material.pdf(r, hit, unit(scattered_ray.direction()));
+                    n_x_[path] = hit.normal.x;
+                    n_y_[path] = hit.normal.y;
+                    n_z_[path] = hit.normal.z;
+                }
+
+                throughput_[path] = throughput;
+                o_x_[path] = scattered_ray.origin().x;
+                o_y_[path] = scattered_ray.origin().y;
+                o_z_[path] = scattered_ray.origin().z;
+                d_x_[path] = scattered_ray.direction().x;
+                d_y_[path] = scattered_ray.direction().y;
+                d_z_[path] = scattered_ray.direction().z;
+                alive_[path] = 1;
+            }
+        }, grain);
+
+    // Light samples are kept for terminated paths as well
+    shadows_.clear();
+    for (uint32_t path : active_)
+        if (shadow_distance_[path] > 0)
+            shadows_.push_back(path);
+
+    // Compaction keeps the generation order, neighbouring paths stay close in the queue
+    std::erase_if(active_, [this] (uint32_t path) { return !alive_[path]; });
+}
+
+void Wavefront::connect(const Hittable & accelerator)
+{
+    parallel_chunks(shadows_.size(), [&] (unsigned int, size_t begin, size_t end) {
+        for (size_t k = begin; k < end; ++k) {
+            uint32_t path = shadows_[k];
+            Ray shadow(hits_[path] -> point, Vec3(shadow_x_[path], shadow_y_[path], shadow_z_[path]), time_[path]);
+
+            if (!accelerator.occluded(shadow, 0.0001, shadow_distance_[path]))
+                radiance_[path] += shadow_radiance_[path];
+
+            shadow_distance_[path] = 0;
+        }
+    }, grain);
+}
+
+void Wavefront::accumulate(size_t count)
+{
+    parallel_for(count, [this] (size_t k) {
+        sums_[pixel_[k]] += radiance_[k];
+    }, grain);
+}
+
+Ray Wavefront::ray(uint32_t path) const
+{
+    return Ray(Point3(o_x_[path], o_y_[path], o_z_[path]), Vec3(d_x_[path], d_y_[path], d_z_[path]), time_[path]);
+}
@@ -0,0 +1,85 @@
+#ifndef WAVEFRONT_HPP
+#define WAVEFRONT_HPP
+
+
+#include "render.hpp"
+#include "light.hpp"
+#include "camera.hpp"
+#include "hittable.hpp"
+#include "image.hpp"
+
+
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+
+// Breadth-first path tracer. A wave of paths is kept in SoA buffers and every bounce runs as a
+// sequence of batched stages, each of them spread over all threads:
+//   generate    camera rays of the wave, pixels in 4x4 tiles so that neighbouring paths are coherent
+//   sort        secondary rays by direction octant and origin (RenderSettings::sort_rays)
+//   extend      closest hits of the active paths, primary rays a tile at a time through Hittable::trace_batch
+//   shade       misses add the sky, hits are grouped by material type, add their emission, sample a light
+//               and scatter, Russian roulette
+//   connect     shadow rays of the light samples
+//   accumulate  radiance of the finished wave into the pixel sums
+// Each stage runs one kind of work over many paths, instead of one path through every kind of work.
+// The estimate is the same as the one of Render's depth-first path tracer
+class Wavefront {
+public:
+
+    Wavefront(const RenderSettings & settings);
+
+    Image<float, 3> render(const Camera & camera, const Hittable & accelerator, const LightList & lights);
+
+private:
+
+    // Starts paths [first, first + count) of the frame, path p is sample p / n_pixels of pixel order_[p % n_pixels]
+    void generate(const Camera & camera, size_t first, size_t count);
+
+    // Reorders active_ by ray_key within the cube around the active origins
+    void sort();
+
+    void extend(const Hittable & accelerator, bool primary);
+
+    void shade(unsigned int depth, const LightList & lights);
+
+    void connect(const Hittable & accelerator);
+
+    void accumulate(size_t count);
+
+    Ray ray(uint32_t path) const;
+
+    RenderSettings settings_;
+
+    std::vector<uint32_t> order_;   // pixels in tile order
+    std::vector<ColorRGB> sums_;    // radiance sums per pixel
+
+    // Path states, indexed by the position of the path in its wave
+    std::vector<double> o_x_, o_y_, o_z_;
+    std::vector<double> d_x_, d_y_, d_z_;
+    std::vector<double> time_;
+    std::vector<ColorRGB> throughput_;
+    std::vector<ColorRGB> radiance_;
+    std::vector<uint32_t> pixel_;
+    std::vector<std::optional<Hit>> hits_;
+    std::vector<uint8_t> alive_;
+
+    // Whether the origin of the ray sampled the lights, then the density of the ray direction and the
+    // normal at the origin, which weight emission found by the ray (see Render::ray_color)
+    std::vector<uint8_t> light_sampled_;
+    std::vector<double> scatter_pdf_;
+    std::vector<double> n_x_, n_y_, n_z_;
+
+    // Pending shadow rays from the current hit points, a distance of 0 marks paths without one
+    std::vector<double> shadow_x_, shadow_y_, shadow_z_;
+    std::vector<double> shadow_distance_;
+    std::vector<ColorRGB> shadow_radiance_;  // contribution when the light is visible
+    std::vector<uint32_t> shadows_;          // paths with a pending shadow ray
+
+    std::vector<uint32_t> active_;  // paths that still bounce, in generation or sorted order
+    std::vector<uint64_t> keys_;    // sort keys of the active paths
+};
+
+
+#endif // WAVEFRONT_HPP